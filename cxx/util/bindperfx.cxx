@@ -0,0 +1,249 @@
+/* -*- Mode: C++; c-basic-offset:4 ; -*- */
+/*
+ *
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+#include "mpi.h"
+#include "mpitestconf.h"
+#ifdef HAVE_IOSTREAM
+// Not all C++ compilers have iostream instead of iostream.h
+#include <iostream>
+#ifdef HAVE_NAMESPACE_STD
+// Those that do need the std namespace; otherwise, a bare "cout"
+// is likely to fail to compile
+using namespace std;
+#endif
+#else
+#include <iostream.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include "mpitestcxx.h"
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+/*
+ * Overhead of the C++ bindings over the C API.  Each operation below is
+ * run through the C binding and through the MPI:: objects (MPI::Comm,
+ * MPI::Datatype, MPI::Request, MPI::Win), in alternating blocks so that
+ * drift in the system affects both equally:
+ *
+ *   rank      - MPI_Comm_rank / Comm::Get_rank (pure wrapper cost)
+ *   typesize  - MPI_Type_size / Datatype::Get_size
+ *   sendrecv  - 8-byte exchange with a neighbor
+ *   isend     - Irecv, Isend and Waitall with a neighbor
+ *   allreduce - one int
+ *   barrier
+ *   putfence  - one int put to a neighbor, then a fence; skipped if the
+ *               RMA tests are disabled
+ *   error     - a send to an invalid rank, returned as an error code in C
+ *               (MPI_ERRORS_RETURN) and thrown as MPI::Exception in C++
+ *               (MPI::ERRORS_THROW_EXCEPTIONS); skipped if the C++
+ *               bindings were built without exception support
+ *
+ * The slowest process's time per call in each binding and the difference
+ * in nanoseconds are printed when MPITEST_VERBOSE is set.  The results of
+ * the communication calls and the error classes are checked.
+ *
+ * Options:
+ *   -n <reps>   calls per block for the communication cases (default
+ *               1000); the local cases use 100 times as many
+ */
+
+#define NROUNDS 5
+
+static bool verbose = false;
+static MPI::Intracomm comm;
+
+static void Report( const char *name, double tc, double tcxx )
+{
+    double t[2], tmax[2];
+
+    t[0] = tc;
+    t[1] = tcxx;
+    comm.Reduce( t, tmax, 2, MPI::DOUBLE, MPI::MAX, 0 );
+    if (comm.Get_rank() == 0 && verbose) {
+	printf( "%-10s%12.1f%12.1f%12.1f\n", name, 1.e9 * tmax[0],
+		1.e9 * tmax[1], 1.e9 * (tmax[1] - tmax[0]) );
+	fflush( stdout );
+    }
+}
+
+// Time n executions of cstmt and of cxxstmt, alternating NROUNDS times
+#define TIMEPAIR(name,n,cstmt,cxxstmt)					\
+    do {								\
+	double t_c = 0, t_x = 0, t0;					\
+	int    k_, r_;							\
+	for (r_=0; r_<NROUNDS; r_++) {					\
+	    comm.Barrier();						\
+	    t0 = MPI::Wtime();						\
+	    for (k_=0; k_<(n); k_++) { cstmt; }				\
+	    t_c += MPI::Wtime() - t0;					\
+	    comm.Barrier();						\
+	    t0 = MPI::Wtime();						\
+	    for (k_=0; k_<(n); k_++) { cxxstmt; }			\
+	    t_x += MPI::Wtime() - t0;					\
+	}								\
+	Report( name, t_c / (NROUNDS * (n)), t_x / (NROUNDS * (n)) );	\
+    } while (0)
+
+int main( int argc, char *argv[] )
+{
+    int            errs = 0, i, rank, size, partner, reps = 1000, nlocal;
+    int            r = 0, s = 0, sbuf[2], rbuf[2], sum;
+    int            rc, eclass, ncerr = 0, nthrow = 0;
+    bool           canthrow;
+    MPI_Request    creq[2];
+    MPI::Request   xreq[2];
+    MPI_Comm       ccomm;
+    MPI::Intracomm ecomm;
+
+    MTest_Init( );
+    if (getenv( "MPITEST_VERBOSE" )) verbose = true;
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-n" ) == 0 && i+1 < argc) {
+	    reps = atoi( argv[++i] );
+	}
+	else {
+	    cerr << "Unrecognized argument " << argv[i] << "\n";
+	    MPI::COMM_WORLD.Abort( 1 );
+	}
+    }
+    nlocal = 100 * reps;
+
+    comm    = MPI::COMM_WORLD;
+    rank    = comm.Get_rank();
+    size    = comm.Get_size();
+    partner = rank ^ 1;
+    if (partner >= size) partner = rank;
+
+    if (rank == 0 && verbose) {
+	printf( "%-10s%12s%12s%12s\n", "op", "C (ns)", "C++ (ns)",
+		"delta (ns)" );
+    }
+
+    // Local calls
+    TIMEPAIR( "rank", nlocal,
+	      MPI_Comm_rank( MPI_COMM_WORLD, &r ),
+	      r = MPI::COMM_WORLD.Get_rank() );
+    TIMEPAIR( "typesize", nlocal,
+	      MPI_Type_size( MPI_INT, &s ),
+	      s = MPI::INT.Get_size() );
+    if (r != rank || s != (int)sizeof(int)) {
+	errs++;
+	cout << "Get_rank returned " << r << " and Get_size returned " <<
+	    s << "\n";
+    }
+
+    // Point-to-point
+    sbuf[0] = rank;
+    sbuf[1] = -rank;
+    TIMEPAIR( "sendrecv", reps,
+	      MPI_Sendrecv( sbuf, 2, MPI_INT, partner, 0, rbuf, 2, MPI_INT,
+			    partner, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE ),
+	      comm.Sendrecv( sbuf, 2, MPI::INT, partner, 0, rbuf, 2,
+			     MPI::INT, partner, 0 ) );
+    if (rbuf[0] != partner || rbuf[1] != -partner) {
+	errs++;
+	cout << "Sendrecv received " << rbuf[0] << " from " << partner << "\n";
+    }
+    TIMEPAIR( "isend", reps,
+	      MPI_Irecv( rbuf, 2, MPI_INT, partner, 1, MPI_COMM_WORLD,
+			 &creq[0] );
+	      MPI_Isend( sbuf, 2, MPI_INT, partner, 1, MPI_COMM_WORLD,
+			 &creq[1] );
+	      MPI_Waitall( 2, creq, MPI_STATUSES_IGNORE ),
+	      xreq[0] = comm.Irecv( rbuf, 2, MPI::INT, partner, 1 );
+	      xreq[1] = comm.Isend( sbuf, 2, MPI::INT, partner, 1 );
+	      MPI::Request::Waitall( 2, xreq ) );
+    if (rbuf[0] != partner || rbuf[1] != -partner) {
+	errs++;
+	cout << "Irecv received " << rbuf[0] << " from " << partner << "\n";
+    }
+
+    // Collectives
+    TIMEPAIR( "allreduce", reps,
+	      MPI_Allreduce( &rank, &sum, 1, MPI_INT, MPI_SUM,
+			     MPI_COMM_WORLD ),
+	      comm.Allreduce( &rank, &sum, 1, MPI::INT, MPI::SUM ) );
+    if (sum != size * (size - 1) / 2) {
+	errs++;
+	cout << "Allreduce gave " << sum << "\n";
+    }
+    TIMEPAIR( "barrier", reps,
+	      MPI_Barrier( MPI_COMM_WORLD ),
+	      comm.Barrier() );
+
+#ifdef HAVE_MPI_WIN_CREATE
+    // RMA; each binding has its own window
+    int      cbuf = -1, xbuf = -1;
+    MPI_Win  cwin;
+    MPI::Win xwin;
+    MPI_Win_create( &cbuf, sizeof(int), sizeof(int), MPI_INFO_NULL,
+		    MPI_COMM_WORLD, &cwin );
+    xwin = MPI::Win::Create( &xbuf, sizeof(int), sizeof(int),
+			     MPI::INFO_NULL, comm );
+    MPI_Win_fence( 0, cwin );
+    xwin.Fence( 0 );
+    TIMEPAIR( "putfence", reps,
+	      MPI_Put( &rank, 1, MPI_INT, partner, 0, 1, MPI_INT, cwin );
+	      MPI_Win_fence( 0, cwin ),
+	      xwin.Put( &rank, 1, MPI::INT, partner, 0, 1, MPI::INT );
+	      xwin.Fence( 0 ) );
+    if (cbuf != partner || xbuf != partner) {
+	errs++;
+	cout << "Put gave " << cbuf << " (C) and " << xbuf << " (C++)\n";
+    }
+    MPI_Win_free( &cwin );
+    xwin.Free();
+#endif
+
+    // Error handling: error codes in C, exceptions in C++
+    MPI_Comm_dup( MPI_COMM_WORLD, &ccomm );
+    MPI_Comm_set_errhandler( ccomm, MPI_ERRORS_RETURN );
+    ecomm = comm.Dup();
+    ecomm.Set_errhandler( MPI::ERRORS_THROW_EXCEPTIONS );
+    // Some implementations are built without C++ exception support; the
+    // error handler is then a no-op, so check that an exception is thrown
+    // before timing
+    canthrow = false;
+    try {
+	ecomm.Send( sbuf, 1, MPI::INT, size, 0 );
+    }
+    catch (MPI::Exception &e) {
+	canthrow = true;
+    }
+    if (canthrow) {
+	TIMEPAIR( "error", reps,
+		  rc = MPI_Send( sbuf, 1, MPI_INT, size, 0, ccomm );
+		  if (rc != MPI_SUCCESS) {
+		      MPI_Error_class( rc, &eclass );
+		      if (eclass == MPI_ERR_RANK) ncerr++;
+		  },
+		  try {
+		      ecomm.Send( sbuf, 1, MPI::INT, size, 0 );
+		  }
+		  catch (MPI::Exception &e) {
+		      if (e.Get_error_class() == MPI::ERR_RANK) nthrow++;
+		  } );
+	if (ncerr != NROUNDS * reps || nthrow != NROUNDS * reps) {
+	    errs++;
+	    cout << "Expected " << NROUNDS * reps <<
+		" MPI_ERR_RANK errors, got " << ncerr << " (C) and " <<
+		nthrow << " (C++)\n";
+	}
+    }
+    else if (rank == 0 && verbose) {
+	printf( "error: MPI::ERRORS_THROW_EXCEPTIONS does not throw; "
+		"not timed\n" );
+    }
+    MPI_Comm_free( &ccomm );
+    ecomm.Free();
+
+    MTest_Finalize( errs );
+    MPI::Finalize();
+    return 0;
+}
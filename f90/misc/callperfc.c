@@ -0,0 +1,86 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+/*
+ * C half of callperff90: the same operations that the Fortran program
+ * times through the Fortran binding, timed here through the C binding.
+ * The operation codes must match those in callperff90.f90.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "mpi.h"
+#include "../../include/mpitestconf.h"
+
+/*
+   Name mapping.  All routines are created with names that are lower case
+   with a single trailing underscore.  This matches many compilers.
+   We use #define to change the name for Fortran compilers that do
+   not use the lowercase/underscore pattern
+*/
+#ifdef F77_NAME_UPPER
+#define cptime_ CPTIME
+#define cpverbose_ CPVERBOSE
+#elif defined(F77_NAME_LOWER) || defined(F77_NAME_MIXED)
+/* Mixed is ok because we use lowercase in all uses */
+#define cptime_ cptime
+#define cpverbose_ cpverbose
+#elif defined(F77_NAME_LOWER_2USCORE) || defined(F77_NAME_LOWER_USCORE) || \
+      defined(F77_NAME_MIXED_USCORE)
+/* Else leave name alone (routines have no underscore, so both
+   of these map to a lowercase, single underscore) */
+#else
+#error 'Unrecognized Fortran name mapping'
+#endif
+
+/* Prototypes to keep compilers happy */
+void cptime_( MPI_Fint *, MPI_Fint *, MPI_Fint *, MPI_Fint *, double * );
+void cpverbose_( MPI_Fint * );
+
+/* Operation codes, as in callperff90.f90 */
+#define OP_RANK      1
+#define OP_SENDRECV  2
+#define OP_ALLREDUCE 3
+#define OP_BARRIER   4
+
+/* Return the time for reps executions of operation op on fcomm */
+void cptime_( MPI_Fint *op, MPI_Fint *fcomm, MPI_Fint *partner,
+	      MPI_Fint *reps, double *t )
+{
+    MPI_Comm    comm = MPI_Comm_f2c( *fcomm );
+    MPI_Request req;
+    int         i, n = *reps, rank, sbuf = 0, rbuf, sum;
+    double      t0;
+
+    MPI_Barrier( comm );
+    t0 = MPI_Wtime();
+    switch (*op) {
+    case OP_RANK:
+	for (i=0; i<n; i++) MPI_Comm_rank( comm, &rank );
+	break;
+    case OP_SENDRECV:
+	for (i=0; i<n; i++) {
+	    MPI_Irecv( &rbuf, 1, MPI_INT, *partner, 0, comm, &req );
+	    MPI_Send( &sbuf, 1, MPI_INT, *partner, 0, comm );
+	    MPI_Wait( &req, MPI_STATUS_IGNORE );
+	}
+	break;
+    case OP_ALLREDUCE:
+	for (i=0; i<n; i++)
+	    MPI_Allreduce( &sbuf, &sum, 1, MPI_INT, MPI_SUM, comm );
+	break;
+    case OP_BARRIER:
+	for (i=0; i<n; i++) MPI_Barrier( comm );
+	break;
+    default:
+	break;
+    }
+    *t = MPI_Wtime() - t0;
+}
+
+/* Set flag to 1 if MPITEST_VERBOSE is set, as the C tests check */
+void cpverbose_( MPI_Fint *flag )
+{
+    *flag = getenv( "MPITEST_VERBOSE" ) ? 1 : 0;
+}
@@ -0,0 +1,210 @@
+! -*- Mode: Fortran; -*-
+!
+!  (C) 2013 by Argonne National Laboratory.
+!      See COPYRIGHT in top-level directory.
+!
+! Cost of the Fortran binding compared with the C binding, and of the
+! temporary copies that a Fortran compiler may make when a noncontiguous
+! array section is passed to an MPI routine.
+!
+! The first part times the same operations (MPI_Comm_rank, a one-integer
+! Irecv/Send/Wait exchange with a neighbor, a one-integer Allreduce and
+! MPI_Barrier) through the Fortran binding in this program and through
+! the C binding in callperfc.c, and reports the difference per call.
+!
+! The second part checks whether passing a strided section a(1:2*n:2)
+! as a choice buffer makes a copy, by comparing the address that
+! MPI_Get_address sees with that of a(1).  Such a copy is harmless for
+! MPI_Send, but with MPI_Isend or MPI_Irecv the temporary may be gone
+! before the operation completes.  It then times sending n doubles as a
+! contiguous array, as the section, and as the same elements described
+! with an MPI vector datatype (which needs no copy), and reports the cost
+! of the section relative to the other two.
+!
+! Results are printed when MPITEST_VERBOSE is set.
+!
+      program main
+      use mpi
+      integer ierr, errs, comm, rank, size, partner, iverb
+      integer op, r, reps, nrounds
+      parameter (nrounds=5)
+      double precision tf, tc, tfsum, tcsum, tmax(2), tloc(2)
+      character*10 opname(4)
+      logical verbose
+      common /flags/ verbose
+      data opname /'rank', 'sendrecv', 'allreduce', 'barrier'/
+
+      errs = 0
+      call MTest_Init( ierr )
+      call cpverbose( iverb )
+      verbose = iverb .ne. 0
+
+      comm = MPI_COMM_WORLD
+      call mpi_comm_rank( comm, rank, ierr )
+      call mpi_comm_size( comm, size, ierr )
+      partner = ieor( rank, 1 )
+      if (partner .ge. size) partner = rank
+
+      if (rank .eq. 0 .and. verbose) then
+         write(*,'(a10,3a14)') 'op', 'Fortran (ns)', 'C (ns)', &
+      &        'delta (ns)'
+      endif
+      do op=1, 4
+         reps = 1000
+         if (op .eq. 1) reps = 100000
+         tfsum = 0.0d0
+         tcsum = 0.0d0
+!        Alternate the two bindings so that drift affects both equally
+         do r=1, nrounds
+            call fptime( op, comm, partner, reps, tf )
+            call cptime( op, comm, partner, reps, tc )
+            tfsum = tfsum + tf
+            tcsum = tcsum + tc
+         enddo
+         tloc(1) = tfsum / (nrounds * reps)
+         tloc(2) = tcsum / (nrounds * reps)
+         call mpi_reduce( tloc, tmax, 2, MPI_DOUBLE_PRECISION, MPI_MAX, &
+      &        0, comm, ierr )
+         if (rank .eq. 0 .and. verbose) then
+            write(*,'(a10,3f14.1)') opname(op), 1.0d9 * tmax(1), &
+      &           1.0d9 * tmax(2), 1.0d9 * (tmax(1) - tmax(2))
+         endif
+      enddo
+
+      call test_sections( comm, partner, errs )
+
+      call MTest_Finalize( errs )
+      call MPI_Finalize( ierr )
+      end
+!
+! Time reps executions of operation op through the Fortran binding.  The
+! operation codes must match those in callperfc.c
+!
+      subroutine fptime( op, comm, partner, reps, t )
+      use mpi
+      integer op, comm, partner, reps
+      double precision t
+      integer i, ierr, rank, sbuf, rbuf, isum, req
+
+      sbuf = 0
+      call mpi_barrier( comm, ierr )
+      t = mpi_wtime()
+      if (op .eq. 1) then
+         do i=1, reps
+            call mpi_comm_rank( comm, rank, ierr )
+         enddo
+      else if (op .eq. 2) then
+         do i=1, reps
+            call mpi_irecv( rbuf, 1, MPI_INTEGER, partner, 0, comm, &
+      &           req, ierr )
+            call mpi_send( sbuf, 1, MPI_INTEGER, partner, 0, comm, ierr )
+            call mpi_wait( req, MPI_STATUS_IGNORE, ierr )
+         enddo
+      else if (op .eq. 3) then
+         do i=1, reps
+            call mpi_allreduce( sbuf, isum, 1, MPI_INTEGER, MPI_SUM, &
+      &           comm, ierr )
+         enddo
+      else if (op .eq. 4) then
+         do i=1, reps
+            call mpi_barrier( comm, ierr )
+         enddo
+      endif
+      t = mpi_wtime() - t
+      end
+!
+! Detect and time the copies made for strided array sections
+!
+      subroutine test_sections( comm, partner, errs )
+      use mpi
+      integer comm, partner, errs
+      integer maxn
+      parameter (maxn=65536)
+      double precision, allocatable :: a(:), b(:), rbuf(:)
+      double precision t(3), tmax(3), expected
+      integer (kind=MPI_ADDRESS_KIND) addr1, addr2, addr3
+      integer i, k, n, reps, rank, vtype, req, ierr, meth
+      logical verbose
+      common /flags/ verbose
+
+      call mpi_comm_rank( comm, rank, ierr )
+!     The buffers are too large to be local arrays on a small stack
+      allocate( a(2*maxn), b(maxn), rbuf(maxn) )
+      do i=1, 2*maxn
+         a(i) = rank * 1.0d6 + i
+      enddo
+      do i=1, maxn
+         b(i) = a(2*i-1)
+      enddo
+
+!     A contiguous section should be passed in place; a strided one may
+!     be copied into a temporary
+      n = 1024
+      call mpi_get_address( a(1), addr1, ierr )
+      call mpi_get_address( a(1:n), addr2, ierr )
+      call mpi_get_address( a(1:2*n:2), addr3, ierr )
+      if (rank .eq. 0 .and. verbose) then
+         if (addr2 .ne. addr1) then
+            print *, 'Contiguous section a(1:n) is copied'
+         endif
+         if (addr3 .ne. addr1) then
+            print *, 'Strided section a(1:2*n:2) is copied; it must', &
+      &           ' not be used with nonblocking routines'
+         else
+            print *, 'Strided section a(1:2*n:2) is passed in place'
+         endif
+         write(*,'(a8,3a14,2a10)') 'count', 'contig (us)', &
+      &        'section (us)', 'vector (us)', 'sec/con', 'sec/vec'
+      endif
+
+      n = 16
+      do while (n .le. maxn)
+         reps = 100000 / (n + 100) + 2
+         call mpi_type_vector( n, 1, 2, MPI_DOUBLE_PRECISION, vtype, &
+      &        ierr )
+         call mpi_type_commit( vtype, ierr )
+         do meth=1, 3
+            do i=1, n
+               rbuf(i) = -1.0d0
+            enddo
+            call mpi_barrier( comm, ierr )
+            t(meth) = mpi_wtime()
+            do k=1, reps
+               call mpi_irecv( rbuf, n, MPI_DOUBLE_PRECISION, partner, &
+      &              0, comm, req, ierr )
+               if (meth .eq. 1) then
+                  call mpi_send( b, n, MPI_DOUBLE_PRECISION, partner, &
+      &                 0, comm, ierr )
+               else if (meth .eq. 2) then
+                  call mpi_send( a(1:2*n:2), n, MPI_DOUBLE_PRECISION, &
+      &                 partner, 0, comm, ierr )
+               else
+                  call mpi_send( a, 1, vtype, partner, 0, comm, ierr )
+               endif
+               call mpi_wait( req, MPI_STATUS_IGNORE, ierr )
+            enddo
+            t(meth) = (mpi_wtime() - t(meth)) / reps
+!           Every method sends the odd elements of the partner's a
+            do i=1, n
+               expected = partner * 1.0d6 + 2*i-1
+               if (rbuf(i) .ne. expected) then
+                  errs = errs + 1
+                  if (errs .le. 10) then
+                     print *, 'Method ', meth, ' count ', n, ' rbuf(', &
+      &                    i, ') = ', rbuf(i), ' expected ', expected
+                  endif
+               endif
+            enddo
+         enddo
+         call mpi_type_free( vtype, ierr )
+         call mpi_reduce( t, tmax, 3, MPI_DOUBLE_PRECISION, MPI_MAX, &
+      &        0, comm, ierr )
+         if (rank .eq. 0 .and. verbose) then
+            write(*,'(i8,3f14.2,2f10.2)') n, 1.0d6 * tmax(1), &
+      &           1.0d6 * tmax(2), 1.0d6 * tmax(3), tmax(2) / tmax(1), &
+      &           tmax(2) / tmax(3)
+         endif
+         n = n * 8
+      enddo
+      deallocate( a, b, rbuf )
+      end
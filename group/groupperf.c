@@ -0,0 +1,353 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Time and memory of the MPI_Group operations as the group grows.
+ * gtranksperf only checks MPI_Group_translate_ranks; here, for groups of
+ * the first n processes of MPI_COMM_WORLD (n = 1, 2, 4, ..., size), each
+ * of
+ *
+ *   incl, excl             - with a list of ranks
+ *   range_incl, range_excl - strided: one range with stride 2;
+ *                            random: one range for each rank in the list
+ *   union, intersection, difference
+ *                          - of the groups of two lists
+ *   compare                - of two groups from the same list (MPI_IDENT)
+ *                            and from the two lists
+ *   translate_ranks        - of all of the ranks of the first group to the
+ *                            group of the n processes
+ *
+ * is timed for two kinds of rank lists: strided (every second rank, and
+ * every third rank for the second list) and random (each rank with
+ * probability 1/2, as in comm/comm_group_rand.c).  The memory per group
+ * created is the growth of the resident set while -keep groups are held.
+ * The results of each operation are checked once.
+ *
+ * Group operations are local, so only process 0 is timed; the others
+ * wait in a barrier.  The size of a group is limited by the size of
+ * MPI_COMM_WORLD; run with many processes and check the growth column
+ * (the time relative to that for n = 1) to find operations whose cost is
+ * proportional to the size of the group rather than to the number of
+ * ranks passed.
+ *
+ * Options:
+ *   -reps <n>  repetitions of each timed operation (default 100)
+ *   -keep <n>  groups held for the memory measurement (default 256)
+ */
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitest.h"
+
+static int verbose = 0;
+
+typedef enum { OP_INCL, OP_EXCL, OP_RANGE_INCL, OP_RANGE_EXCL, OP_UNION,
+	       OP_INTERSECTION, OP_DIFFERENCE, OP_COMPARE_IDENT,
+	       OP_COMPARE_UNEQUAL, OP_TRANSLATE, NOP } op_t;
+static const char *opName[NOP] = { "incl", "excl", "range_incl",
+				   "range_excl", "union", "intersection",
+				   "difference", "compare(ident)",
+				   "compare(unequal)", "translate_ranks" };
+
+typedef enum { PAT_STRIDED, PAT_RANDOM, NPAT } pat_t;
+static const char *patName[NPAT] = { "strided", "random" };
+
+/* The group of n processes, the two rank lists and their groups */
+static MPI_Group base, g1, g2;
+static int n, k1, k2, *list1, *list2, *seq, *ranksout;
+static int nranges, (*ranges)[3];
+static pat_t pat;
+
+/* Make the two rank lists, and the ranges for the range operations */
+static void MakeLists( void )
+{
+    int i;
+
+    k1 = k2 = 0;
+    if (pat == PAT_STRIDED) {
+	for (i=0; i<n; i+=2) list1[k1++] = i;
+	for (i=0; i<n; i+=3) list2[k2++] = i;
+	nranges = 1;
+	ranges[0][0] = 0;
+	ranges[0][1] = n - 1;
+	ranges[0][2] = 2;
+    }
+    else {
+	/* Deterministic, so that the results can be compared between
+	   runs */
+	srand( n );
+	for (i=0; i<n; i++) {
+	    if (rand() % 2) list1[k1++] = i;
+	    if (rand() % 2) list2[k2++] = i;
+	}
+	/* A group may not be empty for the range routines */
+	if (k1 == 0) list1[k1++] = 0;
+	nranges = k1;
+	for (i=0; i<k1; i++) {
+	    ranges[i][0] = list1[i];
+	    ranges[i][1] = list1[i];
+	    ranges[i][2] = 1;
+	}
+    }
+}
+
+/* Run one operation; return a new group or MPI_GROUP_NULL */
+static MPI_Group RunOp( op_t op, int *result )
+{
+    MPI_Group g = MPI_GROUP_NULL;
+
+    switch (op) {
+    case OP_INCL:
+	MPI_Group_incl( base, k1, list1, &g );
+	break;
+    case OP_EXCL:
+	MPI_Group_excl( base, k1, list1, &g );
+	break;
+    case OP_RANGE_INCL:
+	MPI_Group_range_incl( base, nranges, ranges, &g );
+	break;
+    case OP_RANGE_EXCL:
+	MPI_Group_range_excl( base, nranges, ranges, &g );
+	break;
+    case OP_UNION:
+	MPI_Group_union( g1, g2, &g );
+	break;
+    case OP_INTERSECTION:
+	MPI_Group_intersection( g1, g2, &g );
+	break;
+    case OP_DIFFERENCE:
+	MPI_Group_difference( g1, g2, &g );
+	break;
+    case OP_COMPARE_IDENT:
+	MPI_Group_compare( g1, g1, result );
+	break;
+    case OP_COMPARE_UNEQUAL:
+	MPI_Group_compare( g1, g2, result );
+	break;
+    case OP_TRANSLATE:
+	MPI_Group_translate_ranks( g1, k1, seq, base, ranksout );
+	break;
+    default:
+	break;
+    }
+    return g;
+}
+
+/* Check the result of an operation; return the number of errors */
+static int CheckOp( op_t op )
+{
+    MPI_Group g, gcopy;
+    int       errs = 0, i, expected = 0, gsize, result = -1;
+    int       *in1, *in2;
+
+    in1 = (int *)calloc( n, sizeof(int) );
+    in2 = (int *)calloc( n, sizeof(int) );
+    if (!in1 || !in2) {
+	MTestError( "Unable to allocate rank flags" );
+    }
+    for (i=0; i<k1; i++) in1[list1[i]] = 1;
+    for (i=0; i<k2; i++) in2[list2[i]] = 1;
+    for (i=0; i<n; i++) {
+	switch (op) {
+	case OP_INCL:
+	case OP_RANGE_INCL:
+	    expected += in1[i];
+	    break;
+	case OP_EXCL:
+	case OP_RANGE_EXCL:
+	    expected += !in1[i];
+	    break;
+	case OP_UNION:
+	    expected += in1[i] || in2[i];
+	    break;
+	case OP_INTERSECTION:
+	    expected += in1[i] && in2[i];
+	    break;
+	case OP_DIFFERENCE:
+	    expected += in1[i] && !in2[i];
+	    break;
+	default:
+	    break;
+	}
+    }
+
+    g = RunOp( op, &result );
+    if (g != MPI_GROUP_NULL) {
+	MPI_Group_size( g, &gsize );
+	if (gsize != expected) {
+	    errs++;
+	    printf( "%s (%s, n=%d): size %d, expected %d\n", opName[op],
+		    patName[pat], n, gsize, expected );
+	}
+	if (g != MPI_GROUP_EMPTY) MPI_Group_free( &g );
+    }
+    else if (op == OP_COMPARE_IDENT) {
+	/* A group built separately from the same list is also the same */
+	MPI_Group_incl( base, k1, list1, &gcopy );
+	MPI_Group_compare( g1, gcopy, &result );
+	if (result != MPI_IDENT) {
+	    errs++;
+	    printf( "compare of identical groups (%s, n=%d) gave %d\n",
+		    patName[pat], n, result );
+	}
+	MPI_Group_free( &gcopy );
+    }
+    else if (op == OP_COMPARE_UNEQUAL) {
+	/* The lists are in increasing order, so the groups are the same
+	   if they have the same members */
+	expected = MPI_IDENT;
+	for (i=0; i<n; i++) {
+	    if (in1[i] != in2[i]) expected = MPI_UNEQUAL;
+	}
+	if (result != expected) {
+	    errs++;
+	    printf( "compare (%s, n=%d) gave %d, expected %d\n",
+		    patName[pat], n, result, expected );
+	}
+    }
+    else if (op == OP_TRANSLATE) {
+	for (i=0; i<k1; i++) {
+	    if (ranksout[i] != list1[i]) {
+		errs++;
+		if (errs < 10) {
+		    printf( "translate_ranks (%s, n=%d): rank %d -> %d, "
+			    "expected %d\n", patName[pat], n, i, ranksout[i],
+			    list1[i] );
+		}
+	    }
+	}
+    }
+    free( in1 );
+    free( in2 );
+    return errs;
+}
+
+/* Time per operation, and bytes per group created (-1 if none) */
+static void TimeOp( op_t op, int reps, int keep, MPI_Group *kept,
+		    double *usec, double *bytes )
+{
+    MPI_Group g;
+    double    t, r0;
+    int       i, result;
+
+    /* Warm up */
+    g = RunOp( op, &result );
+    if (g != MPI_GROUP_NULL && g != MPI_GROUP_EMPTY) MPI_Group_free( &g );
+
+    t = MPI_Wtime();
+    for (i=0; i<reps; i++) {
+	g = RunOp( op, &result );
+	if (g != MPI_GROUP_NULL && g != MPI_GROUP_EMPTY) MPI_Group_free( &g );
+    }
+    *usec = 1.e6 * (MPI_Wtime() - t) / reps;
+
+    *bytes = -1;
+    if (op >= OP_COMPARE_IDENT) return;
+    r0 = MTestResidentBytes();
+    for (i=0; i<keep; i++) {
+	kept[i] = RunOp( op, &result );
+    }
+    if (r0 >= 0) *bytes = (MTestResidentBytes() - r0) / keep;
+    for (i=0; i<keep; i++) {
+	if (kept[i] != MPI_GROUP_EMPTY) MPI_Group_free( &kept[i] );
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    int       errs = 0, rank, size, i, reps = 100, keep = 256, range[1][3];
+    op_t      op;
+    double    usec, bytes, first[NPAT][NOP];
+    MPI_Group gworld, *kept;
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-reps" ) == 0 && i+1 < argc) {
+	    reps = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-keep" ) == 0 && i+1 < argc) {
+	    keep = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    if (reps < 1) reps = 1;
+    if (keep < 1) keep = 1;
+
+    if (rank == 0) {
+	list1    = (int *)malloc( size * sizeof(int) );
+	list2    = (int *)malloc( size * sizeof(int) );
+	seq      = (int *)malloc( size * sizeof(int) );
+	ranksout = (int *)malloc( size * sizeof(int) );
+	ranges   = (int (*)[3])malloc( size * sizeof(*ranges) );
+	kept     = (MPI_Group *)malloc( keep * sizeof(MPI_Group) );
+	if (!list1 || !list2 || !seq || !ranksout || !ranges || !kept) {
+	    MTestError( "Unable to allocate rank lists" );
+	}
+	for (i=0; i<size; i++) seq[i] = i;
+	MPI_Comm_group( MPI_COMM_WORLD, &gworld );
+
+	if (verbose) {
+	    printf( "%-18s %-8s %8s %8s %12s %8s %12s\n", "operation",
+		    "ranks", "n", "list", "us/op", "growth", "bytes/group" );
+	}
+	for (pat = PAT_STRIDED; pat < NPAT; pat++) {
+	    n = 1;
+	    while (1) {
+		range[0][0] = 0;
+		range[0][1] = n - 1;
+		range[0][2] = 1;
+		MPI_Group_range_incl( gworld, 1, range, &base );
+		MakeLists();
+		MPI_Group_incl( base, k1, list1, &g1 );
+		MPI_Group_incl( base, k2, list2, &g2 );
+
+		for (op = OP_INCL; op < NOP; op++) {
+		    errs += CheckOp( op );
+		    TimeOp( op, reps, keep, kept, &usec, &bytes );
+		    if (n == 1) first[pat][op] = usec;
+		    if (verbose) {
+			printf( "%-18s %-8s %8d %8d %12.3f %8.2f", opName[op],
+				patName[pat], n, k1, usec,
+				(first[pat][op] > 0) ? usec / first[pat][op]
+				: 0.0 );
+			if (bytes >= 0) printf( " %12.0f\n", bytes );
+			else            printf( " %12s\n", "-" );
+			fflush( stdout );
+		    }
+		}
+
+		if (g1 != MPI_GROUP_EMPTY) MPI_Group_free( &g1 );
+		if (g2 != MPI_GROUP_EMPTY) MPI_Group_free( &g2 );
+		MPI_Group_free( &base );
+		if (n == size) break;
+		n = (2 * n < size) ? 2 * n : size;
+	    }
+	}
+
+	MPI_Group_free( &gworld );
+	free( list1 );
+	free( list2 );
+	free( seq );
+	free( ranksout );
+	free( ranges );
+	free( kept );
+    }
+    MPI_Barrier( MPI_COMM_WORLD );
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
@@ -25,6 +25,11 @@ int MTestReturnValue( int );
  * Utilities
  */
 void MTestSleep( int );
+void MTestSpin( double );
+void MTestSortDouble( int, double * );
+double MTestMedian( int, double * );
+int MTestGetClockOffset( MPI_Comm, int, double *, double * );
+double MTestResidentBytes( void );
 
 /*
  * This structure contains the information used to test datatypes
@@ -48,6 +53,7 @@ typedef struct _MTestDatatype {
     int *displs, basesize;
     /* displacements are in multiples of base type; basesize is the
        size of that type*/
+    struct _MTestTypeNode *node;  /* layout of a generated type */
     void *(*InitBuf)( struct _MTestDatatype * );
     void *(*FreeBuf)( struct _MTestDatatype * );
     int   (*CheckBuf)( struct _MTestDatatype * );
@@ -59,6 +65,7 @@ void MTestResetDatatypes( void );
 void MTestFreeDatatype( MTestDatatype * );
 const char *MTestGetDatatypeName( MTestDatatype * );
 int MTestGetDatatypeIndex( void );
+void MTestSetGenDatatypes( int, int, int, int );
 
 int MTestGetIntracomm( MPI_Comm *, int );
 int MTestGetIntracommGeneral( MPI_Comm *, int, int );
@@ -100,4 +107,20 @@ void MTestFreeWin( MPI_Win * );
     ((MTEST_MPI_VERSION == (major_) && MTEST_MPI_SUBVERSION >= (minor_)) ||   \
     (MTEST_MPI_VERSION > (major_)))
 
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+/*
+ * MPI_T performance variable sessions and control variables
+ */
+typedef struct _MTestPvarSet MTestPvarSet;
+int MTestPvarSessionCreate( MPI_Comm, MTestPvarSet ** );
+int MTestPvarStartSample( MTestPvarSet * );
+int MTestPvarEndSample( MTestPvarSet * );
+int MTestPvarGetNum( MTestPvarSet * );
+int MTestPvarGetDelta( MTestPvarSet *, const char *, double * );
+void MTestPvarPrintDeltas( MTestPvarSet *, int );
+void MTestPvarSessionFree( MTestPvarSet ** );
+int MTestCvarWrite( const char *, const char * );
+int MTestCvarRead( const char *, char *, int );
+#endif
+
 #endif
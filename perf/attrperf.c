@@ -0,0 +1,309 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Cost of attribute caching on a communicator as the number of keyvals
+ * with attributes on it grows (1, 2, 4, ..., -maxkeys).  The tests in attr
+ * check the semantics; libraries that cache their state in attributes and
+ * look it up on every call also need MPI_Comm_get_attr to be fast when
+ * many other libraries have done the same.  For each number of attributes
+ * the following are timed (in microseconds, the maximum over processes):
+ *
+ *   set       - MPI_Comm_set_attr of a keyval without a value
+ *   get       - MPI_Comm_get_attr of a random keyval with a value
+ *   absent    - MPI_Comm_get_attr of a keyval without a value
+ *   replace   - MPI_Comm_set_attr of a keyval with a value (which calls
+ *               the delete callback for the old value)
+ *   dup       - MPI_Comm_dup, which calls the copy callback of every
+ *               attribute, and the extra time per attribute over a dup
+ *               without attributes
+ *   free      - MPI_Comm_free of the dup, which calls the delete callback
+ *               of every attribute, and the time per attribute
+ *   delete    - MPI_Comm_delete_attr
+ *
+ * Finally -maxkeys attributes are put on MPI_COMM_SELF, whose delete
+ * callbacks MPI_Finalize calls first (see attrend.c); the time from the
+ * call of MPI_Finalize to the last callback is printed after MPI_Finalize
+ * returns.  The values returned and the number of callbacks are checked.
+ *
+ * Options:
+ *   -maxkeys <n>  largest number of attributes (default 1024)
+ *   -reps <n>     repetitions of get, absent and replace (default 10000)
+ *   -dupreps <n>  repetitions of dup and free (default 10)
+ */
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitest.h"
+
+static int verbose = 0;
+
+static int copyCalls = 0, deleteCalls = 0;
+static int selfCalls = 0, selfErrors = 0;
+static double selfLast = 0;
+
+static int CopyFn( MPI_Comm oldcomm, int keyval, void *extra_state,
+		   void *attribute_val_in, void *attribute_val_out, int *flag )
+{
+    copyCalls++;
+    *(void **)attribute_val_out = attribute_val_in;
+    *flag = 1;
+    return MPI_SUCCESS;
+}
+
+static int DeleteFn( MPI_Comm comm, int keyval, void *attribute_val,
+		     void *extra_state )
+{
+    deleteCalls++;
+    return MPI_SUCCESS;
+}
+
+/* Delete callback for the attributes on MPI_COMM_SELF, called from
+   MPI_Finalize */
+static int DeleteSelfFn( MPI_Comm comm, int keyval, void *attribute_val,
+			 void *extra_state )
+{
+    int flag;
+
+    selfCalls++;
+    MPI_Finalized( &flag );
+    if (flag) selfErrors++;
+    selfLast = MPI_Wtime();
+    return MPI_SUCCESS;
+}
+
+int main( int argc, char *argv[] )
+{
+    int      errs = 0, rank, i, j, r, flag, nkeys, maxkeys = 1024;
+    int      reps = 10000, dupreps = 10, *keyvals, *order, absentKey;
+    int      calls;
+    void     *val;
+    MPI_Comm comm, dup;
+    double   t, tdup0, tfree0, times[9], maxtimes[9], tfinal;
+    unsigned int seed = 1;
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-maxkeys" ) == 0 && i+1 < argc) {
+	    maxkeys = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-reps" ) == 0 && i+1 < argc) {
+	    reps = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-dupreps" ) == 0 && i+1 < argc) {
+	    dupreps = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    if (maxkeys < 1) maxkeys = 1;
+    if (reps < 1) reps = 1;
+    if (dupreps < 1) dupreps = 1;
+
+    keyvals = (int *)malloc( maxkeys * sizeof(int) );
+    order   = (int *)malloc( reps * sizeof(int) );
+    if (!keyvals || !order) {
+	MTestError( "Unable to allocate keyvals" );
+    }
+    MPI_Comm_dup( MPI_COMM_WORLD, &comm );
+    MPI_Comm_create_keyval( CopyFn, DeleteFn, &absentKey, 0 );
+
+    /* The time of a dup and free without attributes */
+    tdup0 = tfree0 = 0;
+    for (r=0; r<dupreps; r++) {
+	MPI_Barrier( comm );
+	t = MPI_Wtime();
+	MPI_Comm_dup( comm, &dup );
+	tdup0 += MPI_Wtime() - t;
+	MPI_Barrier( comm );
+	t = MPI_Wtime();
+	MPI_Comm_free( &dup );
+	tfree0 += MPI_Wtime() - t;
+    }
+    tdup0  /= dupreps;
+    tfree0 /= dupreps;
+
+    if (rank == 0 && verbose) {
+	printf( "Times in us (max over processes)\n" );
+	printf( "%7s %8s %8s %8s %8s %10s %8s %10s %8s %8s\n", "attrs",
+		"set", "get", "absent", "replace", "dup", "/attr", "free",
+		"/attr", "delete" );
+    }
+
+    for (nkeys = 1; ; nkeys = (2 * nkeys < maxkeys) ? 2 * nkeys : maxkeys) {
+	for (i=0; i<nkeys; i++) {
+	    MPI_Comm_create_keyval( CopyFn, DeleteFn, &keyvals[i], 0 );
+	}
+	/* Random keyvals to look up, the same on every process */
+	for (r=0; r<reps; r++) {
+	    seed = seed * 1103515245 + 12345;
+	    order[r] = (seed >> 8) % nkeys;
+	}
+
+	/* Set */
+	t = MPI_Wtime();
+	for (i=0; i<nkeys; i++) {
+	    MPI_Comm_set_attr( comm, keyvals[i], (void *)(MPI_Aint)(i + 1) );
+	}
+	times[0] = (MPI_Wtime() - t) / nkeys;
+
+	/* Get, in random order */
+	t = MPI_Wtime();
+	for (r=0; r<reps; r++) {
+	    MPI_Comm_get_attr( comm, keyvals[order[r]], &val, &flag );
+	}
+	times[1] = (MPI_Wtime() - t) / reps;
+	for (r=0; r<reps; r++) {
+	    MPI_Comm_get_attr( comm, keyvals[order[r]], &val, &flag );
+	    if (!flag || (MPI_Aint)val != order[r] + 1) {
+		errs++;
+		if (errs < 10) {
+		    printf( "Attribute %d of %d: flag %d, value %ld\n",
+			    order[r], nkeys, flag, (long)(MPI_Aint)val );
+		}
+		break;
+	    }
+	}
+
+	/* Get of a keyval without a value */
+	t = MPI_Wtime();
+	for (r=0; r<reps; r++) {
+	    MPI_Comm_get_attr( comm, absentKey, &val, &flag );
+	}
+	times[2] = (MPI_Wtime() - t) / reps;
+	if (flag) {
+	    errs++;
+	    printf( "Found an attribute that was not set\n" );
+	}
+
+	/* Replace */
+	calls = deleteCalls;
+	t = MPI_Wtime();
+	for (r=0; r<reps; r++) {
+	    j = order[r];
+	    MPI_Comm_set_attr( comm, keyvals[j], (void *)(MPI_Aint)(j + 1) );
+	}
+	times[3] = (MPI_Wtime() - t) / reps;
+	if (deleteCalls - calls != reps) {
+	    errs++;
+	    printf( "Replacing %d attributes called delete %d times\n",
+		    reps, deleteCalls - calls );
+	}
+
+	/* Dup, copying every attribute, and free */
+	times[4] = times[5] = 0;
+	for (r=0; r<dupreps; r++) {
+	    calls = copyCalls;
+	    MPI_Barrier( comm );
+	    t = MPI_Wtime();
+	    MPI_Comm_dup( comm, &dup );
+	    times[4] += MPI_Wtime() - t;
+	    if (copyCalls - calls != nkeys) {
+		errs++;
+		printf( "Dup with %d attributes called copy %d times\n",
+			nkeys, copyCalls - calls );
+	    }
+	    if (r == 0) {
+		MPI_Comm_get_attr( dup, keyvals[nkeys-1], &val, &flag );
+		if (!flag || (MPI_Aint)val != nkeys) {
+		    errs++;
+		    printf( "Attribute was not copied by dup\n" );
+		}
+	    }
+	    calls = deleteCalls;
+	    MPI_Barrier( comm );
+	    t = MPI_Wtime();
+	    MPI_Comm_free( &dup );
+	    times[5] += MPI_Wtime() - t;
+	    if (deleteCalls - calls != nkeys) {
+		errs++;
+		printf( "Free with %d attributes called delete %d times\n",
+			nkeys, deleteCalls - calls );
+	    }
+	}
+	times[4] /= dupreps;
+	times[5] /= dupreps;
+
+	/* Delete */
+	t = MPI_Wtime();
+	for (i=0; i<nkeys; i++) {
+	    MPI_Comm_delete_attr( comm, keyvals[i] );
+	}
+	times[6] = (MPI_Wtime() - t) / nkeys;
+
+	for (i=0; i<nkeys; i++) {
+	    MPI_Comm_free_keyval( &keyvals[i] );
+	}
+
+	times[7] = tdup0;
+	times[8] = tfree0;
+	MPI_Reduce( times, maxtimes, 9, MPI_DOUBLE, MPI_MAX, 0, comm );
+	if (rank == 0 && verbose) {
+	    printf( "%7d %8.3f %8.3f %8.3f %8.3f %10.1f %8.3f %10.1f %8.3f "
+		    "%8.3f\n", nkeys, 1.e6 * maxtimes[0], 1.e6 * maxtimes[1],
+		    1.e6 * maxtimes[2], 1.e6 * maxtimes[3], 1.e6 * maxtimes[4],
+		    1.e6 * (maxtimes[4] - maxtimes[7]) / nkeys,
+		    1.e6 * maxtimes[5],
+		    1.e6 * (maxtimes[5] - maxtimes[8]) / nkeys,
+		    1.e6 * maxtimes[6] );
+	    fflush( stdout );
+	}
+	if (nkeys == maxkeys) break;
+    }
+
+    MPI_Comm_free_keyval( &absentKey );
+    MPI_Comm_free( &comm );
+
+    /* Attributes on MPI_COMM_SELF, deleted by MPI_Finalize */
+    for (i=0; i<maxkeys; i++) {
+	MPI_Comm_create_keyval( MPI_COMM_NULL_COPY_FN, DeleteSelfFn,
+				&keyvals[i], 0 );
+	MPI_Comm_set_attr( MPI_COMM_SELF, keyvals[i], (void *)0 );
+	MPI_Comm_free_keyval( &keyvals[i] );
+    }
+    free( keyvals );
+    free( order );
+
+    /* The errors are printed after MPI_Finalize, as in attrend.c */
+    MPI_Allreduce( MPI_IN_PLACE, &errs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD );
+    t = MPI_Wtime();
+    MPI_Finalize();
+    tfinal = selfLast - t;
+
+    if (rank == 0) {
+	if (selfCalls != maxkeys) {
+	    errs++;
+	    printf( "MPI_Finalize called %d of %d delete callbacks on "
+		    "MPI_COMM_SELF\n", selfCalls, maxkeys );
+	}
+	if (selfErrors) {
+	    errs++;
+	    printf( "Found %d delete callbacks after MPI_Finalized\n",
+		    selfErrors );
+	}
+	if (verbose) {
+	    printf( "Deleting %d attributes on MPI_COMM_SELF in MPI_Finalize: "
+		    "%.1f us (%.3f us per attribute)\n", maxkeys, 1.e6 * tfinal,
+		    1.e6 * tfinal / maxkeys );
+	}
+	if (errs == 0) {
+	    printf( " No Errors\n" );
+	}
+	else {
+	    printf( " Found %d errors\n", errs );
+	}
+	fflush( stdout );
+    }
+    return 0;
+}
@@ -0,0 +1,287 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Time MPI_Cancel on large batches of outstanding receives and sends while
+ * real messages are in flight, and check that no message is lost or
+ * delivered twice.  Processes are paired (rank ^ 1); in each pair the even
+ * rank receives and the odd rank sends.
+ *
+ * For the receive side, the receiver posts nbatch receives with the same
+ * tag that the sender uses for nbatch/2 real messages, then cancels all of
+ * them while those messages arrive.  Every receive is either cancelled or
+ * matched; the messages that did not match are then received with blocking
+ * receives, and the payloads (sequence numbers) must cover 0..nbatch/2-1
+ * exactly once.
+ *
+ * For the send side, the sender starts nbatch sends and cancels them.  The
+ * receiver is told how many were not cancelled, receives exactly that many,
+ * and checks the sum of the sequence numbers and that no extra message
+ * arrives before an end marker.
+ *
+ * When MPITEST_VERBOSE is set, the time per MPI_Cancel call, the time to
+ * complete the cancelled requests, and the resulting cancels per second
+ * are printed for each batch size.
+ */
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitest.h"
+
+#define MAX_BATCH  4096
+#define DATA_TAG   10
+#define CTRL_TAG   11
+
+static int verbose = 0;
+
+static int RecvCancelBatch( int nbatch, int partner, int isRecv,
+			    double *tcancel, double *twait );
+static int SendCancelBatch( int nbatch, int partner, int isRecv,
+			    double *tcancel, double *twait );
+static void PrintTimes( const char *, int, int, double, double );
+
+int main( int argc, char *argv[] )
+{
+    int    errs = 0, rank, size, partner, isRecv, nbatch, maxbatch = 1024;
+    int    i, reps = 10, k;
+    double tc, tw, tcsum, twsum;
+    MPI_Comm comm = MPI_COMM_WORLD;
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-maxbatch" ) == 0 && i+1 < argc) {
+	    maxbatch = atoi( argv[++i] );
+	    if (maxbatch > MAX_BATCH) maxbatch = MAX_BATCH;
+	}
+	else if (strcmp( argv[i], "-reps" ) == 0 && i+1 < argc) {
+	    reps = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    if (reps < 1) reps = 1;
+
+    MPI_Comm_rank( comm, &rank );
+    MPI_Comm_size( comm, &size );
+    if (size < 2) {
+	fprintf( stderr, "This program requires at least 2 processes\n" );
+	MPI_Abort( MPI_COMM_WORLD, 1 );
+    }
+    partner = rank ^ 1;
+    if (partner >= size) partner = MPI_PROC_NULL;
+    isRecv = !(rank & 0x1);
+
+    if (rank == 0 && verbose) {
+	printf( "kind\tbatch\tcancel(usec)\tcomplete(usec)\tcancels/sec\n" );
+    }
+
+    for (nbatch = 2; nbatch <= maxbatch; nbatch *= 4) {
+	/* Cancel of receives that race with matching sends */
+	tcsum = twsum = 0;
+	for (k=0; k<reps; k++) {
+	    MPI_Barrier( comm );
+	    errs += RecvCancelBatch( nbatch, partner, isRecv, &tc, &tw );
+	    tcsum += tc;
+	    twsum += tw;
+	}
+	PrintTimes( "recv", nbatch, reps, tcsum, twsum );
+
+	/* Cancel of sends */
+	tcsum = twsum = 0;
+	for (k=0; k<reps; k++) {
+	    MPI_Barrier( comm );
+	    errs += SendCancelBatch( nbatch, partner, isRecv, &tc, &tw );
+	    tcsum += tc;
+	    twsum += tw;
+	}
+	PrintTimes( "send", nbatch, reps, tcsum, twsum );
+    }
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
+
+/*
+ * The receiver posts nbatch receives and cancels them all while the sender
+ * sends nbatch/2 messages that can match them.
+ */
+static int RecvCancelBatch( int nbatch, int partner, int isRecv,
+			    double *tcancel, double *twait )
+{
+    static MPI_Request req[MAX_BATCH];
+    static MPI_Status  status[MAX_BATCH];
+    static int         buf[MAX_BATCH], seen[MAX_BATCH];
+    int    errs = 0, i, nreal = nbatch / 2, nmatched = 0, flag, v;
+    double t;
+    MPI_Comm comm = MPI_COMM_WORLD;
+
+    *tcancel = *twait = 0;
+    if (partner == MPI_PROC_NULL) return 0;
+
+    if (isRecv) {
+	for (i=0; i<nbatch; i++) {
+	    buf[i] = -1;
+	    MPI_Irecv( &buf[i], 1, MPI_INT, partner, DATA_TAG, comm, &req[i] );
+	}
+	/* Tell the sender to start, then cancel while messages arrive */
+	MPI_Send( MPI_BOTTOM, 0, MPI_INT, partner, CTRL_TAG, comm );
+	t = MPI_Wtime();
+	for (i=0; i<nbatch; i++) {
+	    MPI_Cancel( &req[i] );
+	}
+	*tcancel = MPI_Wtime() - t;
+	t = MPI_Wtime();
+	MPI_Waitall( nbatch, req, status );
+	*twait = MPI_Wtime() - t;
+
+	for (i=0; i<nreal; i++) seen[i] = 0;
+	for (i=0; i<nbatch; i++) {
+	    MPI_Test_cancelled( &status[i], &flag );
+	    if (flag) continue;
+	    nmatched++;
+	    v = buf[i];
+	    if (v < 0 || v >= nreal) {
+		errs++;
+		printf( "Received invalid value %d in batch of %d\n",
+			v, nbatch );
+	    }
+	    else seen[v]++;
+	}
+	if (nmatched > nreal) {
+	    errs++;
+	    printf( "%d receives matched but only %d messages were sent\n",
+		    nmatched, nreal );
+	}
+	/* Drain the messages that were not matched by a cancelled receive */
+	for (i=nmatched; i<nreal; i++) {
+	    MPI_Recv( &v, 1, MPI_INT, partner, DATA_TAG, comm,
+		      MPI_STATUS_IGNORE );
+	    if (v < 0 || v >= nreal) {
+		errs++;
+		printf( "Received invalid value %d in batch of %d\n",
+			v, nbatch );
+	    }
+	    else seen[v]++;
+	}
+	for (i=0; i<nreal; i++) {
+	    if (seen[i] != 1) {
+		errs++;
+		printf( "Message %d of %d received %d times\n",
+			i, nreal, seen[i] );
+	    }
+	}
+    }
+    else {
+	MPI_Recv( MPI_BOTTOM, 0, MPI_INT, partner, CTRL_TAG, comm,
+		  MPI_STATUS_IGNORE );
+	for (i=0; i<nreal; i++) {
+	    buf[i] = i;
+	    MPI_Isend( &buf[i], 1, MPI_INT, partner, DATA_TAG, comm, &req[i] );
+	}
+	MPI_Waitall( nreal, req, MPI_STATUSES_IGNORE );
+    }
+    return errs;
+}
+
+/*
+ * The sender starts nbatch sends and cancels them; the receiver receives
+ * only those that could not be cancelled.
+ */
+static int SendCancelBatch( int nbatch, int partner, int isRecv,
+			    double *tcancel, double *twait )
+{
+    static MPI_Request req[MAX_BATCH];
+    static MPI_Status  status[MAX_BATCH];
+    static int         buf[MAX_BATCH];
+    int    errs = 0, i, flag, v, info[2];
+    double t;
+    MPI_Comm comm = MPI_COMM_WORLD;
+
+    *tcancel = *twait = 0;
+    if (partner == MPI_PROC_NULL) return 0;
+
+    if (!isRecv) {
+	for (i=0; i<nbatch; i++) {
+	    buf[i] = i;
+	    MPI_Isend( &buf[i], 1, MPI_INT, partner, DATA_TAG, comm, &req[i] );
+	}
+	t = MPI_Wtime();
+	for (i=0; i<nbatch; i++) {
+	    MPI_Cancel( &req[i] );
+	}
+	*tcancel = MPI_Wtime() - t;
+	t = MPI_Wtime();
+	MPI_Waitall( nbatch, req, status );
+	*twait = MPI_Wtime() - t;
+
+	/* Number and checksum of the messages that were delivered */
+	info[0] = info[1] = 0;
+	for (i=0; i<nbatch; i++) {
+	    MPI_Test_cancelled( &status[i], &flag );
+	    if (!flag) {
+		info[0]++;
+		info[1] += i;
+	    }
+	}
+	MPI_Send( info, 2, MPI_INT, partner, CTRL_TAG, comm );
+	v = -1;
+	MPI_Send( &v, 1, MPI_INT, partner, DATA_TAG, comm );
+    }
+    else {
+	int sum = 0;
+	MPI_Recv( info, 2, MPI_INT, partner, CTRL_TAG, comm,
+		  MPI_STATUS_IGNORE );
+	for (i=0; i<info[0]; i++) {
+	    MPI_Recv( &v, 1, MPI_INT, partner, DATA_TAG, comm,
+		      MPI_STATUS_IGNORE );
+	    sum += v;
+	}
+	if (sum != info[1]) {
+	    errs++;
+	    printf( "Checksum of delivered sends is %d, expected %d\n",
+		    sum, info[1] );
+	}
+	/* The sender ends with a marker on the same tag; since messages
+	   do not overtake, anything before it is a duplicate or a
+	   message whose cancel was reported as successful */
+	MPI_Recv( &v, 1, MPI_INT, partner, DATA_TAG, comm,
+		  MPI_STATUS_IGNORE );
+	while (v != -1) {
+	    errs++;
+	    printf( "Unexpected extra message %d after send cancel batch\n",
+		    v );
+	    MPI_Recv( &v, 1, MPI_INT, partner, DATA_TAG, comm,
+		      MPI_STATUS_IGNORE );
+	}
+    }
+    return errs;
+}
+
+/* Report the slowest process for one kind of cancel and batch size */
+static void PrintTimes( const char *kind, int nbatch, int reps,
+			double tcsum, double twsum )
+{
+    double t[2], tmax[2];
+    int    rank;
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    t[0] = tcsum;
+    t[1] = twsum;
+    MPI_Reduce( t, tmax, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD );
+    if (rank == 0 && verbose) {
+	printf( "%s\t%d\t%12.3f\t%12.3f\t%e\n", kind, nbatch,
+		1.e6 * tmax[0] / (reps * nbatch), 1.e6 * tmax[1] / reps,
+		(tmax[0] + tmax[1]) > 0 ?
+		(reps * nbatch) / (tmax[0] + tmax[1]) : 0.0 );
+	fflush( stdout );
+    }
+}
@@ -0,0 +1,445 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Performance of distributed data structures built on dynamic windows.
+ * This extends the shared linked list of rma/linked_list.c and
+ * rma/linked_list_fop.c into a benchmark with three parts:
+ *
+ *   attach   - cost of MPI_Win_attach and MPI_Win_detach, and of a
+ *              one-element MPI_Get from a neighbor, as the number of
+ *              regions attached to a dynamic window grows.  Implementations
+ *              may limit the number of regions; the doubling stops at the
+ *              first MPI_Win_attach that fails and the limit is reported
+ *   append   - all processes concurrently append elements to one list,
+ *              using either exclusive locks with compare-and-swap and put
+ *              (linked_list.c) or shared locks with compare-and-swap and
+ *              fetch-and-op (linked_list_fop.c).  Reports appends per
+ *              second and how often a stale tail pointer had to be chased
+ *   traverse - pointer-chasing latency per hop when one process walks the
+ *              list, and the aggregate hop rate when all processes walk
+ *              it at the same time
+ *
+ * Each list element is allocated and attached separately, so the append
+ * and traverse phases also run with many attached regions.  The traversal
+ * checks that every process inserted exactly nelems elements.  Timings are
+ * printed when MPITEST_VERBOSE is set.
+ *
+ * Options:
+ *   -nelems <n>      elements appended per process (default 64)
+ *   -maxregions <n>  largest number of attached regions (default 4096)
+ */
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "mpitest.h"
+
+/* The MPI-3 routines are available either from an MPI-3 library or, in
+   MPICH2 before MPI-3 was final, under the MPIX_ prefix */
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+#  define TEST_MPI3_ROUTINES 1
+#elif !defined(USE_STRICT_MPI) && defined(MPICH2)
+#  define TEST_MPI3_ROUTINES 1
+#  define MPI_Win_create_dynamic MPIX_Win_create_dynamic
+#  define MPI_Win_attach         MPIX_Win_attach
+#  define MPI_Win_detach         MPIX_Win_detach
+#  define MPI_Fetch_and_op       MPIX_Fetch_and_op
+#  define MPI_Compare_and_swap   MPIX_Compare_and_swap
+#  define MPI_NO_OP              MPIX_NO_OP
+#endif
+
+#define NPROBE 100
+
+static int verbose = 0;
+
+#ifdef TEST_MPI3_ROUTINES
+/* Linked list pointer */
+typedef struct {
+    int      rank;
+    MPI_Aint disp;
+} llist_ptr_t;
+
+/* Linked list element */
+typedef struct {
+    int value;
+    llist_ptr_t next;
+} llist_elem_t;
+
+static const llist_ptr_t nil = { -1, (MPI_Aint) MPI_BOTTOM };
+
+#define NEXT_RANK(p) ((p).disp + offsetof(llist_elem_t, next.rank))
+#define NEXT_DISP(p) ((p).disp + offsetof(llist_elem_t, next.disp))
+
+/* List of locally allocated list elements */
+static llist_elem_t **my_elems = NULL;
+static int my_elems_size  = 0;
+static int my_elems_count = 0;
+
+typedef enum { APPEND_LOCK = 0, APPEND_FOP = 1 } append_t;
+static const char *appendName[2] = { "lock", "fop" };
+
+static void AttachTest( int maxregions );
+static int  ListTest( append_t kind, int nelems );
+#endif
+
+int main( int argc, char *argv[] )
+{
+    int errs = 0, i, nelems = 64, maxregions = 4096;
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-nelems" ) == 0 && i+1 < argc) {
+	    nelems = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-maxregions" ) == 0 && i+1 < argc) {
+	    maxregions = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+
+#ifdef TEST_MPI3_ROUTINES
+    AttachTest( maxregions );
+    errs += ListTest( APPEND_LOCK, nelems );
+    errs += ListTest( APPEND_FOP, nelems );
+#endif
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
+
+#ifdef TEST_MPI3_ROUTINES
+/* Allocate a new shared linked list element and attach it to the window */
+static MPI_Aint AllocElem( int value, MPI_Win win )
+{
+    MPI_Aint disp;
+    llist_elem_t *elem_ptr;
+
+    MPI_Alloc_mem( sizeof(llist_elem_t), MPI_INFO_NULL, &elem_ptr );
+    elem_ptr->value = value;
+    elem_ptr->next  = nil;
+    MPI_Win_attach( win, elem_ptr, sizeof(llist_elem_t) );
+
+    if (my_elems_size == my_elems_count) {
+	my_elems_size += 100;
+	my_elems = (llist_elem_t **)realloc( my_elems,
+					     my_elems_size * sizeof(void*) );
+    }
+    my_elems[my_elems_count++] = elem_ptr;
+
+    MPI_Get_address( elem_ptr, &disp );
+    return disp;
+}
+
+static void FreeElems( MPI_Win win )
+{
+    for ( ; my_elems_count > 0; my_elems_count--) {
+	MPI_Win_detach( win, my_elems[my_elems_count-1] );
+	MPI_Free_mem( my_elems[my_elems_count-1] );
+    }
+}
+
+/*
+ * Attach regions in growing batches; after each batch time a get of the
+ * most recently attached region on the next process, which forces the
+ * target to look up the region among all that are attached.
+ */
+static void AttachTest( int maxregions )
+{
+    MPI_Win  win;
+    int      rank, size, target, nregions = 0, nnew, i, val;
+    int      **regions;
+    MPI_Aint *disps, tdisp;
+    double   t, tattach, tget, tdetach, tmax[3];
+    int      nok, nmine, limit = 0;
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+    target = (rank + 1) % size;
+
+    regions = (int **)malloc( maxregions * sizeof(int *) );
+    disps   = (MPI_Aint *)malloc( maxregions * sizeof(MPI_Aint) );
+    if (!regions || !disps) {
+	MTestError( "Unable to allocate region arrays" );
+    }
+
+    MPI_Win_create_dynamic( MPI_INFO_NULL, MPI_COMM_WORLD, &win );
+    MPI_Win_set_errhandler( win, MPI_ERRORS_RETURN );
+    if (rank == 0 && verbose) {
+	printf( "regions\tattach(usec)\tget(usec)\tdetach(usec)\n" );
+    }
+
+    for (nnew = 1; nregions + nnew <= maxregions; nnew = nregions) {
+	/* Attach nnew more regions (doubling the total) */
+	t = MPI_Wtime();
+	for (i=nregions; i<nregions+nnew; i++) {
+	    MPI_Alloc_mem( sizeof(int), MPI_INFO_NULL, &regions[i] );
+	    *regions[i] = rank * maxregions + i;
+	    if (MPI_Win_attach( win, regions[i], sizeof(int) ) != MPI_SUCCESS) {
+		MPI_Free_mem( regions[i] );
+		break;
+	    }
+	}
+	tattach = (MPI_Wtime() - t) / nnew;
+
+	/* Stop at the first failed attach on any process.  Some
+	   implementations hang in MPI_Win_detach after a failed attach, so
+	   after a failure the regions are left attached until the window is
+	   freed */
+	nmine = i;
+	nok   = i - nregions;
+	MPI_Allreduce( MPI_IN_PLACE, &nok, 1, MPI_INT, MPI_MIN,
+		       MPI_COMM_WORLD );
+	if (nok < nnew) {
+	    limit = nregions + nok;
+	    break;
+	}
+	nregions += nnew;
+	for (i=nregions-nnew; i<nregions; i++) {
+	    MPI_Get_address( regions[i], &disps[i] );
+	}
+
+	/* Get the neighbor's newest region (looked up among all of them) */
+	MPI_Sendrecv( &disps[nregions-1], 1, MPI_AINT, (rank+size-1) % size, 0,
+		      &tdisp, 1, MPI_AINT, target, 0, MPI_COMM_WORLD,
+		      MPI_STATUS_IGNORE );
+	MPI_Barrier( MPI_COMM_WORLD );
+	t = MPI_Wtime();
+	for (i=0; i<100; i++) {
+	    MPI_Win_lock( MPI_LOCK_SHARED, target, 0, win );
+	    MPI_Get( &val, 1, MPI_INT, target, tdisp, 1, MPI_INT, win );
+	    MPI_Win_unlock( target, win );
+	}
+	tget = (MPI_Wtime() - t) / 100;
+	MPI_Barrier( MPI_COMM_WORLD );
+
+	/* Detach and re-attach the newest region to time detach with this
+	   many regions present */
+	t = MPI_Wtime();
+	MPI_Win_detach( win, regions[nregions-1] );
+	tdetach = MPI_Wtime() - t;
+	MPI_Win_attach( win, regions[nregions-1], sizeof(int) );
+
+	tmax[0] = tattach;
+	tmax[1] = tget;
+	tmax[2] = tdetach;
+	MPI_Allreduce( MPI_IN_PLACE, tmax, 3, MPI_DOUBLE, MPI_MAX,
+		       MPI_COMM_WORLD );
+	if (rank == 0 && verbose) {
+	    printf( "%d\t%12.3f\t%12.3f\t%12.3f\n", nregions,
+		    1.e6 * tmax[0], 1.e6 * tmax[1], 1.e6 * tmax[2] );
+	    fflush( stdout );
+	}
+    }
+
+    if (limit) {
+	if (rank == 0 && verbose) {
+	    printf( "MPI_Win_attach failed after %d regions\n", limit );
+	}
+	MPI_Win_free( &win );
+	for (i=0; i<nmine; i++) MPI_Free_mem( regions[i] );
+    }
+    else {
+	MPI_Barrier( MPI_COMM_WORLD );
+	t = MPI_Wtime();
+	for (i=nregions-1; i>=0; i--) {
+	    MPI_Win_detach( win, regions[i] );
+	}
+	t = nregions ? (MPI_Wtime() - t) / nregions : 0;
+	for (i=0; i<nregions; i++) MPI_Free_mem( regions[i] );
+	MPI_Reduce( rank == 0 ? MPI_IN_PLACE : &t, &t, 1, MPI_DOUBLE,
+		    MPI_MAX, 0, MPI_COMM_WORLD );
+	if (rank == 0 && verbose) {
+	    printf( "Detach all %d regions: %.3f usec each\n", nregions,
+		    1.e6 * t );
+	}
+	MPI_Win_free( &win );
+    }
+    free( regions );
+    free( disps );
+}
+
+/* Append an element, returning the number of stale tail pointers chased */
+static int Append( append_t kind, llist_ptr_t *tail_ptr,
+		   llist_ptr_t new_elem_ptr, MPI_Win win )
+{
+    int success, chased = 0, lock_type, assert_flag;
+
+    if (kind == APPEND_LOCK) {
+	lock_type   = MPI_LOCK_EXCLUSIVE;
+	assert_flag = 0;
+    }
+    else {
+	lock_type   = MPI_LOCK_SHARED;
+	assert_flag = MPI_MODE_NOCHECK;
+    }
+
+    do {
+	llist_ptr_t next_tail_ptr = nil;
+
+	MPI_Win_lock( lock_type, tail_ptr->rank, assert_flag, win );
+	MPI_Compare_and_swap( (void *)&new_elem_ptr.rank, (void *)&nil.rank,
+			      (void *)&next_tail_ptr.rank, MPI_INT,
+			      tail_ptr->rank, NEXT_RANK(*tail_ptr), win );
+	MPI_Win_unlock( tail_ptr->rank, win );
+	success = (next_tail_ptr.rank == nil.rank);
+
+	if (success) {
+	    int i, flag;
+	    MPI_Aint result;
+
+	    MPI_Win_lock( lock_type, tail_ptr->rank, assert_flag, win );
+	    if (kind == APPEND_LOCK) {
+		MPI_Put( &new_elem_ptr.disp, 1, MPI_AINT, tail_ptr->rank,
+			 NEXT_DISP(*tail_ptr), 1, MPI_AINT, win );
+	    }
+	    else {
+		MPI_Fetch_and_op( &new_elem_ptr.disp, &result, MPI_AINT,
+				  tail_ptr->rank, NEXT_DISP(*tail_ptr),
+				  MPI_REPLACE, win );
+	    }
+	    MPI_Win_unlock( tail_ptr->rank, win );
+	    *tail_ptr = new_elem_ptr;
+
+	    /* For implementations that use pt-to-pt messaging, force
+	       progress for other processes' RMA operations. */
+	    for (i = 0; i < NPROBE; i++)
+		MPI_Iprobe( MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag,
+			    MPI_STATUS_IGNORE );
+	}
+	else {
+	    /* Tail pointer is stale, fetch the displacement.  May take
+	       multiple tries if it is being updated. */
+	    chased++;
+	    do {
+		MPI_Win_lock( lock_type, tail_ptr->rank, assert_flag, win );
+		if (kind == APPEND_LOCK) {
+		    MPI_Get( &next_tail_ptr.disp, 1, MPI_AINT, tail_ptr->rank,
+			     NEXT_DISP(*tail_ptr), 1, MPI_AINT, win );
+		}
+		else {
+		    MPI_Fetch_and_op( NULL, &next_tail_ptr.disp, MPI_AINT,
+				      tail_ptr->rank, NEXT_DISP(*tail_ptr),
+				      MPI_NO_OP, win );
+		}
+		MPI_Win_unlock( tail_ptr->rank, win );
+	    } while (next_tail_ptr.disp == nil.disp);
+	    *tail_ptr = next_tail_ptr;
+	}
+    } while (!success);
+
+    return chased;
+}
+
+/* Walk the list from head, counting elements per inserting process */
+static int Traverse( llist_ptr_t head_ptr, int *counts, int nproc,
+		     MPI_Win win )
+{
+    llist_ptr_t  ptr = head_ptr;
+    llist_elem_t elem;
+    int          hops = 0, errs = 0, i;
+
+    for (i=0; i<nproc; i++) counts[i] = 0;
+    while (ptr.disp != nil.disp) {
+	MPI_Win_lock( MPI_LOCK_SHARED, ptr.rank, MPI_MODE_NOCHECK, win );
+	MPI_Get( &elem, sizeof(llist_elem_t), MPI_BYTE, ptr.rank, ptr.disp,
+		 sizeof(llist_elem_t), MPI_BYTE, win );
+	MPI_Win_unlock( ptr.rank, win );
+	if (hops > 0) {
+	    if (elem.value < 0 || elem.value >= nproc) errs++;
+	    else counts[elem.value]++;
+	}
+	else if (elem.value != -1) errs++;
+	ptr = elem.next;
+	hops++;
+    }
+    return errs;
+}
+
+static int ListTest( append_t kind, int nelems )
+{
+    MPI_Win     win;
+    llist_ptr_t head_ptr, tail_ptr, new_elem_ptr;
+    int         procid, nproc, i, chased = 0, errs = 0, *counts, total;
+    double      t, tappend, ttrav1, ttrav;
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &procid );
+    MPI_Comm_size( MPI_COMM_WORLD, &nproc );
+    counts = (int *)malloc( nproc * sizeof(int) );
+
+    MPI_Win_create_dynamic( MPI_INFO_NULL, MPI_COMM_WORLD, &win );
+
+    /* Process 0 creates the head node */
+    if (procid == 0)
+	head_ptr.disp = AllocElem( -1, win );
+    head_ptr.rank = 0;
+    MPI_Bcast( &head_ptr.disp, 1, MPI_AINT, 0, MPI_COMM_WORLD );
+    tail_ptr = head_ptr;
+
+    /* All processes concurrently append nelems elements */
+    MPI_Barrier( MPI_COMM_WORLD );
+    t = MPI_Wtime();
+    for (i=0; i<nelems; i++) {
+	new_elem_ptr.rank = procid;
+	new_elem_ptr.disp = AllocElem( procid, win );
+	chased += Append( kind, &tail_ptr, new_elem_ptr, win );
+    }
+    tappend = MPI_Wtime() - t;
+    MPI_Barrier( MPI_COMM_WORLD );
+
+    /* One process walks the list */
+    ttrav1 = 0;
+    if (procid == 0) {
+	t = MPI_Wtime();
+	errs += Traverse( head_ptr, counts, nproc, win );
+	ttrav1 = MPI_Wtime() - t;
+	for (i=0; i<nproc; i++) {
+	    if (counts[i] != nelems) {
+		errs++;
+		printf( "%s list: rank %d inserted %d elements, expected %d\n",
+			appendName[kind], i, counts[i], nelems );
+	    }
+	}
+    }
+    MPI_Barrier( MPI_COMM_WORLD );
+
+    /* Everyone walks the list at once */
+    t = MPI_Wtime();
+    errs += Traverse( head_ptr, counts, nproc, win );
+    ttrav = MPI_Wtime() - t;
+
+    MPI_Allreduce( MPI_IN_PLACE, &tappend, 1, MPI_DOUBLE, MPI_MAX,
+		   MPI_COMM_WORLD );
+    MPI_Allreduce( MPI_IN_PLACE, &ttrav, 1, MPI_DOUBLE, MPI_MAX,
+		   MPI_COMM_WORLD );
+    MPI_Allreduce( MPI_IN_PLACE, &chased, 1, MPI_INT, MPI_SUM,
+		   MPI_COMM_WORLD );
+    total = nproc * nelems;
+    if (procid == 0 && verbose) {
+	printf( "%s list: %d appends, %e appends/sec, %.2f stale tails per "
+		"append\n", appendName[kind], total,
+		tappend > 0 ? total / tappend : 0.0, (double)chased / total );
+	printf( "%s list: traverse %.3f usec/hop alone, %e hops/sec with all "
+		"%d processes\n", appendName[kind],
+		1.e6 * ttrav1 / (total + 1),
+		ttrav > 0 ? nproc * (total + 1) / ttrav : 0.0, nproc );
+	fflush( stdout );
+    }
+
+    MPI_Barrier( MPI_COMM_WORLD );
+    FreeElems( win );
+    MPI_Win_free( &win );
+    free( counts );
+    return errs;
+}
+#endif
@@ -0,0 +1,263 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Cost of error handlers.  The tests in errhan check that the handlers
+ * are called; code that runs everything with MPI_ERRORS_RETURN (for
+ * example, to recover from failures) also needs that to cost nothing
+ * when there are no errors.  First, each of
+ *
+ *   rank      - MPI_Comm_rank
+ *   iprobe    - MPI_Iprobe with no message
+ *   sendrecv  - MPI_Sendrecv of one int to the process itself
+ *   allreduce - MPI_Allreduce of one int
+ *
+ * is timed on a communicator with MPI_ERRORS_ARE_FATAL, with
+ * MPI_ERRORS_RETURN and with a user error handler (the best of -trials
+ * runs of -reps calls, in microseconds on process 0), with the difference
+ * from MPI_ERRORS_ARE_FATAL.  Then the cost of an error that the program
+ * recovers from is timed with MPI_ERRORS_RETURN and with the user handler:
+ *
+ *   rank      - MPI_Send to a rank that does not exist
+ *   truncate  - MPI_Recv of one int of a message of two ints sent to the
+ *               process itself
+ *
+ * alone, and with MPI_Error_class and MPI_Error_string of the error code.
+ * The error classes returned, the calls of the user handler, and that
+ * communication still works after the errors are checked.
+ *
+ * Options:
+ *   -reps <n>     calls per run without errors (default 100000)
+ *   -errreps <n>  errors per run (default 1000)
+ *   -trials <n>   runs of each (default 3)
+ */
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitest.h"
+
+static int verbose = 0;
+static int rank, size;
+
+typedef enum { EH_FATAL, EH_RETURN, EH_USER, NEH } eh_t;
+static const char *ehName[NEH] = { "fatal", "return", "user" };
+
+typedef enum { OP_RANK, OP_IPROBE, OP_SENDRECV, OP_ALLREDUCE, NOP } op_t;
+static const char *opName[NOP] = { "rank", "iprobe", "sendrecv",
+				   "allreduce" };
+
+typedef enum { ERR_RANK, ERR_TRUNCATE, NERR } err_t;
+static const char *errName[NERR] = { "rank", "truncate" };
+static const int errClass[NERR] = { MPI_ERR_RANK, MPI_ERR_TRUNCATE };
+
+static int userCalls = 0, userLastClass = MPI_SUCCESS;
+
+static void UserHandler( MPI_Comm *comm, int *err, ... )
+{
+    MPI_Error_class( *err, &userLastClass );
+    userCalls++;
+}
+
+static double TimeOp( op_t op, MPI_Comm comm, int reps )
+{
+    int        i, in = 1, out, flag;
+    double     t;
+    MPI_Status status;
+
+    t = MPI_Wtime();
+    for (i=0; i<reps; i++) {
+	switch (op) {
+	case OP_RANK:
+	    MPI_Comm_rank( comm, &out );
+	    break;
+	case OP_IPROBE:
+	    MPI_Iprobe( MPI_ANY_SOURCE, 1, comm, &flag, &status );
+	    break;
+	case OP_SENDRECV:
+	    MPI_Sendrecv( &in, 1, MPI_INT, rank, 0, &out, 1, MPI_INT, rank, 0,
+			  comm, &status );
+	    break;
+	case OP_ALLREDUCE:
+	    MPI_Allreduce( &in, &out, 1, MPI_INT, MPI_SUM, comm );
+	    break;
+	default:
+	    break;
+	}
+    }
+    return (MPI_Wtime() - t) / reps;
+}
+
+/* Cause one error; return the error code */
+static int CauseError( err_t err, MPI_Comm comm )
+{
+    int         buf[2] = { 1, 2 }, rbuf[2], rc;
+    MPI_Request req;
+
+    switch (err) {
+    case ERR_RANK:
+	return MPI_Send( buf, 1, MPI_INT, size, 0, comm );
+    case ERR_TRUNCATE:
+	MPI_Isend( buf, 2, MPI_INT, rank, 0, comm, &req );
+	rc = MPI_Recv( rbuf, 1, MPI_INT, rank, 0, comm, MPI_STATUS_IGNORE );
+	MPI_Wait( &req, MPI_STATUS_IGNORE );
+	return rc;
+    default:
+	return MPI_SUCCESS;
+    }
+}
+
+/* Time errors, optionally with the class and string, and check the class
+   of the last one */
+static double TimeError( err_t err, MPI_Comm comm, int reps, int getString,
+			 int *errs )
+{
+    int    i, rc = MPI_SUCCESS, cls, len;
+    char   msg[MPI_MAX_ERROR_STRING];
+    double t;
+
+    t = MPI_Wtime();
+    for (i=0; i<reps; i++) {
+	rc = CauseError( err, comm );
+	if (getString) {
+	    MPI_Error_class( rc, &cls );
+	    MPI_Error_string( rc, msg, &len );
+	}
+    }
+    t = (MPI_Wtime() - t) / reps;
+
+    MPI_Error_class( rc, &cls );
+    if (cls != errClass[err]) {
+	(*errs)++;
+	printf( "%s error returned class %d, expected %d\n", errName[err],
+		cls, errClass[err] );
+    }
+    return t;
+}
+
+int main( int argc, char *argv[] )
+{
+    int            errs = 0, i, k, reps = 100000, errreps = 1000, trials = 3;
+    int            calls, in, out;
+    double         t, best[NOP][NEH], terr[NERR][2][2];
+    eh_t           eh;
+    op_t           op;
+    err_t          err;
+    MPI_Comm       comm[NEH];
+    MPI_Errhandler userEh;
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-reps" ) == 0 && i+1 < argc) {
+	    reps = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-errreps" ) == 0 && i+1 < argc) {
+	    errreps = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-trials" ) == 0 && i+1 < argc) {
+	    trials = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    if (reps < 1) reps = 1;
+    if (errreps < 1) errreps = 1;
+    if (trials < 1) trials = 1;
+
+    MPI_Comm_create_errhandler( UserHandler, &userEh );
+    for (eh = EH_FATAL; eh < NEH; eh++) {
+	MPI_Comm_dup( MPI_COMM_WORLD, &comm[eh] );
+    }
+    MPI_Comm_set_errhandler( comm[EH_FATAL], MPI_ERRORS_ARE_FATAL );
+    MPI_Comm_set_errhandler( comm[EH_RETURN], MPI_ERRORS_RETURN );
+    MPI_Comm_set_errhandler( comm[EH_USER], userEh );
+    MPI_Errhandler_free( &userEh );
+
+    /* Without errors; the handlers take turns in each trial */
+    for (op = OP_RANK; op < NOP; op++) {
+	for (eh = EH_FATAL; eh < NEH; eh++) best[op][eh] = 1.e30;
+	for (k=0; k<trials; k++) {
+	    for (eh = EH_FATAL; eh < NEH; eh++) {
+		MPI_Barrier( MPI_COMM_WORLD );
+		t = TimeOp( op, comm[eh], reps );
+		if (t < best[op][eh]) best[op][eh] = t;
+	    }
+	}
+    }
+    if (userCalls != 0) {
+	errs++;
+	printf( "The user error handler was called %d times without an "
+		"error\n", userCalls );
+    }
+
+    /* With errors */
+    for (err = ERR_RANK; err < NERR; err++) {
+	for (i=0; i<2; i++) {
+	    eh = (i == 0) ? EH_RETURN : EH_USER;
+	    for (k=0; k<2; k++) {
+		calls = userCalls;
+		terr[err][i][k] = TimeError( err, comm[eh], errreps, k, &errs );
+		if (eh == EH_USER && (userCalls - calls != errreps ||
+				      userLastClass != errClass[err])) {
+		    errs++;
+		    printf( "%d %s errors called the user handler %d times, "
+			    "last with class %d\n", errreps, errName[err],
+			    userCalls - calls, userLastClass );
+		}
+	    }
+	}
+    }
+
+    /* Communication still works */
+    for (eh = EH_RETURN; eh < NEH; eh++) {
+	in = rank + 1;
+	MPI_Allreduce( &in, &out, 1, MPI_INT, MPI_SUM, comm[eh] );
+	if (out != size * (size + 1) / 2) {
+	    errs++;
+	    printf( "Allreduce after errors gave %d\n", out );
+	}
+    }
+
+    if (rank == 0 && verbose) {
+	printf( "Without errors, us per call (best of %d runs of %d)\n",
+		trials, reps );
+	printf( "%-10s %10s %10s %10s %12s %12s\n", "call", ehName[EH_FATAL],
+		ehName[EH_RETURN], ehName[EH_USER], "return-fatal",
+		"user-fatal" );
+	for (op = OP_RANK; op < NOP; op++) {
+	    printf( "%-10s %10.4f %10.4f %10.4f %12.4f %12.4f\n", opName[op],
+		    1.e6 * best[op][EH_FATAL], 1.e6 * best[op][EH_RETURN],
+		    1.e6 * best[op][EH_USER],
+		    1.e6 * (best[op][EH_RETURN] - best[op][EH_FATAL]),
+		    1.e6 * (best[op][EH_USER] - best[op][EH_FATAL]) );
+	}
+	printf( "\nErrors, us per error (%d errors)\n", errreps );
+	printf( "%-10s %10s %14s %10s %14s\n", "error", ehName[EH_RETURN],
+		"+class/string", ehName[EH_USER], "+class/string" );
+	for (err = ERR_RANK; err < NERR; err++) {
+	    printf( "%-10s %10.3f %14.3f %10.3f %14.3f\n", errName[err],
+		    1.e6 * terr[err][0][0], 1.e6 * terr[err][0][1],
+		    1.e6 * terr[err][1][0], 1.e6 * terr[err][1][1] );
+	}
+	fflush( stdout );
+    }
+
+    for (eh = EH_FATAL; eh < NEH; eh++) {
+	MPI_Comm_free( &comm[eh] );
+    }
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,289 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Cost of the MPI_Info routines as the number of keys in an info object
+ * grows (1, 2, 4, ..., -maxkeys).  The tests in info check the semantics;
+ * code that builds info objects with many hints for every file it opens
+ * also needs them not to take time quadratic in the number of keys.  For
+ * each number of keys the following are timed (in microseconds, on
+ * process 0):
+ *
+ *   set      - MPI_Info_set of a new key
+ *   get      - MPI_Info_get of a random key
+ *   nthkey   - MPI_Info_get_nthkey of every key in turn (so a list that
+ *              is searched from the start each time shows up here)
+ *   delete   - MPI_Info_delete of every key of a dup
+ *   dup      - MPI_Info_dup of the whole object
+ *
+ * and the extra time, over MPI_INFO_NULL, of passing the info object to
+ * MPI_File_open (with MPI_File_close), to MPI_Win_create (with
+ * MPI_Win_free), and, with -spawn, to MPI_Comm_spawn of one process (with
+ * MPI_Comm_disconnect).  The keys are not hints that the implementation
+ * knows, so this is the cost of scanning them.  Before that the rate of
+ * MPI_Info_create and MPI_Info_free of empty info objects is reported.
+ * The values returned are checked.
+ *
+ * Options:
+ *   -maxkeys <n>  largest number of keys (default 1024)
+ *   -reps <n>     repetitions of get (default 10000)
+ *   -objreps <n>  repetitions of the open, create and spawn (default 10)
+ *   -spawn        also time MPI_Comm_spawn
+ */
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitestconf.h"
+#include "mpitest.h"
+
+static int verbose = 0;
+static int rank;
+
+/* The calls that take an info object */
+typedef enum { CALL_FILE, CALL_WIN, CALL_SPAWN, NCALL } call_t;
+static const char *callName[NCALL] = { "File_open", "Win_create", "spawn" };
+
+static void MakeKey( char *key, int i )
+{
+    sprintf( key, "infoperf_key%05d", i );
+}
+
+static void MakeValue( char *value, int i )
+{
+    sprintf( value, "value_%d", i );
+}
+
+/* The time to pass info to one of the calls, averaged over reps; -1 if
+   the call is not available */
+static double TimeCall( call_t call, MPI_Info info, int reps, char *prog )
+{
+    double t;
+    int    r;
+#ifdef HAVE_MPI_IO
+    MPI_File fh;
+#endif
+#ifdef HAVE_MPI_WIN_CREATE
+    static char winbuf[64];
+    MPI_Win win;
+#endif
+#ifdef HAVE_MPI_SPAWN
+    MPI_Comm intercomm;
+#endif
+
+    MPI_Barrier( MPI_COMM_WORLD );
+    t = MPI_Wtime();
+    for (r=0; r<reps; r++) {
+	switch (call) {
+#ifdef HAVE_MPI_IO
+	case CALL_FILE:
+	    MPI_File_open( MPI_COMM_WORLD, (char *)"infoperf.tmp",
+			   MPI_MODE_CREATE | MPI_MODE_RDWR |
+			   MPI_MODE_DELETE_ON_CLOSE, info, &fh );
+	    MPI_File_close( &fh );
+	    break;
+#endif
+#ifdef HAVE_MPI_WIN_CREATE
+	case CALL_WIN:
+	    MPI_Win_create( winbuf, sizeof(winbuf), 1, info, MPI_COMM_WORLD,
+			    &win );
+	    MPI_Win_free( &win );
+	    break;
+#endif
+#ifdef HAVE_MPI_SPAWN
+	case CALL_SPAWN:
+	    MPI_Comm_spawn( prog, MPI_ARGV_NULL, 1, info, 0, MPI_COMM_WORLD,
+			    &intercomm, MPI_ERRCODES_IGNORE );
+	    MPI_Comm_disconnect( &intercomm );
+	    break;
+#endif
+	default:
+	    return -1;
+	}
+    }
+    return (MPI_Wtime() - t) / reps;
+}
+
+int main( int argc, char *argv[] )
+{
+    int      errs = 0, i, r, flag, nkeys, maxkeys = 1024, reps = 10000;
+    int      objreps = 10, doSpawn = 0, nobj, *order;
+    unsigned int seed = 1;
+    double   t, times[5], tnull[NCALL], tcall;
+    char     key[MPI_MAX_INFO_KEY+1], value[64], expected[64];
+    MPI_Info info, dup;
+    call_t   call;
+#ifdef HAVE_MPI_SPAWN
+    MPI_Comm parent;
+#endif
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+#ifdef HAVE_MPI_SPAWN
+    /* The processes started by MPI_Comm_spawn only disconnect */
+    MPI_Comm_get_parent( &parent );
+    if (parent != MPI_COMM_NULL) {
+	MPI_Comm_disconnect( &parent );
+	MPI_Finalize();
+	return 0;
+    }
+#endif
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-maxkeys" ) == 0 && i+1 < argc) {
+	    maxkeys = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-reps" ) == 0 && i+1 < argc) {
+	    reps = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-objreps" ) == 0 && i+1 < argc) {
+	    objreps = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-spawn" ) == 0) {
+	    doSpawn = 1;
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    if (maxkeys < 1) maxkeys = 1;
+    if (reps < 1) reps = 1;
+    if (objreps < 1) objreps = 1;
+
+    order = (int *)malloc( reps * sizeof(int) );
+    if (!order) {
+	MTestError( "Unable to allocate key order" );
+    }
+
+    /* Create and free */
+    nobj = 100000;
+    t = MPI_Wtime();
+    for (i=0; i<nobj; i++) {
+	MPI_Info_create( &info );
+	MPI_Info_free( &info );
+    }
+    t = MPI_Wtime() - t;
+    if (rank == 0 && verbose) {
+	printf( "MPI_Info_create and MPI_Info_free: %.3f us (%.0f per "
+		"second)\n", 1.e6 * t / nobj, nobj / t );
+    }
+
+    /* The calls with MPI_INFO_NULL */
+    for (call = CALL_FILE; call < NCALL; call++) {
+	tnull[call] = -1;
+	if (call == CALL_SPAWN && !doSpawn) continue;
+	/* The first call may set up the component used */
+	TimeCall( call, MPI_INFO_NULL, 1, argv[0] );
+	tnull[call] = TimeCall( call, MPI_INFO_NULL, objreps, argv[0] );
+    }
+
+    if (rank == 0 && verbose) {
+	printf( "Times in us; for the calls, the extra time over "
+		"MPI_INFO_NULL\n" );
+	printf( "%7s %8s %8s %8s %8s %10s", "keys", "set", "get", "nthkey",
+		"delete", "dup" );
+	for (call = CALL_FILE; call < NCALL; call++) {
+	    if (tnull[call] >= 0) printf( " %10s", callName[call] );
+	}
+	printf( "\n" );
+    }
+
+    for (nkeys = 1; ; nkeys = (2 * nkeys < maxkeys) ? 2 * nkeys : maxkeys) {
+	/* Random keys to look up */
+	for (r=0; r<reps; r++) {
+	    seed = seed * 1103515245 + 12345;
+	    order[r] = (seed >> 8) % nkeys;
+	}
+
+	/* Set */
+	MPI_Info_create( &info );
+	t = MPI_Wtime();
+	for (i=0; i<nkeys; i++) {
+	    MakeKey( key, i );
+	    MakeValue( value, i );
+	    MPI_Info_set( info, key, value );
+	}
+	times[0] = (MPI_Wtime() - t) / nkeys;
+
+	/* Get, in random order */
+	t = MPI_Wtime();
+	for (r=0; r<reps; r++) {
+	    MakeKey( key, order[r] );
+	    MPI_Info_get( info, key, sizeof(value) - 1, value, &flag );
+	}
+	times[1] = (MPI_Wtime() - t) / reps;
+	for (r=0; r<reps; r++) {
+	    MakeKey( key, order[r] );
+	    MakeValue( expected, order[r] );
+	    MPI_Info_get( info, key, sizeof(value) - 1, value, &flag );
+	    if (!flag || strcmp( value, expected ) != 0) {
+		errs++;
+		printf( "Key %s of %d: flag %d, value %s\n", key, nkeys, flag,
+			flag ? value : "" );
+		break;
+	    }
+	}
+
+	/* Each key in turn */
+	t = MPI_Wtime();
+	for (i=0; i<nkeys; i++) {
+	    MPI_Info_get_nthkey( info, i, key );
+	}
+	times[2] = (MPI_Wtime() - t) / nkeys;
+
+	/* Dup, and delete every key of the dup */
+	t = MPI_Wtime();
+	MPI_Info_dup( info, &dup );
+	times[4] = MPI_Wtime() - t;
+	MPI_Info_get_nkeys( dup, &i );
+	if (i != nkeys) {
+	    errs++;
+	    printf( "Dup of an info with %d keys has %d keys\n", nkeys, i );
+	}
+	t = MPI_Wtime();
+	for (i=0; i<nkeys; i++) {
+	    MakeKey( key, i );
+	    MPI_Info_delete( dup, key );
+	}
+	times[3] = (MPI_Wtime() - t) / nkeys;
+	MPI_Info_get_nkeys( dup, &i );
+	if (i != 0) {
+	    errs++;
+	    printf( "%d keys left after deleting all\n", i );
+	}
+	MPI_Info_free( &dup );
+
+	if (rank == 0 && verbose) {
+	    printf( "%7d %8.3f %8.3f %8.3f %8.3f %10.1f", nkeys,
+		    1.e6 * times[0], 1.e6 * times[1], 1.e6 * times[2],
+		    1.e6 * times[3], 1.e6 * times[4] );
+	}
+	for (call = CALL_FILE; call < NCALL; call++) {
+	    if (tnull[call] < 0) continue;
+	    tcall = TimeCall( call, info, objreps, argv[0] );
+	    if (rank == 0 && verbose) {
+		printf( " %10.1f", 1.e6 * (tcall - tnull[call]) );
+	    }
+	}
+	if (rank == 0 && verbose) {
+	    printf( "\n" );
+	    fflush( stdout );
+	}
+	MPI_Info_free( &info );
+	if (nkeys == maxkeys) break;
+    }
+
+    free( order );
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,407 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Memory used by the MPI library for each communicator, window, datatype
+ * and info object.  MTestResourceSummary (MPITEST_RUSAGE) only reports
+ * the largest resident set of the whole test; here objects of one kind
+ * are created in batches of -batch, up to -n, and the resident set size
+ * of each process is sampled after each batch.  The bytes per object are
+ * the slope of a least squares fit of the samples against the number of
+ * objects, which hides the granularity of the allocator.  The kinds are
+ *
+ *   intracomm - the communicators returned by MTestGetIntracomm
+ *   intercomm - the communicators returned by MTestGetIntercomm
+ *   win       - the windows returned by MTestGetWin (each has a buffer of
+ *               at most 64 * size bytes, which is included)
+ *   datatype  - committed contiguous, vector, indexed and struct types
+ *   info      - info objects with -keys keys each
+ *
+ * Only the objects that are not predefined and not MPI_COMM_NULL on a
+ * process count for that process.  No object is freed until the end, so
+ * that memory freed by one kind cannot be reused by the next; note that
+ * about (log2(size) + 3) * n communicators exist at the end.
+ *
+ * Then, to show how the memory grows with the number of processes, dups
+ * of a communicator with the first p processes of MPI_COMM_WORLD, and
+ * windows (with no memory) on it, are measured for p = 1, 2, 4, ..., size.
+ * A library whose per-communicator or per-window memory is proportional
+ * to p will not fit in memory on very large systems.
+ *
+ * The resident set is read from /proc/self/status, or, where that is not
+ * available, is the maximum resident set from getrusage (which does not
+ * fall when memory is freed).
+ *
+ * Options:
+ *   -n <n>        objects of each kind (default 128)
+ *   -batch <n>    objects between samples (default 16)
+ *   -keys <n>     keys in each info object (default 8)
+ *   -only <kind>  measure only one kind, and skip the scaling with p
+ */
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitestconf.h"
+#include "mpitest.h"
+
+static int verbose = 0;
+static int rank, size;
+
+typedef enum { KIND_INTRACOMM, KIND_INTERCOMM, KIND_WIN, KIND_DATATYPE,
+	       KIND_INFO, NKIND } kind_t;
+static const char *kindName[NKIND] = { "intracomm", "intercomm", "win",
+				       "datatype", "info" };
+
+/* Samples of the resident set against the number of objects */
+typedef struct {
+    int    n;
+    double x[1024], y[1024];
+} Samples;
+
+static void AddSample( Samples *s, int nobj )
+{
+    if (s->n < 1024) {
+	s->x[s->n] = nobj;
+	s->y[s->n] = MTestResidentBytes();
+	s->n++;
+    }
+}
+
+/* Least squares slope of y against x */
+static double Slope( Samples *s )
+{
+    double mx = 0, my = 0, sxx = 0, sxy = 0;
+    int    i;
+
+    for (i=0; i<s->n; i++) {
+	mx += s->x[i];
+	my += s->y[i];
+    }
+    if (s->n < 2) return 0;
+    mx /= s->n;
+    my /= s->n;
+    for (i=0; i<s->n; i++) {
+	sxx += (s->x[i] - mx) * (s->x[i] - mx);
+	sxy += (s->x[i] - mx) * (s->y[i] - my);
+    }
+    return (sxx > 0) ? sxy / sxx : 0;
+}
+
+/* The objects created so far.  None is freed until the end, so that the
+   memory of one kind is not reused by the next */
+typedef struct {
+    int          ncomm, nwin, ntype, ninfo, mtestWins;
+    MPI_Comm     *comms;
+    MPI_Win      *wins;
+    MPI_Datatype *types;
+    MPI_Info     *infos;
+} Objects;
+
+static void AllocObjects( Objects *obj, int n )
+{
+    obj->ncomm = obj->nwin = obj->ntype = obj->ninfo = 0;
+    obj->mtestWins = 0;
+    /* One more communicator for the communicator of the scaling test */
+    obj->comms = (MPI_Comm *)malloc( (n + 1) * sizeof(MPI_Comm) );
+    obj->wins  = (MPI_Win *)malloc( n * sizeof(MPI_Win) );
+    obj->types = (MPI_Datatype *)malloc( n * sizeof(MPI_Datatype) );
+    obj->infos = (MPI_Info *)malloc( n * sizeof(MPI_Info) );
+    if (!obj->comms || !obj->wins || !obj->types || !obj->infos) {
+	MTestError( "Unable to allocate object arrays" );
+    }
+}
+
+static void FreeObjects( Objects *obj )
+{
+    int i;
+
+    for (i=0; i<obj->nwin; i++) {
+#ifdef HAVE_MPI_WIN_CREATE
+	if (obj->mtestWins) MTestFreeWin( &obj->wins[i] );
+	else                MPI_Win_free( &obj->wins[i] );
+#endif
+    }
+    for (i=0; i<obj->ncomm; i++) MTestFreeComm( &obj->comms[i] );
+    for (i=0; i<obj->ntype; i++) MPI_Type_free( &obj->types[i] );
+    for (i=0; i<obj->ninfo; i++) MPI_Info_free( &obj->infos[i] );
+    free( obj->comms );
+    free( obj->wins );
+    free( obj->types );
+    free( obj->infos );
+}
+
+/* Create the i-th object of a kind (collectively for communicators and
+   windows).  Return 1 if the calling process has a new object */
+static int CreateObject( kind_t kind, int i, int nkeys, Objects *obj )
+{
+    int          k, isLeft, blens[3] = { 1, 2, 3 }, displs[3] = { 0, 4, 16 };
+    MPI_Aint     bdispls[3] = { 0, 8, 32 };
+    MPI_Datatype types[3];
+    MPI_Comm     comm;
+    char         key[32], value[32];
+
+    switch (kind) {
+    case KIND_INTRACOMM:
+	MTestGetIntracomm( &comm, 1 );
+	if (comm == MPI_COMM_NULL || comm == MPI_COMM_WORLD ||
+	    comm == MPI_COMM_SELF) return 0;
+	obj->comms[obj->ncomm++] = comm;
+	return 1;
+    case KIND_INTERCOMM:
+	MTestGetIntercomm( &comm, &isLeft, 1 );
+	if (comm == MPI_COMM_NULL) return 0;
+	obj->comms[obj->ncomm++] = comm;
+	return 1;
+#ifdef HAVE_MPI_WIN_CREATE
+    case KIND_WIN:
+	/* MTestGetWin returns 0 at the end of its list, without a window */
+	while (MTestGetWin( &obj->wins[obj->nwin], 0 ) == 0) ;
+	obj->nwin++;
+	obj->mtestWins = 1;
+	return 1;
+#endif
+    case KIND_DATATYPE:
+	switch (i % 4) {
+	case 0:
+	    MPI_Type_contiguous( 16, MPI_INT, &obj->types[obj->ntype] );
+	    break;
+	case 1:
+	    MPI_Type_vector( 8, 2, 5, MPI_DOUBLE, &obj->types[obj->ntype] );
+	    break;
+	case 2:
+	    MPI_Type_indexed( 3, blens, displs, MPI_INT,
+			      &obj->types[obj->ntype] );
+	    break;
+	default:
+	    types[0] = MPI_INT;
+	    types[1] = MPI_DOUBLE;
+	    types[2] = MPI_CHAR;
+	    MPI_Type_create_struct( 3, blens, bdispls, types,
+				    &obj->types[obj->ntype] );
+	    break;
+	}
+	MPI_Type_commit( &obj->types[obj->ntype++] );
+	return 1;
+    case KIND_INFO:
+	MPI_Info_create( &obj->infos[obj->ninfo] );
+	for (k=0; k<nkeys; k++) {
+	    sprintf( key, "memscale_key%d", k );
+	    sprintf( value, "value%d_%d", i, k );
+	    MPI_Info_set( obj->infos[obj->ninfo], key, value );
+	}
+	obj->ninfo++;
+	return 1;
+    default:
+	return 0;
+    }
+}
+
+/* Measure one kind; return the bytes per object on this process, or -1
+   if this process created no objects */
+static double MeasureKind( kind_t kind, int n, int batch, int nkeys,
+			   Objects *obj )
+{
+    int     i, nobj = 0;
+    Samples s;
+
+    AllocObjects( obj, n );
+    s.n = 0;
+    MPI_Barrier( MPI_COMM_WORLD );
+    AddSample( &s, 0 );
+    for (i=0; i<n; i++) {
+	nobj += CreateObject( kind, i, nkeys, obj );
+	if ((i + 1) % batch == 0 || i == n - 1) {
+	    AddSample( &s, nobj );
+	}
+    }
+    return (nobj > 0) ? Slope( &s ) : -1;
+}
+
+/* Report the average (over the processes with objects) and maximum */
+static void Report( const char *name, double bytes )
+{
+    double in[2], sum[2], maxv;
+
+    in[0] = (bytes >= 0) ? bytes : 0;
+    in[1] = (bytes >= 0) ? 1 : 0;
+    MPI_Reduce( in, sum, 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD );
+    MPI_Reduce( &bytes, &maxv, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD );
+    if (rank == 0 && verbose) {
+	if (sum[1] > 0) {
+	    printf( "%-24s %14.0f %14.0f\n", name, sum[0] / sum[1], maxv );
+	}
+	else {
+	    printf( "%-24s %14s %14s\n", name, "-", "-" );
+	}
+	fflush( stdout );
+    }
+}
+
+/* Bytes per dup of, and per window on, the first p processes */
+static void MeasureScaling( int p, int n, int batch, double *commBytes,
+			    double *winBytes, Objects *obj )
+{
+    static char winbuf[8];
+    MPI_Comm sub;
+    Samples  s;
+    int      i, ok = 1;
+
+    *commBytes = -1;
+    *winBytes  = -1;
+    AllocObjects( obj, n );
+    MPI_Comm_split( MPI_COMM_WORLD, rank < p ? 0 : MPI_UNDEFINED, rank,
+		    &sub );
+    if (sub == MPI_COMM_NULL) return;
+    obj->comms[obj->ncomm++] = sub;
+
+    s.n = 0;
+    MPI_Barrier( sub );
+    AddSample( &s, 0 );
+    for (i=0; i<n; i++) {
+	MPI_Comm_dup( sub, &obj->comms[obj->ncomm++] );
+	if ((i + 1) % batch == 0 || i == n - 1) AddSample( &s, i + 1 );
+    }
+    *commBytes = Slope( &s );
+
+#ifdef HAVE_MPI_WIN_CREATE
+    /* Some implementations cannot create windows on some communicators
+       (e.g., with one process); report no value for those */
+    MPI_Comm_set_errhandler( sub, MPI_ERRORS_RETURN );
+    s.n = 0;
+    MPI_Barrier( sub );
+    AddSample( &s, 0 );
+    for (i=0; i<n && ok; i++) {
+	ok = (MPI_Win_create( winbuf, 0, 1, MPI_INFO_NULL, sub,
+			      &obj->wins[obj->nwin] ) == MPI_SUCCESS);
+	if (ok) obj->nwin++;
+	MPI_Allreduce( MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, sub );
+	if ((i + 1) % batch == 0 || i == n - 1) AddSample( &s, i + 1 );
+    }
+    if (ok) *winBytes = Slope( &s );
+#endif
+}
+
+int main( int argc, char *argv[] )
+{
+    int     errs = 0, i, n = 128, batch = 16, nkeys = 8, only = -1, p;
+    int     nobj = 0;
+    kind_t  kind;
+    double  commBytes, winBytes, base[2];
+    char    name[64];
+    Objects obj[NKIND + 32];
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-n" ) == 0 && i+1 < argc) {
+	    n = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-batch" ) == 0 && i+1 < argc) {
+	    batch = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-keys" ) == 0 && i+1 < argc) {
+	    nkeys = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-only" ) == 0 && i+1 < argc) {
+	    i++;
+	    for (kind = KIND_INTRACOMM; kind < NKIND; kind++) {
+		if (strcmp( argv[i], kindName[kind] ) == 0) only = kind;
+	    }
+	    if (only < 0) {
+		fprintf( stderr, "Unrecognized kind %s\n", argv[i] );
+		MPI_Abort( MPI_COMM_WORLD, 1 );
+	    }
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    if (n < 1) n = 1;
+    if (batch < 1) batch = 1;
+    /* At least two samples are needed for a slope */
+    if (batch > n) batch = n;
+    if (n / batch > 1000) batch = (n + 999) / 1000;
+
+    if (MTestResidentBytes() < 0) {
+	errs++;
+	if (rank == 0) {
+	    printf( "The resident set size is not available\n" );
+	}
+    }
+
+    if (rank == 0 && verbose) {
+	printf( "%d processes, %d objects of each kind, sampled every %d\n",
+		size, n, batch );
+	printf( "%-24s %14s %14s\n", "object", "avg bytes", "max bytes" );
+    }
+    for (kind = KIND_INTRACOMM; kind < NKIND && !errs; kind++) {
+	if (only >= 0 && kind != only) continue;
+#ifndef HAVE_MPI_WIN_CREATE
+	if (kind == KIND_WIN) continue;
+#endif
+	if (kind == KIND_INFO) {
+	    sprintf( name, "info (%d keys)", nkeys );
+	}
+	else {
+	    strcpy( name, kindName[kind] );
+	}
+	Report( name, MeasureKind( kind, n, batch, nkeys, &obj[nobj++] ) );
+    }
+
+    if (only < 0 && !errs) {
+	if (rank == 0 && verbose) {
+	    printf( "\nBytes per object on the first p processes (average, "
+		    "and growth from the smallest p)\n" );
+	    printf( "%8s %14s %8s %14s %8s\n", "p", "comm dup", "growth",
+		    "win", "growth" );
+	}
+	base[0] = base[1] = -1;
+	p = 1;
+	while (1) {
+	    double in[4], sum[4];
+	    MeasureScaling( p, n, batch, &commBytes, &winBytes,
+			    &obj[nobj++] );
+	    in[0] = (commBytes >= 0) ? commBytes : 0;
+	    in[1] = (commBytes >= 0);
+	    in[2] = (winBytes >= 0) ? winBytes : 0;
+	    in[3] = (winBytes >= 0);
+	    MPI_Reduce( in, sum, 4, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD );
+	    if (rank == 0 && verbose) {
+		printf( "%8d", p );
+		for (i=0; i<2; i++) {
+		    if (sum[2*i+1] > 0) {
+			sum[2*i] /= sum[2*i+1];
+			if (base[i] < 0) base[i] = sum[2*i];
+			printf( " %14.0f %8.2f", sum[2*i],
+				(base[i] > 0) ? sum[2*i] / base[i] : 0.0 );
+		    }
+		    else {
+			printf( " %14s %8s", "-", "-" );
+		    }
+		}
+		printf( "\n" );
+		fflush( stdout );
+	    }
+	    if (p == size) break;
+	    p = (2 * p < size) ? 2 * p : size;
+	}
+    }
+
+    for (i=nobj-1; i>=0; i--) {
+	FreeObjects( &obj[i] );
+    }
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
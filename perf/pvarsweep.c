@@ -0,0 +1,204 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Ping-pong between processes 0 and 1 with the MPI_T performance
+ * variables sampled around each message size, optionally repeated for
+ * several values of a control variable (for example an eager threshold).
+ * For each value and size, the round-trip time is printed together with
+ * the performance variables on process 0 that changed (unexpected and
+ * posted queue lengths, message counts, memory in use, and so on, as
+ * provided by the implementation), when MPITEST_VERBOSE is set.
+ *
+ * Any test can be run with different control variable settings with the
+ * MPITEST_CVARS environment variable (see MTest_Init); this program
+ * sweeps one variable within a run.  Since the values are written after
+ * MPI_Init, only variables that the implementation lets change at that
+ * point can be swept: never those with scope MPI_T_SCOPE_CONSTANT or
+ * MPI_T_SCOPE_READONLY, and those with a LOCAL to ALL_EQ scope only if
+ * the implementation permits it (Open MPI, for example, fixes most of its
+ * transport parameters during MPI_Init).  Such variables must be set
+ * before MPI_Init, with MPITEST_CVARS or the -env knobs of autotune.  A
+ * value that cannot be written is skipped (and reported when
+ * MPITEST_VERBOSE is set); it is an error if none of the values can be
+ * written.  A value that was written must read back unchanged.
+ *
+ * Options:
+ *   -cvar <name>        control variable to sweep
+ *   -values <v1,v2,...> values for it
+ *   -maxbytes <n>       largest message (default 1048576)
+ */
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitest.h"
+
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+#define TEST_MPI_T 1
+#endif
+
+static int verbose = 0;
+
+int main( int argc, char *argv[] )
+{
+    int    errs = 0, i, k, rank, size, n, reps, maxbytes = 1048576;
+    char   *cvar = 0, *values = 0, *value, *next;
+    char   *sbuf, *rbuf;
+    double t;
+#ifdef TEST_MPI_T
+    MTestPvarSet *pvars = 0;
+    int          merr, failed, nset = 0;
+    char         readback[256];
+#endif
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-cvar" ) == 0 && i+1 < argc) {
+	    cvar = argv[++i];
+	}
+	else if (strcmp( argv[i], "-values" ) == 0 && i+1 < argc) {
+	    values = argv[++i];
+	}
+	else if (strcmp( argv[i], "-maxbytes" ) == 0 && i+1 < argc) {
+	    maxbytes = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+    if (size < 2) {
+	fprintf( stderr, "This test requires at least 2 processes\n" );
+	MPI_Abort( MPI_COMM_WORLD, 1 );
+    }
+
+    sbuf = (char *)malloc( maxbytes );
+    rbuf = (char *)malloc( maxbytes );
+    if (!sbuf || !rbuf) {
+	MTestError( "Unable to allocate buffers" );
+    }
+
+#ifdef TEST_MPI_T
+    merr = MTestPvarSessionCreate( MPI_COMM_WORLD, &pvars );
+    if (merr && rank == 0 && verbose) {
+	printf( "No MPI_T performance variables (%d)\n", merr );
+    }
+    if (pvars && rank == 0 && verbose) {
+	printf( "%d performance variables\n", MTestPvarGetNum( pvars ) );
+    }
+#endif
+
+    /* One pass with the current settings if no sweep is requested */
+    if (!cvar || !values) {
+	cvar   = 0;
+	values = (char *)"";
+    }
+    values = strdup( values );
+    for (value = values; value; value = next) {
+	next = strchr( value, ',' );
+	if (next) *next++ = 0;
+	if (cvar) {
+#ifdef TEST_MPI_T
+	    /* The write is local; skip the value on every process if it
+	       failed on any, or the others would wait in the ping-pong */
+	    merr   = MTestCvarWrite( cvar, value );
+	    failed = merr != 0;
+	    MPI_Allreduce( MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX,
+			   MPI_COMM_WORLD );
+	    if (failed) {
+		if (rank == 0 && verbose)
+		    printf( "%s = %s could not be set (%d)\n", cvar, value,
+			    merr );
+		continue;
+	    }
+	    nset++;
+	    MTestCvarRead( cvar, readback, sizeof(readback) );
+	    if (strtod( readback, 0 ) != strtod( value, 0 ) &&
+		strcmp( readback, value ) != 0) {
+		errs++;
+		printf( "%s was set to %s but reads %s\n", cvar, value,
+			readback );
+	    }
+	    if (rank == 0 && verbose) printf( "%s = %s\n", cvar, value );
+#else
+	    if (rank == 0 && verbose)
+		printf( "MPI_T is not available; %s not set\n", cvar );
+	    cvar = 0;
+#endif
+	}
+	if (rank == 0 && verbose) {
+	    printf( "%10s%14s%12s\n", "bytes", "rtt (us)", "MB/s" );
+	}
+
+	for (n = 1; n <= maxbytes; n *= 4) {
+	    reps = 10000000 / (n + 10000) + 2;
+	    for (i=0; i<n; i++) {
+		sbuf[i] = (char)(i + rank);
+		rbuf[i] = -1;
+	    }
+	    MPI_Barrier( MPI_COMM_WORLD );
+#ifdef TEST_MPI_T
+	    if (pvars) MTestPvarStartSample( pvars );
+#endif
+	    t = MPI_Wtime();
+	    for (k=0; k<reps; k++) {
+		if (rank == 0) {
+		    MPI_Send( sbuf, n, MPI_CHAR, 1, 0, MPI_COMM_WORLD );
+		    MPI_Recv( rbuf, n, MPI_CHAR, 1, 0, MPI_COMM_WORLD,
+			      MPI_STATUS_IGNORE );
+		}
+		else if (rank == 1) {
+		    MPI_Recv( rbuf, n, MPI_CHAR, 0, 0, MPI_COMM_WORLD,
+			      MPI_STATUS_IGNORE );
+		    MPI_Send( sbuf, n, MPI_CHAR, 0, 0, MPI_COMM_WORLD );
+		}
+	    }
+	    t = (MPI_Wtime() - t) / reps;
+#ifdef TEST_MPI_T
+	    if (pvars) MTestPvarEndSample( pvars );
+#endif
+	    if (rank < 2) {
+		for (i=0; i<n; i++) {
+		    if (rbuf[i] != (char)(i + 1 - rank)) {
+			errs++;
+			if (errs < 10)
+			    printf( "rbuf[%d] = %d for %d bytes\n", i,
+				    rbuf[i], n );
+			break;
+		    }
+		}
+	    }
+	    if (rank == 0 && verbose) {
+		printf( "%10d%14.2f%12.2f\n", n, 1.e6 * t, 2.e-6 * n / t );
+#ifdef TEST_MPI_T
+		if (pvars) MTestPvarPrintDeltas( pvars, 1 );
+#endif
+		fflush( stdout );
+	    }
+	}
+    }
+    free( values );
+
+#ifdef TEST_MPI_T
+    if (cvar && nset == 0 && rank == 0) {
+	errs++;
+	printf( "None of the values of %s could be set; it may only be "
+		"writable before MPI_Init (see MPITEST_CVARS)\n", cvar );
+    }
+    if (pvars) MTestPvarSessionFree( &pvars );
+#endif
+    free( sbuf );
+    free( rbuf );
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
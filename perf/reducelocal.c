@@ -0,0 +1,383 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Throughput of the predefined reduction operations.  MPI_Reduce_local is
+ * timed for every predefined op applied to every basic datatype it is
+ * defined for (the C integers, MPI_BYTE, the floating point types, the
+ * C complex types and the MPI_MAXLOC/MPI_MINLOC pair types), with buffers
+ * sized to fit in the L1, L2 and L3 caches and in main memory.  Each case
+ * is also timed with a plain C loop doing the same reduction, which the
+ * compiler vectorizes (this file is built with -O3, see Makefile.am); a
+ * large ratio between the two points to an op kernel that the
+ * implementation does not vectorize.
+ *
+ * Throughput is reported in GB/s of input vector reduced (count * size of
+ * the type per call).  Before timing, the result of MPI_Reduce_local is
+ * compared with that of the C loop.  Results are printed when
+ * MPITEST_VERBOSE is set.
+ *
+ * Options:
+ *   -maxbytes <n>  largest buffer size (default 32 MB)
+ *   -work <n>      bytes to reduce for each measurement (default 4 MB); a
+ *                  buffer larger than this is reduced once
+ */
+#include "mpi.h"
+#include "mpitestconf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitest.h"
+
+#if MTEST_HAVE_MIN_MPI_VERSION(2,2) && defined(HAVE_FLOAT__COMPLEX) \
+    && defined(HAVE_DOUBLE__COMPLEX)
+#define TEST_COMPLEX 1
+#endif
+
+/* Classes of datatypes, used to decide which ops apply */
+#define K_INT     0x1   /* C integer: arithmetic, logical and bitwise */
+#define K_BYTE    0x2   /* byte: bitwise only */
+#define K_FLOAT   0x4   /* floating point: arithmetic, min and max */
+#define K_COMPLEX 0x8   /* complex: sum and product */
+#define K_PAIR    0x10  /* value-index pair: maxloc and minloc */
+
+typedef struct {
+    MPI_Op     op;
+    const char *name;
+    int        kinds;
+} opinfo_t;
+
+typedef struct {
+    MPI_Datatype type;
+    const char   *name;
+    int          kind;
+    int          size;
+    /* Fill a buffer; mod selects the values (i % mod) + 1, or all ones
+       when mod is 0 so that repeated products stay bounded */
+    void (*init)( void *buf, int n, int mod );
+    void (*ref)( const void *in, void *inout, int n, MPI_Op op );
+    int  (*check)( const void *a, const void *b, int n );
+} typeinfo_t;
+
+/*
+ * Reference loops.  The op is tested outside of the loop so that each
+ * loop body is simple enough for the compiler to vectorize.
+ */
+#define DEF_CHECK(fn,ctype)						\
+static int fn##_check( const void *a, const void *b, int n )		\
+{									\
+    const ctype *x = (const ctype *)a, *y = (const ctype *)b;		\
+    int i, errs = 0;							\
+    for (i=0; i<n; i++) if (x[i] != y[i]) errs++;			\
+    return errs;							\
+}
+
+#define DEF_INIT(fn,ctype)						\
+static void fn##_init( void *buf, int n, int mod )			\
+{									\
+    ctype *p = (ctype *)buf;						\
+    int i;								\
+    for (i=0; i<n; i++) p[i] = (ctype)(mod ? (i % mod) + 1 : 1);	\
+}
+
+#define DEF_INT(fn,ctype)						\
+DEF_INIT(fn,ctype)							\
+DEF_CHECK(fn,ctype)							\
+static void fn##_ref( const void *in, void *inout, int n, MPI_Op op )	\
+{									\
+    const ctype *a = (const ctype *)in;					\
+    ctype *b = (ctype *)inout;						\
+    int i;								\
+    if (op == MPI_SUM)       for (i=0; i<n; i++) b[i] = a[i] + b[i];	\
+    else if (op == MPI_PROD) for (i=0; i<n; i++) b[i] = a[i] * b[i];	\
+    else if (op == MPI_MAX)						\
+	for (i=0; i<n; i++) b[i] = (a[i] > b[i]) ? a[i] : b[i];		\
+    else if (op == MPI_MIN)						\
+	for (i=0; i<n; i++) b[i] = (a[i] < b[i]) ? a[i] : b[i];		\
+    else if (op == MPI_LAND) for (i=0; i<n; i++) b[i] = a[i] && b[i];	\
+    else if (op == MPI_LOR)  for (i=0; i<n; i++) b[i] = a[i] || b[i];	\
+    else if (op == MPI_LXOR) for (i=0; i<n; i++) b[i] = !a[i] != !b[i];	\
+    else if (op == MPI_BAND) for (i=0; i<n; i++) b[i] = a[i] & b[i];	\
+    else if (op == MPI_BOR)  for (i=0; i<n; i++) b[i] = a[i] | b[i];	\
+    else if (op == MPI_BXOR) for (i=0; i<n; i++) b[i] = a[i] ^ b[i];	\
+}
+
+#define DEF_FLOAT(fn,ctype)						\
+DEF_INIT(fn,ctype)							\
+DEF_CHECK(fn,ctype)							\
+static void fn##_ref( const void *in, void *inout, int n, MPI_Op op )	\
+{									\
+    const ctype *a = (const ctype *)in;					\
+    ctype *b = (ctype *)inout;						\
+    int i;								\
+    if (op == MPI_SUM)       for (i=0; i<n; i++) b[i] = a[i] + b[i];	\
+    else if (op == MPI_PROD) for (i=0; i<n; i++) b[i] = a[i] * b[i];	\
+    else if (op == MPI_MAX)						\
+	for (i=0; i<n; i++) b[i] = (a[i] > b[i]) ? a[i] : b[i];		\
+    else if (op == MPI_MIN)						\
+	for (i=0; i<n; i++) b[i] = (a[i] < b[i]) ? a[i] : b[i];		\
+}
+
+#define DEF_COMPLEX(fn,ctype)						\
+DEF_INIT(fn,ctype)							\
+DEF_CHECK(fn,ctype)							\
+static void fn##_ref( const void *in, void *inout, int n, MPI_Op op )	\
+{									\
+    const ctype *a = (const ctype *)in;					\
+    ctype *b = (ctype *)inout;						\
+    int i;								\
+    if (op == MPI_SUM)       for (i=0; i<n; i++) b[i] = a[i] + b[i];	\
+    else if (op == MPI_PROD) for (i=0; i<n; i++) b[i] = a[i] * b[i];	\
+}
+
+/* Pairs take the index i * mod, so that the two inputs of a tie have
+   different indices */
+#define DEF_PAIR(fn,vtype)						\
+typedef struct { vtype v; int i; } fn##_t;				\
+static void fn##_init( void *buf, int n, int mod )			\
+{									\
+    fn##_t *p = (fn##_t *)buf;						\
+    int i;								\
+    for (i=0; i<n; i++) {						\
+	p[i].v = (vtype)(mod ? (i % mod) + 1 : 1);			\
+	p[i].i = i * mod;						\
+    }									\
+}									\
+static int fn##_check( const void *a, const void *b, int n )		\
+{									\
+    const fn##_t *x = (const fn##_t *)a, *y = (const fn##_t *)b;	\
+    int i, errs = 0;							\
+    for (i=0; i<n; i++) if (x[i].v != y[i].v || x[i].i != y[i].i) errs++; \
+    return errs;							\
+}									\
+static void fn##_ref( const void *in, void *inout, int n, MPI_Op op )	\
+{									\
+    const fn##_t *a = (const fn##_t *)in;				\
+    fn##_t *b = (fn##_t *)inout;					\
+    int i;								\
+    if (op == MPI_MAXLOC) {						\
+	for (i=0; i<n; i++) {						\
+	    if (a[i].v > b[i].v) b[i] = a[i];				\
+	    else if (a[i].v == b[i].v && a[i].i < b[i].i) b[i].i = a[i].i; \
+	}								\
+    }									\
+    else if (op == MPI_MINLOC) {					\
+	for (i=0; i<n; i++) {						\
+	    if (a[i].v < b[i].v) b[i] = a[i];				\
+	    else if (a[i].v == b[i].v && a[i].i < b[i].i) b[i].i = a[i].i; \
+	}								\
+    }									\
+}
+
+DEF_INT(schar,signed char)
+DEF_INT(uchar,unsigned char)
+DEF_INT(short,short)
+DEF_INT(ushort,unsigned short)
+DEF_INT(int,int)
+DEF_INT(uint,unsigned int)
+DEF_INT(long,long)
+DEF_INT(ulong,unsigned long)
+#ifdef HAVE_LONG_LONG
+DEF_INT(llong,long long)
+#endif
+DEF_FLOAT(float,float)
+DEF_FLOAT(double,double)
+#ifdef HAVE_LONG_DOUBLE
+DEF_FLOAT(ldouble,long double)
+#endif
+#ifdef TEST_COMPLEX
+DEF_COMPLEX(fcomplex,float _Complex)
+DEF_COMPLEX(dcomplex,double _Complex)
+#if defined(USE_LONG_DOUBLE_COMPLEX) && defined(HAVE_LONG_DOUBLE__COMPLEX)
+DEF_COMPLEX(ldcomplex,long double _Complex)
+#endif
+#endif
+DEF_PAIR(twoint,int)
+DEF_PAIR(floatint,float)
+DEF_PAIR(doubleint,double)
+DEF_PAIR(longint,long)
+DEF_PAIR(shortint,short)
+#ifdef HAVE_LONG_DOUBLE
+DEF_PAIR(ldoubleint,long double)
+#endif
+
+#define TYPE(mpitype,kind,fn,ctype) \
+    { mpitype, #mpitype, kind, sizeof(ctype), fn##_init, fn##_ref, fn##_check }
+
+static typeinfo_t types[] = {
+    TYPE(MPI_SIGNED_CHAR,	K_INT,	schar,	signed char),
+    TYPE(MPI_UNSIGNED_CHAR,	K_INT,	uchar,	unsigned char),
+    TYPE(MPI_BYTE,		K_BYTE,	uchar,	unsigned char),
+    TYPE(MPI_SHORT,		K_INT,	short,	short),
+    TYPE(MPI_UNSIGNED_SHORT,	K_INT,	ushort,	unsigned short),
+    TYPE(MPI_INT,		K_INT,	int,	int),
+    TYPE(MPI_UNSIGNED,		K_INT,	uint,	unsigned int),
+    TYPE(MPI_LONG,		K_INT,	long,	long),
+    TYPE(MPI_UNSIGNED_LONG,	K_INT,	ulong,	unsigned long),
+#ifdef HAVE_LONG_LONG
+    TYPE(MPI_LONG_LONG,		K_INT,	llong,	long long),
+#endif
+    TYPE(MPI_FLOAT,		K_FLOAT, float,	float),
+    TYPE(MPI_DOUBLE,		K_FLOAT, double, double),
+#ifdef HAVE_LONG_DOUBLE
+    TYPE(MPI_LONG_DOUBLE,	K_FLOAT, ldouble, long double),
+#endif
+#ifdef TEST_COMPLEX
+    TYPE(MPI_C_FLOAT_COMPLEX,	K_COMPLEX, fcomplex, float _Complex),
+    TYPE(MPI_C_DOUBLE_COMPLEX,	K_COMPLEX, dcomplex, double _Complex),
+#if defined(USE_LONG_DOUBLE_COMPLEX) && defined(HAVE_LONG_DOUBLE__COMPLEX)
+    TYPE(MPI_C_LONG_DOUBLE_COMPLEX, K_COMPLEX, ldcomplex, long double _Complex),
+#endif
+#endif
+    TYPE(MPI_2INT,		K_PAIR,	twoint,	twoint_t),
+    TYPE(MPI_FLOAT_INT,		K_PAIR,	floatint, floatint_t),
+    TYPE(MPI_DOUBLE_INT,	K_PAIR,	doubleint, doubleint_t),
+    TYPE(MPI_LONG_INT,		K_PAIR,	longint, longint_t),
+    TYPE(MPI_SHORT_INT,		K_PAIR,	shortint, shortint_t),
+#ifdef HAVE_LONG_DOUBLE
+    TYPE(MPI_LONG_DOUBLE_INT,	K_PAIR,	ldoubleint, ldoubleint_t),
+#endif
+};
+
+static int verbose = 0;
+
+static double TimeReduce( typeinfo_t *t, MPI_Op op, void *in, void *inout,
+			  int count, int reps, int useMPI );
+
+int main( int argc, char *argv[] )
+{
+    int    errs = 0, i, j, rank, count, reps, ntypes, nerr;
+    int    maxbytes = 32*1024*1024, work = 4*1024*1024, bytes, s;
+    static const int  sizes[4] = { 16*1024, 256*1024, 4*1024*1024,
+				   32*1024*1024 };
+    static const char *level[4] = { "L1", "L2", "L3", "DRAM" };
+    double tmpi, tref;
+    char   *in, *inout, *inout2;
+    opinfo_t ops[12];
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-maxbytes" ) == 0 && i+1 < argc) {
+	    maxbytes = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-work" ) == 0 && i+1 < argc) {
+	    work = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+
+    /* The op handles are not compile-time constants in every MPI */
+    ops[0].op  = MPI_SUM;    ops[0].name  = "SUM";
+    ops[0].kinds  = K_INT | K_FLOAT | K_COMPLEX;
+    ops[1].op  = MPI_PROD;   ops[1].name  = "PROD";
+    ops[1].kinds  = K_INT | K_FLOAT | K_COMPLEX;
+    ops[2].op  = MPI_MAX;    ops[2].name  = "MAX";
+    ops[2].kinds  = K_INT | K_FLOAT;
+    ops[3].op  = MPI_MIN;    ops[3].name  = "MIN";
+    ops[3].kinds  = K_INT | K_FLOAT;
+    ops[4].op  = MPI_LAND;   ops[4].name  = "LAND";   ops[4].kinds  = K_INT;
+    ops[5].op  = MPI_LOR;    ops[5].name  = "LOR";    ops[5].kinds  = K_INT;
+    ops[6].op  = MPI_LXOR;   ops[6].name  = "LXOR";   ops[6].kinds  = K_INT;
+    ops[7].op  = MPI_BAND;   ops[7].name  = "BAND";
+    ops[7].kinds  = K_INT | K_BYTE;
+    ops[8].op  = MPI_BOR;    ops[8].name  = "BOR";
+    ops[8].kinds  = K_INT | K_BYTE;
+    ops[9].op  = MPI_BXOR;   ops[9].name  = "BXOR";
+    ops[9].kinds  = K_INT | K_BYTE;
+    ops[10].op = MPI_MAXLOC; ops[10].name = "MAXLOC"; ops[10].kinds = K_PAIR;
+    ops[11].op = MPI_MINLOC; ops[11].name = "MINLOC"; ops[11].kinds = K_PAIR;
+
+    if (maxbytes < sizes[0]) maxbytes = sizes[0];
+    in     = (char *)malloc( maxbytes );
+    inout  = (char *)malloc( maxbytes );
+    inout2 = (char *)malloc( maxbytes );
+    if (!in || !inout || !inout2) {
+	MTestError( "Unable to allocate buffers" );
+    }
+
+    if (rank == 0 && verbose) {
+	printf( "%-26s%-8s%-6s%10s%12s%12s%8s\n", "type", "op", "size",
+		"bytes", "MPI GB/s", "C GB/s", "C/MPI" );
+    }
+
+    ntypes = sizeof(types) / sizeof(types[0]);
+    for (i=0; i<ntypes; i++) {
+	if (types[i].type == MPI_DATATYPE_NULL) continue;
+	for (j=0; j<12; j++) {
+	    if (!(ops[j].kinds & types[i].kind)) continue;
+	    for (s=0; s<4 && sizes[s] <= maxbytes; s++) {
+		bytes = sizes[s];
+		count = bytes / types[i].size;
+
+		/* Check the result against the C loop */
+		types[i].init( in, count, ops[j].op == MPI_PROD ? 0 : 7 );
+		types[i].init( inout, count, 5 );
+		types[i].init( inout2, count, 5 );
+		MPI_Reduce_local( in, inout, count, types[i].type, ops[j].op );
+		types[i].ref( in, inout2, count, ops[j].op );
+		nerr = types[i].check( inout, inout2, count );
+		if (nerr) {
+		    errs += nerr;
+		    printf( "MPI_Reduce_local(%s, %s) differs from the C loop "
+			    "in %d of %d elements\n", types[i].name,
+			    ops[j].name, nerr, count );
+		}
+
+		reps = (bytes < work) ? work / bytes : 1;
+		tmpi = TimeReduce( &types[i], ops[j].op, in, inout, count,
+				   reps, 1 );
+		tref = TimeReduce( &types[i], ops[j].op, in, inout2, count,
+				   reps, 0 );
+		if (rank == 0 && verbose) {
+		    printf( "%-26s%-8s%-6s%10d%12.3f%12.3f%8.2f\n",
+			    types[i].name, ops[j].name, level[s], bytes,
+			    1.e-9 * bytes / tmpi, 1.e-9 * bytes / tref,
+			    tmpi / tref );
+		    fflush( stdout );
+		}
+	    }
+	}
+    }
+
+    free( in );
+    free( inout );
+    free( inout2 );
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
+
+/* Return the time of one reduction, after one untimed call to warm up */
+static double TimeReduce( typeinfo_t *t, MPI_Op op, void *in, void *inout,
+			  int count, int reps, int useMPI )
+{
+    int    k;
+    double tstart, tend;
+
+    if (useMPI) {
+	MPI_Reduce_local( in, inout, count, t->type, op );
+	tstart = MPI_Wtime();
+	for (k=0; k<reps; k++)
+	    MPI_Reduce_local( in, inout, count, t->type, op );
+	tend = MPI_Wtime();
+    }
+    else {
+	t->ref( in, inout, count, op );
+	tstart = MPI_Wtime();
+	for (k=0; k<reps; k++)
+	    t->ref( in, inout, count, op );
+	tend = MPI_Wtime();
+    }
+    if (tend <= tstart) tend = tstart + MPI_Wtick();
+    return (tend - tstart) / reps;
+}
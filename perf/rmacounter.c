@@ -0,0 +1,350 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Compare implementations of a shared RMA counter as the number of
+ * processes that increment it grows.  The counter lives on rank 0 of
+ * each subcommunicator, and every process (including rank 0) takes
+ * ntimes values from it.  The implementations are
+ *
+ *   central - the non-scalable fetch-and-add from Using MPI-2 (Fig 6.12;
+ *             see rma/fetchandadd.c): accumulate into our own slot and
+ *             get all the other slots under an exclusive lock
+ *   tree    - the tree-based version (Fig 6.16; see rma/fetchandadd_tree.c)
+ *   fop     - MPI_Fetch_and_op with MPI_SUM on a single location
+ *   cas     - an MPI_Compare_and_swap retry loop on a single location
+ *
+ * For each process count (powers of two up to the size of MPI_COMM_WORLD)
+ * and implementation the program checks that the values handed out are
+ * exactly 0 .. n*ntimes-1, and, when MPITEST_VERBOSE is set, prints the
+ * increments per second and the min/median/99%/max latency of a single
+ * increment (plus the mean number of retries for cas).
+ *
+ * Options:
+ *   -n <ntimes>  increments per process (default 100)
+ */
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitest.h"
+
+/* The MPI-3 atomics are available either from an MPI-3 library or, in
+   MPICH2 before MPI-3 was final, under the MPIX_ prefix */
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+#  define TEST_MPI3_ROUTINES 1
+#elif !defined(USE_STRICT_MPI) && defined(MPICH2)
+#  define TEST_MPI3_ROUTINES 1
+#  define MPI_Fetch_and_op     MPIX_Fetch_and_op
+#  define MPI_Compare_and_swap MPIX_Compare_and_swap
+#  define MPI_NO_OP            MPIX_NO_OP
+#endif
+
+typedef enum { CTR_CENTRAL = 0, CTR_TREE, CTR_FOP, CTR_CAS, CTR_LAST } ctr_t;
+static const char *ctrName[CTR_LAST] = { "central", "tree", "fop", "cas" };
+
+static int verbose = 0;
+
+/* State of one counter instance */
+typedef struct {
+    ctr_t        kind;
+    MPI_Win      win;
+    int          *mem;           /* window memory on rank 0 */
+    int          rank, nprocs;
+    int          localvalue;     /* our contribution (central, tree) */
+    int          *val_array;     /* central: all slots; tree: one/level */
+    int          *one;           /* tree: 1 per level */
+    int          nlevels;
+    MPI_Datatype get_type, acc_type;
+    long         retries;        /* cas: failed compare-and-swaps */
+} counter;
+
+static void CounterCreate( counter *, ctr_t, MPI_Comm );
+static void CounterFree( counter * );
+static int  CounterNext( counter * );
+static int  CompareInt( const void *, const void * );
+
+int main( int argc, char *argv[] )
+{
+    int      errs = 0, wrank, wsize, n, i, k, ntimes = 100;
+    int      *vals, *allvals = 0;
+    double   *lat, *alllat = 0, t, tmax;
+    long     retries;
+    ctr_t    kind;
+    counter  ctr;
+    MPI_Comm comm;
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-n" ) == 0 && i+1 < argc) {
+	    ntimes = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    if (ntimes < 1) ntimes = 1;
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &wrank );
+    MPI_Comm_size( MPI_COMM_WORLD, &wsize );
+
+    vals = (int *)malloc( ntimes * sizeof(int) );
+    lat  = (double *)malloc( ntimes * sizeof(double) );
+    if (wrank == 0) {
+	allvals = (int *)malloc( wsize * ntimes * sizeof(int) );
+	alllat  = (double *)malloc( wsize * ntimes * sizeof(double) );
+    }
+    if (!vals || !lat || (wrank == 0 && (!allvals || !alllat))) {
+	MTestError( "Unable to allocate result arrays" );
+    }
+
+    if (wrank == 0 && verbose) {
+	printf( "np\tcounter\tincr/sec\tmin(usec)\tmedian\t99%%\tmax\tretries\n" );
+    }
+
+    for (n = 1; ; n *= 2) {
+	if (n > wsize) n = wsize;
+	MPI_Comm_split( MPI_COMM_WORLD, wrank < n ? 0 : MPI_UNDEFINED, wrank,
+			&comm );
+	for (kind = CTR_CENTRAL; kind < CTR_LAST; kind++) {
+#ifndef TEST_MPI3_ROUTINES
+	    if (kind == CTR_FOP || kind == CTR_CAS) continue;
+#endif
+	    t = 0;
+	    retries = 0;
+	    if (comm != MPI_COMM_NULL) {
+		CounterCreate( &ctr, kind, comm );
+		MPI_Barrier( comm );
+		t = MPI_Wtime();
+		for (k=0; k<ntimes; k++) {
+		    lat[k]  = MPI_Wtime();
+		    vals[k] = CounterNext( &ctr );
+		    lat[k]  = MPI_Wtime() - lat[k];
+		}
+		t = MPI_Wtime() - t;
+		retries = ctr.retries;
+		CounterFree( &ctr );
+
+		MPI_Gather( vals, ntimes, MPI_INT, allvals, ntimes, MPI_INT,
+			    0, comm );
+		MPI_Gather( lat, ntimes, MPI_DOUBLE, alllat, ntimes,
+			    MPI_DOUBLE, 0, comm );
+		MPI_Reduce( &t, &tmax, 1, MPI_DOUBLE, MPI_MAX, 0, comm );
+		MPI_Reduce( wrank == 0 ? MPI_IN_PLACE : &retries, &retries,
+			    1, MPI_LONG, MPI_SUM, 0, comm );
+	    }
+
+	    if (wrank == 0) {
+		int total = n * ntimes;
+		qsort( allvals, total, sizeof(int), CompareInt );
+		for (i=0; i<total; i++) {
+		    if (allvals[i] != i) {
+			errs++;
+			printf( "%s counter with %d processes: value %d at "
+				"position %d\n", ctrName[kind], n,
+				allvals[i], i );
+			break;
+		    }
+		}
+		if (verbose) {
+		    MTestSortDouble( total, alllat );
+		    printf( "%d\t%s\t%e\t%.2f\t%.2f\t%.2f\t%.2f\t%.2f\n",
+			    n, ctrName[kind], tmax > 0 ? total / tmax : 0.0,
+			    1.e6 * alllat[0], 1.e6 * alllat[total/2],
+			    1.e6 * alllat[(99*total)/100],
+			    1.e6 * alllat[total-1],
+			    (double)retries / total );
+		    fflush( stdout );
+		}
+	    }
+	}
+	if (comm != MPI_COMM_NULL) MPI_Comm_free( &comm );
+	MPI_Barrier( MPI_COMM_WORLD );
+	if (n == wsize) break;
+    }
+
+    free( vals );
+    free( lat );
+    if (wrank == 0) {
+	free( allvals );
+	free( alllat );
+    }
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
+
+static void CounterCreate( counter *ctr, ctr_t kind, MPI_Comm comm )
+{
+    int      size = 0, i, mask, level, idx, tmp_rank, pof2;
+    int      blens[2], disps[2], *get_idx, *acc_idx;
+
+    memset( ctr, 0, sizeof(*ctr) );
+    ctr->kind     = kind;
+    ctr->get_type = MPI_DATATYPE_NULL;
+    ctr->acc_type = MPI_DATATYPE_NULL;
+    MPI_Comm_rank( comm, &ctr->rank );
+    MPI_Comm_size( comm, &ctr->nprocs );
+
+    /* Find the next power-of-two >= nprocs and the number of levels */
+    pof2 = 1;
+    ctr->nlevels = 0;
+    while (pof2 < ctr->nprocs) {
+	pof2 *= 2;
+	ctr->nlevels++;
+    }
+
+    switch (kind) {
+    case CTR_CENTRAL: size = ctr->nprocs; break;
+    case CTR_TREE:    size = 2 * pof2;    break;
+    default:          size = 1;           break;
+    }
+    if (ctr->rank == 0) {
+	MPI_Alloc_mem( size * sizeof(int), MPI_INFO_NULL, &ctr->mem );
+	for (i=0; i<size; i++) ctr->mem[i] = 0;
+	MPI_Win_create( ctr->mem, size * sizeof(int), sizeof(int),
+			MPI_INFO_NULL, comm, &ctr->win );
+    }
+    else {
+	MPI_Win_create( NULL, 0, 1, MPI_INFO_NULL, comm, &ctr->win );
+    }
+
+    if (kind == CTR_CENTRAL) {
+	/* Get every slot except our own */
+	blens[0] = ctr->rank;
+	disps[0] = 0;
+	blens[1] = ctr->nprocs - ctr->rank - 1;
+	disps[1] = ctr->rank + 1;
+	MPI_Type_indexed( 2, blens, disps, MPI_INT, &ctr->get_type );
+	MPI_Type_commit( &ctr->get_type );
+	ctr->val_array = (int *)malloc( ctr->nprocs * sizeof(int) );
+    }
+    else if (kind == CTR_TREE && ctr->nlevels > 0) {
+	get_idx = (int *)malloc( ctr->nlevels * sizeof(int) );
+	acc_idx = (int *)malloc( ctr->nlevels * sizeof(int) );
+	ctr->val_array = (int *)malloc( ctr->nlevels * sizeof(int) );
+	ctr->one       = (int *)malloc( ctr->nlevels * sizeof(int) );
+	for (i=0; i<ctr->nlevels; i++) ctr->one[i] = 1;
+
+	mask     = pof2 >> 1;
+	level    = 0;
+	idx      = 0;
+	tmp_rank = ctr->rank;
+	while (mask >= 1) {
+	    if (tmp_rank < mask) {
+		/* go to left for acc_idx, go to right for get_idx */
+		acc_idx[level] = idx + 1;
+		get_idx[level] = idx + mask*2;
+		idx            = idx + 1;
+	    }
+	    else {
+		/* go to right for acc_idx, go to left for get_idx */
+		acc_idx[level] = idx + mask*2;
+		get_idx[level] = idx + 1;
+		idx            = idx + mask*2;
+	    }
+	    level++;
+	    tmp_rank = tmp_rank % mask;
+	    mask >>= 1;
+	}
+	MPI_Type_create_indexed_block( ctr->nlevels, 1, get_idx, MPI_INT,
+				       &ctr->get_type );
+	MPI_Type_create_indexed_block( ctr->nlevels, 1, acc_idx, MPI_INT,
+				       &ctr->acc_type );
+	MPI_Type_commit( &ctr->get_type );
+	MPI_Type_commit( &ctr->acc_type );
+	free( get_idx );
+	free( acc_idx );
+    }
+}
+
+static void CounterFree( counter *ctr )
+{
+    MPI_Win_free( &ctr->win );
+    if (ctr->mem) MPI_Free_mem( ctr->mem );
+    if (ctr->get_type != MPI_DATATYPE_NULL) MPI_Type_free( &ctr->get_type );
+    if (ctr->acc_type != MPI_DATATYPE_NULL) MPI_Type_free( &ctr->acc_type );
+    if (ctr->val_array) free( ctr->val_array );
+    if (ctr->one) free( ctr->one );
+}
+
+/* Return the next value of the counter */
+static int CounterNext( counter *ctr )
+{
+    int one = 1, value = 0, i;
+
+    switch (ctr->kind) {
+    case CTR_CENTRAL:
+	MPI_Win_lock( MPI_LOCK_EXCLUSIVE, 0, 0, ctr->win );
+	MPI_Accumulate( &one, 1, MPI_INT, 0, ctr->rank, 1, MPI_INT,
+			MPI_SUM, ctr->win );
+	if (ctr->nprocs > 1) {
+	    MPI_Get( ctr->val_array, 1, ctr->get_type, 0, 0, 1,
+		     ctr->get_type, ctr->win );
+	}
+	MPI_Win_unlock( 0, ctr->win );
+	ctr->val_array[ctr->rank] = ctr->localvalue;
+	for (i=0; i<ctr->nprocs; i++) value += ctr->val_array[i];
+	ctr->localvalue++;
+	break;
+
+    case CTR_TREE:
+	if (ctr->nlevels > 0) {
+	    MPI_Win_lock( MPI_LOCK_EXCLUSIVE, 0, 0, ctr->win );
+	    MPI_Accumulate( ctr->one, ctr->nlevels, MPI_INT, 0, 0, 1,
+			    ctr->acc_type, MPI_SUM, ctr->win );
+	    MPI_Get( ctr->val_array, ctr->nlevels, MPI_INT, 0, 0, 1,
+		     ctr->get_type, ctr->win );
+	    MPI_Win_unlock( 0, ctr->win );
+	}
+	value = ctr->localvalue;
+	for (i=0; i<ctr->nlevels; i++) value += ctr->val_array[i];
+	ctr->localvalue++;
+	break;
+
+#ifdef TEST_MPI3_ROUTINES
+    case CTR_FOP:
+	MPI_Win_lock( MPI_LOCK_SHARED, 0, 0, ctr->win );
+	MPI_Fetch_and_op( &one, &value, MPI_INT, 0, 0, MPI_SUM, ctr->win );
+	MPI_Win_unlock( 0, ctr->win );
+	break;
+
+    case CTR_CAS:
+    {
+	int old, next, result;
+	MPI_Win_lock( MPI_LOCK_SHARED, 0, 0, ctr->win );
+	MPI_Fetch_and_op( NULL, &old, MPI_INT, 0, 0, MPI_NO_OP, ctr->win );
+	MPI_Win_unlock( 0, ctr->win );
+	while (1) {
+	    next = old + 1;
+	    MPI_Win_lock( MPI_LOCK_SHARED, 0, 0, ctr->win );
+	    MPI_Compare_and_swap( &next, &old, &result, MPI_INT, 0, 0,
+				  ctr->win );
+	    MPI_Win_unlock( 0, ctr->win );
+	    if (result == old) break;
+	    ctr->retries++;
+	    old = result;
+	}
+	value = old;
+    }
+	break;
+#endif
+
+    default:
+	MTestError( "Unknown counter kind" );
+    }
+    return value;
+}
+
+static int CompareInt( const void *a, const void *b )
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x < y) ? -1 : (x > y);
+}
@@ -0,0 +1,288 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Latency and fairness of passive-target locks under contention.  The
+ * lockcontention tests in rma/ check that many processes locking one
+ * target get correct results; this program measures what the contention
+ * costs.  Rank 0 owns a counter; 1, 2, 4, ... and finally all of the
+ * other processes (the contenders) repeatedly run short access epochs on
+ * it for a fixed time:
+ *
+ *   excl     - MPI_Win_lock(EXCLUSIVE), get and put the counter (a
+ *              read-modify-write that is only safe under the exclusive
+ *              lock), MPI_Win_unlock
+ *   shared   - MPI_Win_lock(SHARED), accumulate 1, MPI_Win_unlock
+ *   lockall  - one MPI_Win_lock_all for the whole run; each "epoch" is an
+ *              accumulate followed by MPI_Win_flush (MPI-3 only)
+ *
+ * Each contender records the latency of every epoch and the number of
+ * epochs it completed.  Rank 0 reports the aggregate epoch rate, the
+ * median, 99th percentile and maximum latency over all contenders, the
+ * worst per-contender maximum, and two fairness measures over the epoch
+ * counts: Jain's index (sum x)^2 / (n sum x^2), which is 1 when every
+ * contender got the same share, and the ratio of the smallest to the
+ * largest count, which approaches 0 when a contender starves.  Since the
+ * MPI implementation may defer acquiring the lock until the unlock, the
+ * latency of a whole epoch is measured rather than of MPI_Win_lock alone.
+ *
+ * The final value of the counter must equal the total number of epochs;
+ * a lost update under the exclusive lock indicates a locking error.
+ * Results are printed when MPITEST_VERBOSE is set.
+ *
+ * Options:
+ *   -time <sec>   duration of each case (default 0.05)
+ *   -perorigin    also print each contender's count and latencies
+ */
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitest.h"
+
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+#  define TEST_MPI3_ROUTINES 1
+#elif !defined(USE_STRICT_MPI) && defined(MPICH2)
+#  define TEST_MPI3_ROUTINES 1
+#  define MPI_Win_lock_all   MPIX_Win_lock_all
+#  define MPI_Win_unlock_all MPIX_Win_unlock_all
+#  define MPI_Win_flush      MPIX_Win_flush
+#endif
+
+#define MAX_SAMPLES 20000
+
+typedef enum { LOCK_EXCL = 0, LOCK_SHARED = 1, LOCK_ALL = 2 } lockkind_t;
+static const char *kindName[3] = { "excl", "shared", "lockall" };
+
+/* Per-contender summary gathered at rank 0 */
+typedef struct {
+    double count, median, p99, max;
+} originstat_t;
+
+static int    verbose = 0, perorigin = 0;
+static double *samples;
+
+static int  RunCase( MPI_Win win, int *counter, lockkind_t kind,
+		     int ncontend, double duration );
+
+int main( int argc, char *argv[] )
+{
+    int      errs = 0, i, rank, size, ncontend, maxcontend, *counter;
+    double   duration = 0.05;
+    MPI_Win  win;
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-time" ) == 0 && i+1 < argc) {
+	    duration = atof( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-perorigin" ) == 0) {
+	    perorigin = 1;
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+
+    samples = (double *)malloc( MAX_SAMPLES * sizeof(double) );
+    if (!samples) {
+	MTestError( "Unable to allocate sample array" );
+    }
+    MPI_Alloc_mem( sizeof(int), MPI_INFO_NULL, &counter );
+    *counter = 0;
+    MPI_Win_create( counter, sizeof(int), sizeof(int), MPI_INFO_NULL,
+		    MPI_COMM_WORLD, &win );
+
+    if (rank == 0 && verbose) {
+	printf( "kind\tprocs\tepochs/sec\tmedian(usec)\t99%%(usec)\t"
+		"max(usec)\tworst max\tJain\tmin/max\n" );
+    }
+
+    /* With a single process, rank 0 contends with itself.  The last case
+       always has every other process contending */
+    maxcontend = (size > 1) ? size - 1 : 1;
+    for (ncontend = 1; ; ncontend = (2 * ncontend < maxcontend) ?
+	     2 * ncontend : maxcontend) {
+	errs += RunCase( win, counter, LOCK_EXCL, ncontend, duration );
+	errs += RunCase( win, counter, LOCK_SHARED, ncontend, duration );
+#ifdef TEST_MPI3_ROUTINES
+	errs += RunCase( win, counter, LOCK_ALL, ncontend, duration );
+#endif
+	if (ncontend == maxcontend) break;
+    }
+
+    MPI_Win_free( &win );
+    MPI_Free_mem( counter );
+    free( samples );
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
+
+/*
+ * Run one kind of epoch with ncontend contenders for duration seconds and
+ * report the results at rank 0.
+ */
+static int RunCase( MPI_Win win, int *counter, lockkind_t kind,
+		    int ncontend, double duration )
+{
+    int    errs = 0, rank, size, first, isContender, i, val, one = 1;
+    int    nsamples = 0, nepochs = 0, total, final;
+    double t, tend, telapsed = 0, rate, jain, sum, sumsq, cmin, cmax;
+    double wmax, *all = NULL;
+    originstat_t mystat, *stats = NULL;
+    MPI_Comm comm = MPI_COMM_WORLD;
+
+    MPI_Comm_rank( comm, &rank );
+    MPI_Comm_size( comm, &size );
+    first       = (size > 1) ? 1 : 0;
+    isContender = (rank >= first && rank < first + ncontend);
+
+    /* Reset the counter */
+    MPI_Win_lock( MPI_LOCK_EXCLUSIVE, rank, 0, win );
+    *counter = 0;
+    MPI_Win_unlock( rank, win );
+    MPI_Barrier( comm );
+
+    if (isContender) {
+#ifdef TEST_MPI3_ROUTINES
+	if (kind == LOCK_ALL) MPI_Win_lock_all( 0, win );
+#endif
+	telapsed = MPI_Wtime();
+	tend     = telapsed + duration;
+	while ((t = MPI_Wtime()) < tend) {
+	    switch (kind) {
+	    case LOCK_EXCL:
+		MPI_Win_lock( MPI_LOCK_EXCLUSIVE, 0, 0, win );
+#ifdef TEST_MPI3_ROUTINES
+		/* Read-modify-write; correct only if the lock excludes
+		   the other contenders */
+		MPI_Get( &val, 1, MPI_INT, 0, 0, 1, MPI_INT, win );
+		MPI_Win_flush( 0, win );
+		val++;
+		MPI_Put( &val, 1, MPI_INT, 0, 0, 1, MPI_INT, win );
+#else
+		MPI_Accumulate( &one, 1, MPI_INT, 0, 0, 1, MPI_INT, MPI_SUM,
+				win );
+#endif
+		MPI_Win_unlock( 0, win );
+		break;
+	    case LOCK_SHARED:
+		MPI_Win_lock( MPI_LOCK_SHARED, 0, 0, win );
+		MPI_Accumulate( &one, 1, MPI_INT, 0, 0, 1, MPI_INT, MPI_SUM,
+				win );
+		MPI_Win_unlock( 0, win );
+		break;
+	    case LOCK_ALL:
+#ifdef TEST_MPI3_ROUTINES
+		MPI_Accumulate( &one, 1, MPI_INT, 0, 0, 1, MPI_INT, MPI_SUM,
+				win );
+		MPI_Win_flush( 0, win );
+#endif
+		break;
+	    }
+	    if (nsamples < MAX_SAMPLES) samples[nsamples++] = MPI_Wtime() - t;
+	    nepochs++;
+	}
+	telapsed = MPI_Wtime() - telapsed;
+#ifdef TEST_MPI3_ROUTINES
+	if (kind == LOCK_ALL) MPI_Win_unlock_all( win );
+#endif
+    }
+
+    /* Per-contender summary */
+    mystat.count = nepochs;
+    mystat.median = mystat.p99 = mystat.max = 0;
+    if (nsamples > 0) {
+	MTestSortDouble( nsamples, samples );
+	mystat.median = samples[nsamples/2];
+	mystat.p99    = samples[(99*nsamples)/100];
+	mystat.max    = samples[nsamples-1];
+    }
+
+    /* The distribution over all contenders needs all of the samples;
+       gather them (up to MAX_SAMPLES each) to rank 0 */
+    if (rank == 0) {
+	stats = (originstat_t *)malloc( size * sizeof(originstat_t) );
+	all   = (double *)malloc( (size_t)ncontend * MAX_SAMPLES *
+				  sizeof(double) );
+	if (!stats || !all) {
+	    MTestError( "Unable to allocate result arrays" );
+	}
+    }
+    MPI_Gather( &mystat, 4, MPI_DOUBLE, stats, 4, MPI_DOUBLE, 0, comm );
+    MPI_Reduce( rank == 0 ? MPI_IN_PLACE : &telapsed, &telapsed, 1,
+		MPI_DOUBLE, MPI_MAX, 0, comm );
+    MPI_Reduce( &nepochs, &total, 1, MPI_INT, MPI_SUM, 0, comm );
+    if (rank == 0) {
+	int n = 0;
+	MPI_Status status;
+
+	if (isContender) {
+	    memcpy( all, samples, nsamples * sizeof(double) );
+	    n = nsamples;
+	}
+	for (i=first; i<first+ncontend; i++) {
+	    int cnt;
+	    if (i == rank) continue;
+	    MPI_Recv( all + n, MAX_SAMPLES, MPI_DOUBLE, i, 0, comm, &status );
+	    MPI_Get_count( &status, MPI_DOUBLE, &cnt );
+	    n += cnt;
+	}
+
+	/* Every epoch added one to the counter */
+	MPI_Win_lock( MPI_LOCK_SHARED, 0, 0, win );
+	MPI_Get( &final, 1, MPI_INT, 0, 0, 1, MPI_INT, win );
+	MPI_Win_unlock( 0, win );
+	if (final != total) {
+	    errs++;
+	    printf( "%s with %d contenders: counter is %d, expected %d\n",
+		    kindName[kind], ncontend, final, total );
+	}
+
+	sum = sumsq = 0;
+	cmin = cmax = stats[first].count;
+	wmax = 0;
+	for (i=first; i<first+ncontend; i++) {
+	    sum   += stats[i].count;
+	    sumsq += stats[i].count * stats[i].count;
+	    if (stats[i].count < cmin) cmin = stats[i].count;
+	    if (stats[i].count > cmax) cmax = stats[i].count;
+	    if (stats[i].max > wmax) wmax = stats[i].max;
+	}
+	jain = (sumsq > 0) ? (sum * sum) / (ncontend * sumsq) : 0;
+	rate = (telapsed > 0) ? total / telapsed : 0;
+	MTestSortDouble( n, all );
+	if (verbose && n > 0) {
+	    printf( "%s\t%d\t%e\t%10.2f\t%10.2f\t%10.2f\t%10.2f\t%.3f\t%.3f\n",
+		    kindName[kind], ncontend, rate, 1.e6 * all[n/2],
+		    1.e6 * all[(99*n)/100], 1.e6 * all[n-1], 1.e6 * wmax,
+		    jain, (cmax > 0) ? cmin / cmax : 0.0 );
+	    if (perorigin) {
+		for (i=first; i<first+ncontend; i++) {
+		    printf( "\trank %d\t%.0f epochs\t%10.2f\t%10.2f\t%10.2f\n",
+			    i, stats[i].count, 1.e6 * stats[i].median,
+			    1.e6 * stats[i].p99, 1.e6 * stats[i].max );
+		}
+	    }
+	    fflush( stdout );
+	}
+	free( stats );
+	free( all );
+    }
+    else if (isContender) {
+	MPI_Send( samples, nsamples, MPI_DOUBLE, 0, 0, comm );
+    }
+    MPI_Barrier( comm );
+    return errs;
+}
@@ -0,0 +1,338 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Sensitivity of the rooted collectives (Bcast, Reduce, Gather, Gatherv,
+ * Scatter and Scatterv) to the choice of root and to skew in the times at
+ * which the processes arrive.  non_zero_root compares two roots of Gather;
+ * this test tries every root (or -maxroots of them, evenly spaced, on
+ * larger jobs) of each collective.
+ *
+ * For each root, the time from a barrier until the last process leaves the
+ * collective is measured with each process first waiting for
+ *
+ *   none     - no delay
+ *   rootlate - the root waits -skew microseconds
+ *   leaflate - the process just before the root waits -skew microseconds
+ *   random   - every process waits a random time up to -skew microseconds
+ *
+ * and the longest delay is subtracted, giving the latency after the last
+ * arrival (the median over -reps repetitions).  An algorithm that does
+ * useful work while waiting for the late process has a smaller latency
+ * after the last arrival than with no skew; the difference is reported as
+ * the skew it absorbs.  The spread of the unskewed latency across roots
+ * and the slowest root are reported for each collective.
+ *
+ * The delays are busy waits, so the skewed results are only meaningful
+ * with one process per core.  The data is checked once for each
+ * collective and root.
+ *
+ * Options:
+ *   -bytes <n>     bytes contributed by each process (default 65536)
+ *   -skew <us>     delay in microseconds (default 100)
+ *   -reps <n>      repetitions of each measurement (default 20)
+ *   -maxroots <n>  largest number of roots to try (default 16)
+ */
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitest.h"
+
+static int verbose = 0;
+
+typedef enum { COLL_BCAST, COLL_REDUCE, COLL_GATHER, COLL_GATHERV,
+	       COLL_SCATTER, COLL_SCATTERV, NCOLL } coll_t;
+static const char *collName[NCOLL] = { "Bcast", "Reduce", "Gather", "Gatherv",
+				       "Scatter", "Scatterv" };
+
+typedef enum { SKEW_NONE, SKEW_ROOT, SKEW_LEAF, SKEW_RANDOM, NSKEW } skew_t;
+static const char *skewName[NSKEW] = { "none", "rootlate", "leaflate",
+				       "random" };
+
+static int rank, size, count;
+static int *sbuf, *rbuf, *counts, *displs;
+
+/* The delay of process r; every process can compute the delay of every
+   other, so that the longest delay is known without communication */
+static double Delay( skew_t skew, int r, int root, int rep, double maxdelay )
+{
+    unsigned int seed;
+
+    switch (skew) {
+    case SKEW_ROOT:
+	return (r == root) ? maxdelay : 0.0;
+    case SKEW_LEAF:
+	return (r == (root + size - 1) % size) ? maxdelay : 0.0;
+    case SKEW_RANDOM:
+	seed = (unsigned int)(rep * 7919 + r * 104729 + root * 15485863);
+	seed = seed * 1103515245 + 12345;
+	seed = seed * 1103515245 + 12345;
+	return maxdelay * ((seed >> 8) & 0xffff) / 65535.0;
+    default:
+	return 0.0;
+    }
+}
+
+static void RunColl( coll_t coll, int root )
+{
+    switch (coll) {
+    case COLL_BCAST:
+	MPI_Bcast( sbuf, count, MPI_INT, root, MPI_COMM_WORLD );
+	break;
+    case COLL_REDUCE:
+	MPI_Reduce( sbuf, rbuf, count, MPI_INT, MPI_SUM, root, MPI_COMM_WORLD );
+	break;
+    case COLL_GATHER:
+	MPI_Gather( sbuf, count, MPI_INT, rbuf, count, MPI_INT, root,
+		    MPI_COMM_WORLD );
+	break;
+    case COLL_GATHERV:
+	MPI_Gatherv( sbuf, counts[rank], MPI_INT, rbuf, counts, displs,
+		     MPI_INT, root, MPI_COMM_WORLD );
+	break;
+    case COLL_SCATTER:
+	MPI_Scatter( sbuf, count, MPI_INT, rbuf, count, MPI_INT, root,
+		     MPI_COMM_WORLD );
+	break;
+    case COLL_SCATTERV:
+	MPI_Scatterv( sbuf, counts, displs, MPI_INT, rbuf, counts[rank],
+		      MPI_INT, root, MPI_COMM_WORLD );
+	break;
+    default:
+	break;
+    }
+}
+
+/* Run the collective once with known data and check the result */
+static int CheckColl( coll_t coll, int root )
+{
+    int i, j, errs = 0, n = 0, *expect = 0, *got = rbuf;
+
+    /* The scatters send from the root's part of the send buffer, which
+       holds size * count values */
+    if (coll == COLL_SCATTER || coll == COLL_SCATTERV) {
+	for (i=0; i<size*count; i++) sbuf[i] = (rank == root) ? i : -1;
+    }
+    else {
+	for (i=0; i<count; i++) sbuf[i] = rank * count + i;
+    }
+    for (i=0; i<size*count; i++) rbuf[i] = -1;
+
+    RunColl( coll, root );
+
+    expect = (int *)malloc( size * count * sizeof(int) );
+    if (!expect) {
+	MTestError( "Unable to allocate check buffer" );
+    }
+    switch (coll) {
+    case COLL_BCAST:
+	n   = count;
+	got = sbuf;
+	for (i=0; i<n; i++) expect[i] = root * count + i;
+	break;
+    case COLL_REDUCE:
+	if (rank == root) {
+	    n = count;
+	    for (i=0; i<n; i++)
+		expect[i] = count * (size * (size - 1) / 2) + size * i;
+	}
+	break;
+    case COLL_GATHER:
+	if (rank == root) {
+	    n = size * count;
+	    for (i=0; i<n; i++) expect[i] = i;
+	}
+	break;
+    case COLL_GATHERV:
+	if (rank == root) {
+	    for (j=0; j<size; j++) {
+		for (i=0; i<counts[j]; i++) expect[displs[j] + i] = j * count + i;
+	    }
+	    n = displs[size-1] + counts[size-1];
+	}
+	break;
+    case COLL_SCATTER:
+	n = count;
+	for (i=0; i<n; i++) expect[i] = rank * count + i;
+	break;
+    case COLL_SCATTERV:
+	n = counts[rank];
+	for (i=0; i<n; i++) expect[i] = displs[rank] + i;
+	break;
+    default:
+	break;
+    }
+    for (i=0; i<n; i++) {
+	if (got[i] != expect[i]) {
+	    errs++;
+	    if (errs < 10) {
+		fprintf( stderr, "%s root %d: [%d] = %d, expected %d on %d\n",
+			 collName[coll], root, i, got[i], expect[i], rank );
+	    }
+	}
+    }
+    free( expect );
+    return errs;
+}
+
+int main( int argc, char *argv[] )
+{
+    int    errs = 0, i, r, rep, root, nroots, maxroots = 16, bytes = 65536;
+    int    reps = 20, slowRoot;
+    int    *roots;
+    coll_t coll;
+    skew_t skew;
+    double skewus = 100.0, maxdelay, mydelay, longest, t;
+    double *elapsed, *maxElapsed, *lat, tmin, tmax, absorbed;
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-bytes" ) == 0 && i+1 < argc) {
+	    bytes = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-skew" ) == 0 && i+1 < argc) {
+	    skewus = atof( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-reps" ) == 0 && i+1 < argc) {
+	    reps = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-maxroots" ) == 0 && i+1 < argc) {
+	    maxroots = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+    maxdelay = 1.e-6 * skewus;
+    count    = bytes / sizeof(int);
+    if (count < 1) count = 1;
+    if (reps < 1) reps = 1;
+    if (maxroots < 1) maxroots = 1;
+
+    sbuf       = (int *)malloc( size * count * sizeof(int) );
+    rbuf       = (int *)malloc( size * count * sizeof(int) );
+    counts     = (int *)malloc( size * sizeof(int) );
+    displs     = (int *)malloc( size * sizeof(int) );
+    roots      = (int *)malloc( size * sizeof(int) );
+    elapsed    = (double *)malloc( reps * sizeof(double) );
+    maxElapsed = (double *)malloc( reps * sizeof(double) );
+    lat        = (double *)malloc( size * NSKEW * sizeof(double) );
+    if (!sbuf || !rbuf || !counts || !displs || !roots || !elapsed ||
+	!maxElapsed || !lat) {
+	MTestError( "Unable to allocate buffers" );
+    }
+    /* Alternate full and half counts in the v-variants, packed together */
+    for (i=0; i<size; i++) {
+	counts[i] = (i % 2 == 0) ? count : (count + 1) / 2;
+	displs[i] = (i == 0) ? 0 : displs[i-1] + counts[i-1];
+    }
+
+    /* Every root, or an evenly spaced sample that includes the first and
+       last */
+    if (size <= maxroots) {
+	nroots = size;
+	for (i=0; i<size; i++) roots[i] = i;
+    }
+    else {
+	nroots = maxroots;
+	for (i=0; i<nroots; i++) {
+	    roots[i] = (nroots == 1) ? 0 :
+		(int)((double)i * (size - 1) / (nroots - 1) + 0.5);
+	}
+    }
+
+    for (coll = COLL_BCAST; coll < NCOLL; coll++) {
+	if (rank == 0 && verbose) {
+	    printf( "%s, %d bytes per process, skew %.1f us\n",
+		    collName[coll], bytes, skewus );
+	    printf( "%6s", "root" );
+	    for (skew = SKEW_NONE; skew < NSKEW; skew++)
+		printf( "%12s", skewName[skew] );
+	    printf( "   (us after the last arrival)\n" );
+	}
+	for (r=0; r<nroots; r++) {
+	    root = roots[r];
+	    errs += CheckColl( coll, root );
+	    for (skew = SKEW_NONE; skew < NSKEW; skew++) {
+		/* Warm up */
+		MPI_Barrier( MPI_COMM_WORLD );
+		RunColl( coll, root );
+		for (rep=0; rep<reps; rep++) {
+		    mydelay = Delay( skew, rank, root, rep, maxdelay );
+		    MPI_Barrier( MPI_COMM_WORLD );
+		    t = MPI_Wtime();
+		    if (mydelay > 0) MTestSpin( mydelay );
+		    RunColl( coll, root );
+		    elapsed[rep] = MPI_Wtime() - t;
+		}
+		MPI_Reduce( elapsed, maxElapsed, reps, MPI_DOUBLE, MPI_MAX, 0,
+			    MPI_COMM_WORLD );
+		if (rank == 0) {
+		    for (rep=0; rep<reps; rep++) {
+			longest = 0.0;
+			for (i=0; i<size; i++) {
+			    t = Delay( skew, i, root, rep, maxdelay );
+			    if (t > longest) longest = t;
+			}
+			maxElapsed[rep] -= longest;
+		    }
+		    lat[r * NSKEW + skew] = MTestMedian( reps, maxElapsed );
+		}
+	    }
+	    if (rank == 0 && verbose) {
+		printf( "%6d", root );
+		for (skew = SKEW_NONE; skew < NSKEW; skew++)
+		    printf( "%12.1f", 1.e6 * lat[r * NSKEW + skew] );
+		printf( "\n" );
+	    }
+	}
+
+	if (rank == 0 && verbose) {
+	    tmin = tmax = lat[SKEW_NONE];
+	    slowRoot = roots[0];
+	    for (r=1; r<nroots; r++) {
+		t = lat[r * NSKEW + SKEW_NONE];
+		if (t < tmin) tmin = t;
+		if (t > tmax) { tmax = t; slowRoot = roots[r]; }
+	    }
+	    printf( "%s: root spread %.1f - %.1f us (%.2fx), slowest root %d\n",
+		    collName[coll], 1.e6 * tmin, 1.e6 * tmax,
+		    (tmin > 0) ? tmax / tmin : 0.0, slowRoot );
+	    /* Skew absorbed: the reduction in latency after the last arrival
+	       compared with no skew, averaged over the roots.  Negative values
+	       mean that the skew was amplified */
+	    printf( "%s: skew absorbed", collName[coll] );
+	    for (skew = SKEW_ROOT; skew < NSKEW; skew++) {
+		absorbed = 0.0;
+		for (r=0; r<nroots; r++)
+		    absorbed += lat[r * NSKEW + SKEW_NONE] - lat[r * NSKEW + skew];
+		printf( " %s %.1f us", skewName[skew], 1.e6 * absorbed / nroots );
+	    }
+	    printf( "\n" );
+	    fflush( stdout );
+	}
+    }
+
+    free( sbuf );
+    free( rbuf );
+    free( counts );
+    free( displs );
+    free( roots );
+    free( elapsed );
+    free( maxElapsed );
+    free( lat );
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,295 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Latency of the prefix reductions MPI_Scan and MPI_Exscan, and (with
+ * MPI-3) MPI_Iscan and MPI_Iexscan completed with MPI_Wait, on the first
+ * p processes of MPI_COMM_WORLD for p = 2, 4, ..., size and message sizes
+ * from 8 bytes to -maxbytes.  Two ops are used:
+ *
+ *   sum     - MPI_SUM on MPI_INT
+ *   affine  - a user-defined, non-commutative op on pairs of unsigned
+ *             ints (a, b), each standing for x -> a*x + b, that composes
+ *             the maps in rank order
+ *
+ * The time is the average over -reps calls, and the maximum over the
+ * processes.  A prefix reduction can be done in O(log p) steps; one done
+ * as a chain through the processes takes O(p).  At the end, for the
+ * smallest message, the ratio of the times for the largest and smallest
+ * p is compared with the ratios of log2(p) and of p, and the closer of
+ * the two is reported (this needs a range of p of 8 or more to say much).
+ * The results are checked once for each case.
+ *
+ * Options:
+ *   -maxbytes <n>  largest message in bytes (default 65536)
+ *   -reps <n>      calls per measurement (default 100)
+ */
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitest.h"
+
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+#define TEST_NBC_ROUTINES 1
+#endif
+
+static int verbose = 0;
+
+typedef enum { COLL_SCAN, COLL_EXSCAN, COLL_ISCAN, COLL_IEXSCAN,
+	       NCOLL } coll_t;
+static const char *collName[NCOLL] = { "Scan", "Exscan", "Iscan",
+				       "Iexscan" };
+
+typedef enum { OP_SUM, OP_AFFINE, NOP } op_t;
+static const char *opName[NOP] = { "sum", "affine" };
+
+#define MAX_NP 32
+
+/* log2 of n, interpolating linearly between powers of two (the tests
+   do not link with the math library) */
+static double Log2( int n )
+{
+    double l = 0, v = n;
+
+    while (v >= 2) {
+	v /= 2;
+	l++;
+    }
+    return l + (v - 1);
+}
+
+/* x -> a*x + b; the op applies the map of the lower rank (in) first */
+void affine( void *invec, void *inoutvec, int *len, MPI_Datatype *dtype );
+void affine( void *invec, void *inoutvec, int *len, MPI_Datatype *dtype )
+{
+    const unsigned int *in = (const unsigned int *)invec;
+    unsigned int       *inout = (unsigned int *)inoutvec;
+    int                i, n = *len;
+
+    for (i=0; i<n; i++) {
+	inout[2*i+1] = inout[2*i] * in[2*i+1] + inout[2*i+1];
+	inout[2*i]   = inout[2*i] * in[2*i];
+    }
+}
+
+static void InitBuf( op_t op, void *buf, int count, int rank )
+{
+    int          *ibuf = (int *)buf;
+    unsigned int *ubuf = (unsigned int *)buf;
+    int          j;
+
+    for (j=0; j<count; j++) {
+	if (op == OP_SUM) {
+	    ibuf[j] = rank + j;
+	}
+	else {
+	    ubuf[2*j]   = 2 * (unsigned int)(rank + j) + 1;
+	    ubuf[2*j+1] = (unsigned int)(rank + j);
+	}
+    }
+}
+
+/* Check the result on process rank; return the number of errors */
+static int CheckBuf( coll_t coll, op_t op, void *buf, int count, int rank )
+{
+    int          *ibuf = (int *)buf;
+    unsigned int *ubuf = (unsigned int *)buf;
+    unsigned int a, b, ai;
+    int          errs = 0, j, i, last, ok;
+
+    /* The result covers ranks 0..last */
+    last = (coll == COLL_SCAN || coll == COLL_ISCAN) ? rank : rank - 1;
+    if (last < 0) return 0;
+
+    for (j=0; j<count; j++) {
+	if (op == OP_SUM) {
+	    ok = (ibuf[j] == last * (last + 1) / 2 + (last + 1) * j);
+	}
+	else {
+	    a = 1;
+	    b = 0;
+	    for (i=0; i<=last; i++) {
+		ai = 2 * (unsigned int)(i + j) + 1;
+		b  = ai * b + (unsigned int)(i + j);
+		a  = ai * a;
+	    }
+	    ok = (ubuf[2*j] == a && ubuf[2*j+1] == b);
+	}
+	if (!ok) {
+	    errs++;
+	    if (errs < 10) {
+		printf( "[%d] %s with %s: wrong value at %d\n", rank,
+			collName[coll], opName[op], j );
+	    }
+	}
+    }
+    return errs;
+}
+
+static void RunColl( coll_t coll, void *sbuf, void *rbuf, int count,
+		     MPI_Datatype type, MPI_Op op, MPI_Comm comm )
+{
+#ifdef TEST_NBC_ROUTINES
+    MPI_Request req;
+#endif
+
+    switch (coll) {
+    case COLL_SCAN:
+	MPI_Scan( sbuf, rbuf, count, type, op, comm );
+	break;
+    case COLL_EXSCAN:
+	MPI_Exscan( sbuf, rbuf, count, type, op, comm );
+	break;
+#ifdef TEST_NBC_ROUTINES
+    case COLL_ISCAN:
+	MPI_Iscan( sbuf, rbuf, count, type, op, comm, &req );
+	MPI_Wait( &req, MPI_STATUS_IGNORE );
+	break;
+    case COLL_IEXSCAN:
+	MPI_Iexscan( sbuf, rbuf, count, type, op, comm, &req );
+	MPI_Wait( &req, MPI_STATUS_IGNORE );
+	break;
+#endif
+    default:
+	break;
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    int          errs = 0, i, r, rank, size, p, np = 0, bytes, count;
+    int          maxbytes = 65536, reps = 100, ncoll = 2, psize[MAX_NP];
+    coll_t       coll;
+    op_t         op;
+    double       t, tmax, tsmall[NCOLL][NOP][MAX_NP], x, ylog, yp;
+    void         *sbuf, *rbuf;
+    MPI_Datatype pairtype, types[NOP];
+    MPI_Op       affineOp, ops[NOP];
+    MPI_Comm     comm;
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-maxbytes" ) == 0 && i+1 < argc) {
+	    maxbytes = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-reps" ) == 0 && i+1 < argc) {
+	    reps = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    if (maxbytes < 8) maxbytes = 8;
+    if (reps < 1) reps = 1;
+#ifdef TEST_NBC_ROUTINES
+    ncoll = NCOLL;
+#endif
+
+    MPI_Type_contiguous( 2, MPI_UNSIGNED, &pairtype );
+    MPI_Type_commit( &pairtype );
+    MPI_Op_create( affine, 0, &affineOp );
+    types[OP_SUM]    = MPI_INT;
+    types[OP_AFFINE] = pairtype;
+    ops[OP_SUM]      = MPI_SUM;
+    ops[OP_AFFINE]   = affineOp;
+
+    sbuf = malloc( maxbytes );
+    rbuf = malloc( maxbytes );
+    if (!sbuf || !rbuf) {
+	MTestError( "Unable to allocate buffers" );
+    }
+
+    if (rank == 0 && verbose) {
+	printf( "Time in us (average over %d calls, max over processes)\n",
+		reps );
+	printf( "%6s %-8s %-7s %8s %12s\n", "p", "coll", "op", "bytes",
+		"time" );
+    }
+
+    p = (size > 1) ? 2 : 1;
+    while (np < MAX_NP) {
+	psize[np] = p;
+	MPI_Comm_split( MPI_COMM_WORLD, rank < p ? 0 : MPI_UNDEFINED, rank,
+			&comm );
+	if (comm != MPI_COMM_NULL) {
+	    for (coll = COLL_SCAN; coll < ncoll; coll++) {
+		for (op = OP_SUM; op < NOP; op++) {
+		    for (bytes = 8; ; bytes = (8 * bytes < maxbytes) ?
+			     8 * bytes : maxbytes) {
+			/* The sum is on ints and the affine op on pairs */
+			count = bytes / ((op == OP_SUM) ? 4 : 8);
+
+			InitBuf( op, sbuf, count, rank );
+			RunColl( coll, sbuf, rbuf, count, types[op], ops[op],
+				 comm );
+			errs += CheckBuf( coll, op, rbuf, count, rank );
+
+			MPI_Barrier( comm );
+			t = MPI_Wtime();
+			for (r=0; r<reps; r++) {
+			    RunColl( coll, sbuf, rbuf, count, types[op],
+				     ops[op], comm );
+			}
+			t = (MPI_Wtime() - t) / reps;
+			MPI_Reduce( &t, &tmax, 1, MPI_DOUBLE, MPI_MAX, 0,
+				    comm );
+			if (bytes == 8) tsmall[coll][op][np] = tmax;
+			if (rank == 0 && verbose) {
+			    printf( "%6d %-8s %-7s %8d %12.2f\n", p,
+				    collName[coll], opName[op], bytes,
+				    1.e6 * tmax );
+			    fflush( stdout );
+			}
+			if (bytes == maxbytes) break;
+		    }
+		}
+	    }
+	    MPI_Comm_free( &comm );
+	}
+	MPI_Barrier( MPI_COMM_WORLD );
+	np++;
+	if (p == size) break;
+	p = (2 * p < size) ? 2 * p : size;
+    }
+
+    /* Growth with p for the smallest message */
+    if (rank == 0 && verbose && np > 1) {
+	printf( "\nGrowth from p=%d to p=%d for 8 bytes\n", psize[0],
+		psize[np-1] );
+	printf( "%-8s %-7s %10s %10s %10s %10s\n", "coll", "op", "time",
+		"log2 p", "p", "closer to" );
+	ylog = Log2( psize[np-1] ) / Log2( psize[0] );
+	yp   = (double)psize[np-1] / psize[0];
+	/* x is closer to ylog than to yp, as ratios, if x < sqrt(ylog*yp) */
+	for (coll = COLL_SCAN; coll < ncoll; coll++) {
+	    for (op = OP_SUM; op < NOP; op++) {
+		x = tsmall[coll][op][np-1] / tsmall[coll][op][0];
+		printf( "%-8s %-7s %10.2f %10.2f %10.2f %10s\n",
+			collName[coll], opName[op], x, ylog, yp,
+			(ylog == yp) ? "-" :
+			(x * x <= ylog * yp) ? "log p" : "p" );
+	    }
+	}
+	fflush( stdout );
+    }
+
+    free( sbuf );
+    free( rbuf );
+    MPI_Op_free( &affineOp );
+    MPI_Type_free( &pairtype );
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,299 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Tolerance of the collectives to imbalance in the times at which the
+ * processes arrive.  The tests in coll start each collective just after a
+ * barrier, which hides the cost of a late process; here each process
+ * first waits for
+ *
+ *   late    - one process (-late, default the last) waits -skew us
+ *   uniform - every process waits a random time up to -skew us
+ *   linear  - process r waits r/(size-1) * -skew us
+ *
+ * before each blocking collective and each nonblocking collective (started
+ * and then completed with MPI_Wait).  The time a process spends in the
+ * collective beyond the imbalance itself, that is, after the last process
+ * arrived, is measured (the median over -reps repetitions) and averaged
+ * and maximized over the processes.  With no skew this is the latency of
+ * the collective; the extra time with skew is the amount by which the
+ * algorithm amplifies the imbalance (negative if it absorbs some of it).
+ *
+ * A delayed process spins on MPI_Wtime (MTestSpin) rather than sleeping,
+ * so that it arrives at a known time; when several processes share a
+ * core, the spinning takes time from the others and the skewed columns
+ * say little.  The results of the collectives are left to the tests in
+ * coll.
+ *
+ * Options:
+ *   -bytes <n>  bytes per process (per destination for Alltoall; default
+ *               4096)
+ *   -skew <us>  largest delay in microseconds (default 100)
+ *   -late <r>   the process that is late in the "late" pattern
+ *   -reps <n>   repetitions of each measurement (default 20)
+ */
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "mpitest.h"
+
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+#define TEST_NBC_ROUTINES 1
+#endif
+
+static int verbose = 0;
+
+typedef enum { COLL_BARRIER, COLL_BCAST, COLL_REDUCE, COLL_ALLREDUCE,
+	       COLL_GATHER, COLL_ALLGATHER, COLL_ALLTOALL,
+	       COLL_REDUCE_SCATTER_BLOCK, COLL_SCAN, COLL_EXSCAN,
+	       NCOLL } coll_t;
+static const char *collName[NCOLL] = { "Barrier", "Bcast", "Reduce",
+				       "Allreduce", "Gather", "Allgather",
+				       "Alltoall", "Reduce_scatter_block",
+				       "Scan", "Exscan" };
+
+typedef enum { SKEW_NONE, SKEW_LATE, SKEW_UNIFORM, SKEW_LINEAR,
+	       NSKEW } skew_t;
+static const char *skewName[NSKEW] = { "none", "late", "uniform", "linear" };
+
+static int rank, size, count, lateRank;
+static int *sbuf, *rbuf;
+
+/* Fill delays with the delay of every process in repetition rep, and
+   return the longest.  Each process computes the whole table, so the
+   arrival of the last process is known without communication */
+static double MakeDelays( skew_t skew, int rep, double maxdelay,
+			  double *delays )
+{
+    unsigned int seed = 2654435761u * (unsigned int)(rep + 1);
+    double       longest = 0.0;
+    int          r;
+
+    for (r=0; r<size; r++) {
+	switch (skew) {
+	case SKEW_LATE:
+	    delays[r] = (r == lateRank) ? maxdelay : 0.0;
+	    break;
+	case SKEW_UNIFORM:
+	    seed      = seed * 1103515245 + 12345;
+	    delays[r] = maxdelay * ((seed >> 16) & 0x7fff) / 32767.0;
+	    break;
+	case SKEW_LINEAR:
+	    delays[r] = (size > 1) ? maxdelay * r / (size - 1) : 0.0;
+	    break;
+	default:
+	    delays[r] = 0.0;
+	    break;
+	}
+	if (delays[r] > longest) longest = delays[r];
+    }
+    return longest;
+}
+
+/* Run one collective, blocking or started and waited for */
+static void RunColl( coll_t coll, int nonblocking )
+{
+    MPI_Comm comm = MPI_COMM_WORLD;
+#ifdef TEST_NBC_ROUTINES
+    MPI_Request req;
+
+    if (nonblocking) {
+	switch (coll) {
+	case COLL_BARRIER:
+	    MPI_Ibarrier( comm, &req );
+	    break;
+	case COLL_BCAST:
+	    MPI_Ibcast( sbuf, count, MPI_INT, 0, comm, &req );
+	    break;
+	case COLL_REDUCE:
+	    MPI_Ireduce( sbuf, rbuf, count, MPI_INT, MPI_SUM, 0, comm, &req );
+	    break;
+	case COLL_ALLREDUCE:
+	    MPI_Iallreduce( sbuf, rbuf, count, MPI_INT, MPI_SUM, comm, &req );
+	    break;
+	case COLL_GATHER:
+	    MPI_Igather( sbuf, count, MPI_INT, rbuf, count, MPI_INT, 0, comm,
+			 &req );
+	    break;
+	case COLL_ALLGATHER:
+	    MPI_Iallgather( sbuf, count, MPI_INT, rbuf, count, MPI_INT, comm,
+			    &req );
+	    break;
+	case COLL_ALLTOALL:
+	    MPI_Ialltoall( sbuf, count, MPI_INT, rbuf, count, MPI_INT, comm,
+			   &req );
+	    break;
+	case COLL_REDUCE_SCATTER_BLOCK:
+	    MPI_Ireduce_scatter_block( sbuf, rbuf, count, MPI_INT, MPI_SUM,
+				       comm, &req );
+	    break;
+	case COLL_SCAN:
+	    MPI_Iscan( sbuf, rbuf, count, MPI_INT, MPI_SUM, comm, &req );
+	    break;
+	case COLL_EXSCAN:
+	    MPI_Iexscan( sbuf, rbuf, count, MPI_INT, MPI_SUM, comm, &req );
+	    break;
+	default:
+	    return;
+	}
+	MPI_Wait( &req, MPI_STATUS_IGNORE );
+	return;
+    }
+#endif
+    switch (coll) {
+    case COLL_BARRIER:
+	MPI_Barrier( comm );
+	break;
+    case COLL_BCAST:
+	MPI_Bcast( sbuf, count, MPI_INT, 0, comm );
+	break;
+    case COLL_REDUCE:
+	MPI_Reduce( sbuf, rbuf, count, MPI_INT, MPI_SUM, 0, comm );
+	break;
+    case COLL_ALLREDUCE:
+	MPI_Allreduce( sbuf, rbuf, count, MPI_INT, MPI_SUM, comm );
+	break;
+    case COLL_GATHER:
+	MPI_Gather( sbuf, count, MPI_INT, rbuf, count, MPI_INT, 0, comm );
+	break;
+    case COLL_ALLGATHER:
+	MPI_Allgather( sbuf, count, MPI_INT, rbuf, count, MPI_INT, comm );
+	break;
+    case COLL_ALLTOALL:
+	MPI_Alltoall( sbuf, count, MPI_INT, rbuf, count, MPI_INT, comm );
+	break;
+    case COLL_REDUCE_SCATTER_BLOCK:
+	MPI_Reduce_scatter_block( sbuf, rbuf, count, MPI_INT, MPI_SUM, comm );
+	break;
+    case COLL_SCAN:
+	MPI_Scan( sbuf, rbuf, count, MPI_INT, MPI_SUM, comm );
+	break;
+    case COLL_EXSCAN:
+	MPI_Exscan( sbuf, rbuf, count, MPI_INT, MPI_SUM, comm );
+	break;
+    default:
+	break;
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    int    errs = 0, i, rep, reps = 20, bytes = 4096, nonblocking, nmodes = 1;
+    coll_t coll;
+    skew_t skew;
+    double skewus = 100.0, maxdelay, longest, t;
+    double *excess, *delays, median, avg[NSKEW], maxv[NSKEW];
+    char   name[64];
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+    lateRank = size - 1;
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-bytes" ) == 0 && i+1 < argc) {
+	    bytes = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-skew" ) == 0 && i+1 < argc) {
+	    skewus = atof( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-late" ) == 0 && i+1 < argc) {
+	    lateRank = atoi( argv[++i] ) % size;
+	}
+	else if (strcmp( argv[i], "-reps" ) == 0 && i+1 < argc) {
+	    reps = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    maxdelay = 1.e-6 * skewus;
+    count    = bytes / sizeof(int);
+    if (count < 1) count = 1;
+    if (reps < 1) reps = 1;
+#ifdef TEST_NBC_ROUTINES
+    nmodes = 2;
+#endif
+
+    /* Alltoall and Reduce_scatter_block send count values to each process */
+    sbuf   = (int *)malloc( size * count * sizeof(int) );
+    rbuf   = (int *)malloc( size * count * sizeof(int) );
+    excess = (double *)malloc( reps * sizeof(double) );
+    delays = (double *)malloc( size * sizeof(double) );
+    if (!sbuf || !rbuf || !excess || !delays) {
+	MTestError( "Unable to allocate buffers" );
+    }
+    for (i=0; i<size*count; i++) {
+	sbuf[i] = i;
+	rbuf[i] = 0;
+    }
+
+    if (rank == 0 && verbose) {
+	printf( "%d bytes per process, skew %.1f us, late process %d\n",
+		bytes, skewus, lateRank );
+	printf( "Time after the last arrival in us (average/max over "
+		"processes)\n" );
+	printf( "%-22s", "collective" );
+	for (skew = SKEW_NONE; skew < NSKEW; skew++)
+	    printf( "%16s", skewName[skew] );
+	printf( "\n" );
+    }
+
+    for (nonblocking = 0; nonblocking < nmodes; nonblocking++) {
+	for (coll = COLL_BARRIER; coll < NCOLL; coll++) {
+	    for (skew = SKEW_NONE; skew < NSKEW; skew++) {
+		/* Warm up */
+		MPI_Barrier( MPI_COMM_WORLD );
+		RunColl( coll, nonblocking );
+
+		for (rep=0; rep<reps; rep++) {
+		    longest = MakeDelays( skew, rep, maxdelay, delays );
+		    MPI_Barrier( MPI_COMM_WORLD );
+		    t = MPI_Wtime();
+		    if (delays[rank] > 0) MTestSpin( delays[rank] );
+		    RunColl( coll, nonblocking );
+		    excess[rep] = MPI_Wtime() - t - longest;
+		}
+		median = MTestMedian( reps, excess );
+		MPI_Reduce( &median, &avg[skew], 1, MPI_DOUBLE, MPI_SUM, 0,
+			    MPI_COMM_WORLD );
+		MPI_Reduce( &median, &maxv[skew], 1, MPI_DOUBLE, MPI_MAX, 0,
+			    MPI_COMM_WORLD );
+		avg[skew] /= size;
+	    }
+	    if (rank == 0 && verbose) {
+		/* Bcast becomes Ibcast, and so on */
+		if (nonblocking) {
+		    sprintf( name, "I%s", collName[coll] );
+		    name[1] = tolower( name[1] );
+		}
+		else {
+		    strcpy( name, collName[coll] );
+		}
+		printf( "%-22s", name );
+		for (skew = SKEW_NONE; skew < NSKEW; skew++)
+		    printf( "%8.1f/%-7.1f", 1.e6 * avg[skew], 1.e6 * maxv[skew] );
+		printf( "\n" );
+		fflush( stdout );
+	    }
+	}
+    }
+
+    free( sbuf );
+    free( rbuf );
+    free( excess );
+    free( delays );
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,302 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Cost of noncontiguous RMA compared with contiguous transfers of the same
+ * number of bytes.  Each process exposes an XDIM x YDIM array of doubles
+ * and moves a rows x cols patch (starting at [0,0]) to or from the next
+ * process, as the strided_* and transpose tests in rma/ do.  For each patch
+ * shape, MPI_Put, MPI_Get and MPI_Accumulate are timed with these
+ * origin/target layouts:
+ *
+ *   contig   - contiguous on both sides (the reference)
+ *   c-vec    - contiguous origin, vector target
+ *   vec-vec  - vector on both sides
+ *   c-idx    - contiguous origin, indexed target (as strided_*_indexed)
+ *   subarr   - subarray on both sides (as strided_acc_subarray)
+ *   rows     - one contiguous operation per row, i.e. what an
+ *              implementation that falls back to per-block transfers does
+ *
+ * Each transfer is a separate exclusive lock epoch.  The report gives the
+ * bandwidth of each case and its time relative to contig; a derived
+ * datatype that is about as slow as "rows" (or slower) indicates that the
+ * implementation moves the blocks one at a time.  The put data is read
+ * back and checked for every layout.  Results are printed when
+ * MPITEST_VERBOSE is set.
+ *
+ * Options:
+ *   -nelem <n>   elements (doubles) in each patch (default 16384); narrow
+ *                patches are limited to 1024 rows
+ *   -reps <n>    transfers per case (default 10)
+ */
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitest.h"
+
+#define XDIM 1024
+#define YDIM 1024
+
+typedef enum { LAY_CONTIG = 0, LAY_CVEC, LAY_VECVEC, LAY_CIDX, LAY_SUBARR,
+	       LAY_ROWS, LAY_MAX } layout_t;
+static const char *layoutName[LAY_MAX] = { "contig", "c-vec", "vec-vec",
+					   "c-idx", "subarr", "rows" };
+
+typedef enum { OP_PUT = 0, OP_GET, OP_ACC, OP_MAX } rmaop_t;
+static const char *opName[OP_MAX] = { "put", "get", "acc" };
+
+static int verbose = 0;
+
+/* Origin and target types for one patch shape; count is the number of
+   elements of the type to transfer */
+typedef struct {
+    MPI_Datatype otype, ttype;
+    int          ocount, tcount;
+} layouttypes_t;
+
+static void MakeTypes( layout_t lay, int rows, int cols, layouttypes_t *lt );
+static void FreeTypes( layouttypes_t *lt );
+static double TimeOp( rmaop_t op, layout_t lay, layouttypes_t *lt,
+		      int rows, int cols, double *obuf, int target,
+		      int reps, MPI_Win win );
+static int  CheckPatch( layout_t lay, int rows, int cols, double *check,
+			int target, int src, MPI_Win win );
+
+int main( int argc, char *argv[] )
+{
+    int      errs = 0, i, rank, size, target, nelem = 16384, reps = 10;
+    int      rows, cols, lay, op;
+    double   *winbuf, *obuf, *check, t, tcontig[OP_MAX], tmax;
+    layouttypes_t lt;
+    MPI_Win  win;
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-nelem" ) == 0 && i+1 < argc) {
+	    nelem = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-reps" ) == 0 && i+1 < argc) {
+	    reps = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    if (nelem > XDIM * YDIM) nelem = XDIM * YDIM;
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+    target = (rank + 1) % size;
+
+    MPI_Alloc_mem( XDIM * YDIM * sizeof(double), MPI_INFO_NULL, &winbuf );
+    obuf  = (double *)malloc( XDIM * YDIM * sizeof(double) );
+    check = (double *)malloc( XDIM * YDIM * sizeof(double) );
+    if (!obuf || !check) {
+	MTestError( "Unable to allocate buffers" );
+    }
+    memset( winbuf, 0, XDIM * YDIM * sizeof(double) );
+    MPI_Win_create( winbuf, XDIM * YDIM * sizeof(double), sizeof(double),
+		    MPI_INFO_NULL, MPI_COMM_WORLD, &win );
+
+    if (rank == 0 && verbose) {
+	printf( "op\trows\tcols\tlayout\tMB/sec\t\ttime/contig\n" );
+    }
+
+    /* Sweep the patch shape from one column (the most fragmented) to
+       full rows; a shape with more rows than the array is cut to YDIM rows
+       and moves fewer elements */
+    for (cols = 1; cols <= XDIM && cols <= nelem; cols *= 4) {
+	rows = nelem / cols;
+	if (rows > YDIM) rows = YDIM;
+	for (lay = 0; lay < LAY_MAX; lay++) {
+	    MakeTypes( (layout_t)lay, rows, cols, &lt );
+	    for (op = 0; op < OP_MAX; op++) {
+		/* Origin data identifies the origin and the element */
+		for (i=0; i<XDIM*YDIM; i++) obuf[i] = rank * 1.0e7 + i;
+		MPI_Barrier( MPI_COMM_WORLD );
+		t = TimeOp( (rmaop_t)op, (layout_t)lay, &lt, rows, cols, obuf,
+			    target, reps, win );
+		MPI_Allreduce( &t, &tmax, 1, MPI_DOUBLE, MPI_MAX,
+			       MPI_COMM_WORLD );
+		if (lay == LAY_CONTIG) tcontig[op] = tmax;
+		if (rank == 0 && verbose) {
+		    printf( "%s\t%d\t%d\t%s\t%e\t%.2f\n", opName[op], rows,
+			    cols, layoutName[lay],
+			    tmax > 0 ? rows * cols * sizeof(double) * 1.e-6 /
+			    tmax : 0.0,
+			    tcontig[op] > 0 ? tmax / tcontig[op] : 0.0 );
+		    fflush( stdout );
+		}
+		if (op == OP_PUT) {
+		    MPI_Barrier( MPI_COMM_WORLD );
+		    errs += CheckPatch( (layout_t)lay, rows, cols, check, target,
+					rank, win );
+		}
+	    }
+	    FreeTypes( &lt );
+	}
+    }
+
+    MPI_Win_free( &win );
+    MPI_Free_mem( winbuf );
+    free( obuf );
+    free( check );
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
+
+/* Build the origin and target datatypes for a layout and patch shape */
+static void MakeTypes( layout_t lay, int rows, int cols, layouttypes_t *lt )
+{
+    int i, *blens, *displs, sizes[2], subsizes[2], starts[2];
+    MPI_Datatype vtype;
+
+    lt->otype  = lt->ttype  = MPI_DOUBLE;
+    lt->ocount = lt->tcount = rows * cols;
+
+    switch (lay) {
+    case LAY_CONTIG:
+    case LAY_ROWS:
+	/* ROWS uses cols elements of MPI_DOUBLE per operation */
+	if (lay == LAY_ROWS) lt->ocount = lt->tcount = cols;
+	return;
+    case LAY_CVEC:
+    case LAY_VECVEC:
+	MPI_Type_vector( rows, cols, XDIM, MPI_DOUBLE, &vtype );
+	MPI_Type_commit( &vtype );
+	lt->ttype  = vtype;
+	lt->tcount = 1;
+	if (lay == LAY_VECVEC) {
+	    MPI_Type_dup( vtype, &lt->otype );
+	    lt->ocount = 1;
+	}
+	break;
+    case LAY_CIDX:
+	blens  = (int *)malloc( rows * sizeof(int) );
+	displs = (int *)malloc( rows * sizeof(int) );
+	for (i=0; i<rows; i++) {
+	    blens[i]  = cols;
+	    displs[i] = i * XDIM;
+	}
+	MPI_Type_indexed( rows, blens, displs, MPI_DOUBLE, &lt->ttype );
+	MPI_Type_commit( &lt->ttype );
+	lt->tcount = 1;
+	free( blens );
+	free( displs );
+	break;
+    case LAY_SUBARR:
+	sizes[0]    = YDIM; sizes[1]    = XDIM;
+	subsizes[0] = rows; subsizes[1] = cols;
+	starts[0]   = 0;    starts[1]   = 0;
+	MPI_Type_create_subarray( 2, sizes, subsizes, starts, MPI_ORDER_C,
+				  MPI_DOUBLE, &lt->ttype );
+	MPI_Type_commit( &lt->ttype );
+	MPI_Type_dup( lt->ttype, &lt->otype );
+	lt->ocount = lt->tcount = 1;
+	break;
+    default:
+	break;
+    }
+}
+
+static void FreeTypes( layouttypes_t *lt )
+{
+    if (lt->otype != MPI_DOUBLE) MPI_Type_free( &lt->otype );
+    if (lt->ttype != MPI_DOUBLE) MPI_Type_free( &lt->ttype );
+}
+
+/* Time reps transfers, each in its own exclusive lock epoch */
+static double TimeOp( rmaop_t op, layout_t lay, layouttypes_t *lt,
+		      int rows, int cols, double *obuf, int target,
+		      int reps, MPI_Win win )
+{
+    int    k, r, nops = 1, ostride = 0, tstride = 0;
+    double t;
+
+    if (lay == LAY_ROWS) {
+	nops    = rows;
+	ostride = cols;
+	tstride = XDIM;
+    }
+
+    t = MPI_Wtime();
+    for (k=0; k<reps; k++) {
+	MPI_Win_lock( MPI_LOCK_EXCLUSIVE, target, 0, win );
+	for (r=0; r<nops; r++) {
+	    switch (op) {
+	    case OP_PUT:
+		MPI_Put( obuf + r * ostride, lt->ocount, lt->otype, target,
+			 r * tstride, lt->tcount, lt->ttype, win );
+		break;
+	    case OP_GET:
+		MPI_Get( obuf + r * ostride, lt->ocount, lt->otype, target,
+			 r * tstride, lt->tcount, lt->ttype, win );
+		break;
+	    case OP_ACC:
+		MPI_Accumulate( obuf + r * ostride, lt->ocount, lt->otype,
+				target, r * tstride, lt->tcount, lt->ttype,
+				MPI_SUM, win );
+		break;
+	    default:
+		break;
+	    }
+	}
+	MPI_Win_unlock( target, win );
+    }
+    return (MPI_Wtime() - t) / reps;
+}
+
+/*
+ * Read the patch back from the target as contiguous rows and compare it
+ * with what the layout should have put there.  The contiguous origin
+ * layouts take consecutive elements of the origin buffer; the vector and
+ * subarray origins take the same patch of the origin array.
+ */
+static int CheckPatch( layout_t lay, int rows, int cols, double *check,
+		       int target, int src, MPI_Win win )
+{
+    int    errs = 0, i, j;
+    double expected;
+    MPI_Datatype vtype;
+
+    /* The contiguous reference writes rows * cols consecutive elements
+       rather than the patch */
+    if (lay == LAY_CONTIG) {
+	MPI_Type_contiguous( rows * cols, MPI_DOUBLE, &vtype );
+    }
+    else {
+	MPI_Type_vector( rows, cols, XDIM, MPI_DOUBLE, &vtype );
+    }
+    MPI_Type_commit( &vtype );
+    MPI_Win_lock( MPI_LOCK_SHARED, target, 0, win );
+    MPI_Get( check, rows * cols, MPI_DOUBLE, target, 0, 1, vtype, win );
+    MPI_Win_unlock( target, win );
+    MPI_Type_free( &vtype );
+
+    for (i=0; i<rows; i++) {
+	for (j=0; j<cols; j++) {
+	    if (lay == LAY_VECVEC || lay == LAY_SUBARR)
+		expected = src * 1.0e7 + i * XDIM + j;
+	    else
+		expected = src * 1.0e7 + i * cols + j;
+	    if (check[i*cols+j] != expected) {
+		errs++;
+		if (errs < 10) {
+		    printf( "%s %dx%d: element [%d,%d] is %f, expected %f\n",
+			    layoutName[lay], rows, cols, i, j,
+			    check[i*cols+j], expected );
+		}
+	    }
+	}
+    }
+    return errs;
+}
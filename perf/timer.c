@@ -4,27 +4,70 @@
  *      See COPYRIGHT in top-level directory.
  */
 
-/* 
+/*
  * Check that the timer produces monotone nondecreasing times and that
- * the Tick is reasonable
+ * the Tick is reasonable, and characterize the timer that the other
+ * benchmarks depend on:
+ *
+ *   overhead   - the cost of one call to MPI_Wtime
+ *   resolution - the smallest step actually observed in MPI_Wtime,
+ *                compared with the value claimed by MPI_Wtick
+ *   offsets    - the offset of each process's clock from that of process
+ *                0, measured with MTestGetClockOffset at the start and
+ *                again after a delay, giving the drift of each clock
+ *
+ * If MPI_WTIME_IS_GLOBAL is set on MPI_COMM_WORLD, the offsets must be
+ * within the error of the measurement.  The per-process table of offsets,
+ * errors and drift is printed when MPITEST_VERBOSE is set; benchmarks
+ * that need to align timestamps across processes can call
+ * MTestGetClockOffset themselves.
+ *
+ * Options:
+ *   -delay <sec>   time between the two offset measurements (default 0.5)
+ *   -npings <n>    exchanges per process for each offset (default 100)
  */
 
 #include "mpi.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "mpitest.h"
 
 static int verbose = 0;
 
 #define MAX_TIMER_TEST 5000
+/* Calls used to measure the overhead of MPI_Wtime */
+#define NOVERHEAD 100000
+/* Steps of the clock used to measure its resolution */
+#define NSTEPS 100
 
 int main(int argc, char* argv[])
 {
     double t1[MAX_TIMER_TEST], tick[MAX_TIMER_TEST], tickval;
     double minDiff, maxDiff, diff;
-    int i, nZeros = 0;
+    double overhead, minStep, tstart, tnow, delay = 0.5;
+    double off[2], err[2], vals[4], *table = 0;
+    int i, nZeros = 0, nNeg = 0, npings = 100;
+    int rank, size, flag, isGlobal = 0, *attrval;
     int errs = 0;
 
     MTest_Init(&argc,&argv);
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-delay" ) == 0 && i+1 < argc) {
+	    delay = atof( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-npings" ) == 0 && i+1 < argc) {
+	    npings = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
 
     for (i=0; i<MAX_TIMER_TEST; i++) {
 	t1[i] = MPI_Wtime();
@@ -44,6 +87,10 @@ int main(int argc, char* argv[])
 	    errs ++;
 	}
     }
+    if (tickval <= 0.0) {
+	fprintf( stderr, "MPI_Wtick returned %e\n", tickval );
+	errs++;
+    }
 
     /* Look at the timer */
     minDiff = 1.e20;
@@ -52,16 +99,101 @@ int main(int argc, char* argv[])
     for (i=1; i<MAX_TIMER_TEST; i++) {
 	diff = t1[i] - t1[i-1];
 	if (diff == 0.0) nZeros++;
+	else if (diff < 0.0) nNeg++;
 	else if (diff < minDiff) minDiff = diff;
 	if (diff > maxDiff) maxDiff = diff;
     }
+    if (nNeg) {
+	fprintf( stderr, "MPI_Wtime decreased %d times\n", nNeg );
+	errs++;
+    }
 
     /* Are the time diff values and tick values consistent */
-    if (verbose) {
-	printf( "Tick = %e, timer range = [%e,%e]\n", tickval, minDiff, 
+    if (verbose && rank == 0) {
+	printf( "Tick = %e, timer range = [%e,%e]\n", tickval, minDiff,
 		maxDiff );
 	if (nZeros) printf( "Wtime difference was 0 %d times\n", nZeros );
-    }    
+    }
+
+    /* Overhead of a call */
+    tstart = MPI_Wtime();
+    for (i=0; i<NOVERHEAD; i++) {
+	tnow = MPI_Wtime();
+    }
+    overhead = (MPI_Wtime() - tstart) / NOVERHEAD;
+
+    /* Resolution: the smallest step seen when spinning until the clock
+       changes.  Unlike the differences above, this is not limited by the
+       time between two calls */
+    minStep = 1.e20;
+    for (i=0; i<NSTEPS; i++) {
+	tstart = MPI_Wtime();
+	do {
+	    tnow = MPI_Wtime();
+	} while (tnow == tstart);
+	if (tnow - tstart < minStep) minStep = tnow - tstart;
+    }
+
+    /* The times and steps differ between processes on different nodes;
+       report the largest */
+    vals[0] = overhead;
+    vals[1] = minStep;
+    MPI_Reduce( rank == 0 ? MPI_IN_PLACE : vals, vals, 2, MPI_DOUBLE,
+		MPI_MAX, 0, MPI_COMM_WORLD );
+    if (verbose && rank == 0) {
+	printf( "MPI_Wtime overhead = %.1f ns, observed resolution = %e, "
+		"MPI_Wtick = %e\n", 1.e9 * vals[0], vals[1], tickval );
+	if (vals[1] > 2 * tickval)
+	    printf( "MPI_Wtick claims a finer resolution than observed\n" );
+	else if (vals[1] < 0.5 * tickval)
+	    printf( "MPI_Wtick claims a coarser resolution than observed\n" );
+    }
+
+    /* Clock offsets and drift relative to process 0 */
+    MPI_Comm_get_attr( MPI_COMM_WORLD, MPI_WTIME_IS_GLOBAL, &attrval, &flag );
+    if (flag) isGlobal = *attrval;
+
+    MTestGetClockOffset( MPI_COMM_WORLD, npings, &off[0], &err[0] );
+    MPI_Barrier( MPI_COMM_WORLD );
+    tstart = MPI_Wtime();
+    while (MPI_Wtime() - tstart < delay) ;
+    MTestGetClockOffset( MPI_COMM_WORLD, npings, &off[1], &err[1] );
+    tnow = MPI_Wtime() - tstart;
+
+    if (isGlobal) {
+	for (i=0; i<2; i++) {
+	    if (off[i] > err[i] + tickval || -off[i] > err[i] + tickval) {
+		errs++;
+		fprintf( stderr, "MPI_WTIME_IS_GLOBAL is set but the clock on "
+			 "process %d is offset by %e (+/- %e)\n", rank, off[i],
+			 err[i] );
+	    }
+	}
+    }
+
+    vals[0] = off[0];
+    vals[1] = err[0];
+    vals[2] = off[1];
+    vals[3] = (off[1] - off[0]) / tnow;
+    if (rank == 0) {
+	table = (double *)malloc( 4 * size * sizeof(double) );
+	if (!table) {
+	    MTestError( "Unable to allocate offset table" );
+	}
+    }
+    MPI_Gather( vals, 4, MPI_DOUBLE, table, 4, MPI_DOUBLE, 0,
+		MPI_COMM_WORLD );
+    if (verbose && rank == 0) {
+	printf( "MPI_WTIME_IS_GLOBAL = %d\n", isGlobal );
+	printf( "%6s%14s%14s%14s%14s\n", "rank", "offset (us)", "error (us)",
+		"offset2 (us)", "drift (us/s)" );
+	for (i=0; i<size; i++) {
+	    printf( "%6d%14.3f%14.3f%14.3f%14.3f\n", i, 1.e6 * table[4*i],
+		    1.e6 * table[4*i+1], 1.e6 * table[4*i+2],
+		    1.e6 * table[4*i+3] );
+	}
+    }
+    if (table) free( table );
 
     MTest_Finalize(errs);
     MPI_Finalize();
@@ -0,0 +1,295 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Cost of user-defined reduction operations compared with the equivalent
+ * predefined operation.  Two reductions are measured, each with the
+ * predefined op, a user op created as commutative and the same user op
+ * created as non-commutative (which, as in coll/allred6.c, forces the
+ * implementation to use its algorithms for non-commutative ops):
+ *
+ *   sum     - MPI_SUM on MPI_DOUBLE
+ *   minloc  - MPI_MINLOC on MPI_DOUBLE_INT, against a user op on a struct
+ *             { double value; int index; } datatype, the usual form of an
+ *             application's min-with-index reduction
+ *
+ * with MPI_Allreduce, MPI_Reduce, MPI_Reduce_scatter_block and MPI_Scan,
+ * for vector lengths from 1 element upward.  For short vectors the
+ * difference is the cost of calling through the function pointer; for
+ * long vectors it is the speed of the user loop and the algorithm chosen.
+ * The user functions count their invocations, so the report also gives
+ * the number of invocations per call on each process and the average
+ * number of elements per invocation (a small number means the
+ * implementation splits the vector into small pieces).  All results are
+ * checked.  Timings are printed when MPITEST_VERBOSE is set.
+ *
+ * Options:
+ *   -maxcount <n>  largest vector length (default 65536)
+ */
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitest.h"
+
+typedef struct {
+    double value;
+    int    index;
+} dint_t;
+
+typedef enum { C_ALLREDUCE = 0, C_REDUCE, C_REDSCAT, C_SCAN, C_MAX } coll_t;
+static const char *collName[C_MAX] = { "allreduce", "reduce", "redscat",
+				       "scan" };
+
+/* Invocation counters for the user functions */
+static long nInvoke = 0, nElements = 0;
+
+void usersum( void *invec, void *inoutvec, int *len, MPI_Datatype *dtype );
+void usersum( void *invec, void *inoutvec, int *len, MPI_Datatype *dtype )
+{
+    const double *in = (const double *)invec;
+    double       *inout = (double *)inoutvec;
+    int          i, n = *len;
+
+    nInvoke++;
+    nElements += n;
+    for (i=0; i<n; i++)
+	inout[i] += in[i];
+}
+
+void userminloc( void *invec, void *inoutvec, int *len, MPI_Datatype *dtype );
+void userminloc( void *invec, void *inoutvec, int *len, MPI_Datatype *dtype )
+{
+    const dint_t *in = (const dint_t *)invec;
+    dint_t       *inout = (dint_t *)inoutvec;
+    int          i, n = *len;
+
+    nInvoke++;
+    nElements += n;
+    for (i=0; i<n; i++) {
+	if (in[i].value < inout[i].value ||
+	    (in[i].value == inout[i].value && in[i].index < inout[i].index))
+	    inout[i] = in[i];
+    }
+}
+
+static int verbose = 0;
+
+static void RunColl( coll_t coll, void *sbuf, void *rbuf, int count,
+		     MPI_Datatype type, MPI_Op op, MPI_Comm comm );
+static void InitBuf( int isSum, void *buf, int n, int rank );
+static int  CheckBuf( int isSum, coll_t coll, void *buf, int count,
+		      int rank, int size );
+
+int main( int argc, char *argv[] )
+{
+    int          errs = 0, i, k, rank, size, count, maxcount = 65536, reps;
+    int          isSum, coll, v, blens[2] = { 1, 1 };
+    MPI_Aint     displs[2];
+    MPI_Datatype types[2] = { MPI_DOUBLE, MPI_INT }, dinttype, tmptype;
+    MPI_Datatype vtype[3];
+    MPI_Op       ops[2][3];
+    const char   *vname[3] = { "predef", "user-c", "user-nc" };
+    double       t[3], tmax[3];
+    long         inv[3], elt[3];
+    void         *sbuf, *rbuf;
+    MPI_Comm     comm = MPI_COMM_WORLD;
+    dint_t       d;
+
+    MTest_Init( &argc, &argv );
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-maxcount" ) == 0 && i+1 < argc) {
+	    maxcount = atoi( argv[++i] );
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    MPI_Comm_rank( comm, &rank );
+    MPI_Comm_size( comm, &size );
+
+    /* A struct type as an application would describe dint_t */
+    MPI_Get_address( &d.value, &displs[0] );
+    MPI_Get_address( &d.index, &displs[1] );
+    displs[1] -= displs[0];
+    displs[0]  = 0;
+    MPI_Type_create_struct( 2, blens, displs, types, &tmptype );
+    MPI_Type_create_resized( tmptype, 0, sizeof(dint_t), &dinttype );
+    MPI_Type_free( &tmptype );
+    MPI_Type_commit( &dinttype );
+
+    ops[1][0] = MPI_SUM;
+    MPI_Op_create( usersum, 1, &ops[1][1] );
+    MPI_Op_create( usersum, 0, &ops[1][2] );
+    ops[0][0] = MPI_MINLOC;
+    MPI_Op_create( userminloc, 1, &ops[0][1] );
+    MPI_Op_create( userminloc, 0, &ops[0][2] );
+
+    sbuf = malloc( (size_t)maxcount * size * sizeof(dint_t) );
+    rbuf = malloc( (size_t)maxcount * size * sizeof(dint_t) );
+    if (!sbuf || !rbuf) {
+	MTestError( "Unable to allocate buffers" );
+    }
+
+    if (rank == 0 && verbose) {
+	printf( "%-7s %-10s%8s%11s%11s%11s%8s%8s%9s%9s\n", "op", "coll",
+		"count", "predef", "user-c", "user-nc", "c/pre", "nc/pre",
+		"inv/call", "elt/inv" );
+    }
+
+    for (isSum = 1; isSum >= 0; isSum--) {
+	vtype[0] = isSum ? MPI_DOUBLE : MPI_DOUBLE_INT;
+	vtype[1] = vtype[2] = isSum ? MPI_DOUBLE : dinttype;
+	for (coll = 0; coll < C_MAX; coll++) {
+	    for (count = 1; count <= maxcount; count *= 8) {
+		reps = 100000 / (count + 100) + 2;
+		for (v=0; v<3; v++) {
+		    /* Check the result of one call, then time */
+		    InitBuf( isSum, sbuf, count * size, rank );
+		    RunColl( (coll_t)coll, sbuf, rbuf, count, vtype[v],
+			     ops[isSum][v], comm );
+		    errs += CheckBuf( isSum, (coll_t)coll, rbuf, count, rank,
+				      size );
+		    nInvoke = nElements = 0;
+		    MPI_Barrier( comm );
+		    t[v] = MPI_Wtime();
+		    for (k=0; k<reps; k++) {
+			RunColl( (coll_t)coll, sbuf, rbuf, count, vtype[v],
+				 ops[isSum][v], comm );
+		    }
+		    t[v] = (MPI_Wtime() - t[v]) / reps;
+		    inv[v] = nInvoke;
+		    elt[v] = nElements;
+		}
+		MPI_Reduce( t, tmax, 3, MPI_DOUBLE, MPI_MAX, 0, comm );
+		/* Invocations by the busiest process, for the
+		   non-commutative op */
+		MPI_Reduce( rank == 0 ? MPI_IN_PLACE : inv, inv, 3, MPI_LONG,
+			    MPI_MAX, 0, comm );
+		MPI_Reduce( rank == 0 ? MPI_IN_PLACE : elt, elt, 3, MPI_LONG,
+			    MPI_MAX, 0, comm );
+		if (rank == 0 && verbose) {
+		    printf( "%-7s %-10s%8d%11.2f%11.2f%11.2f%8.2f%8.2f"
+			    "%9.2f%9.1f\n", isSum ? "sum" : "minloc",
+			    collName[coll], count, 1.e6 * tmax[0],
+			    1.e6 * tmax[1], 1.e6 * tmax[2],
+			    tmax[1] / tmax[0], tmax[2] / tmax[0],
+			    (double)inv[2] / reps,
+			    inv[2] ? (double)elt[2] / inv[2] : 0.0 );
+		    fflush( stdout );
+		}
+	    }
+	}
+    }
+    if (rank == 0 && verbose) {
+	printf( "times in usec; inv/call and elt/inv are for %s\n",
+		vname[2] );
+    }
+
+    for (v=1; v<3; v++) {
+	MPI_Op_free( &ops[0][v] );
+	MPI_Op_free( &ops[1][v] );
+    }
+    MPI_Type_free( &dinttype );
+    free( sbuf );
+    free( rbuf );
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
+
+static void RunColl( coll_t coll, void *sbuf, void *rbuf, int count,
+		     MPI_Datatype type, MPI_Op op, MPI_Comm comm )
+{
+    switch (coll) {
+    case C_ALLREDUCE:
+	MPI_Allreduce( sbuf, rbuf, count, type, op, comm );
+	break;
+    case C_REDUCE:
+	MPI_Reduce( sbuf, rbuf, count, type, op, 0, comm );
+	break;
+    case C_REDSCAT:
+	MPI_Reduce_scatter_block( sbuf, rbuf, count, type, op, comm );
+	break;
+    case C_SCAN:
+	MPI_Scan( sbuf, rbuf, count, type, op, comm );
+	break;
+    default:
+	break;
+    }
+}
+
+/*
+ * Element i of process r's contribution.  The minloc values are chosen so
+ * that the minimum over any prefix of the processes is unique.
+ */
+static double SumValue( int r, int i )  { return r + i; }
+static double MinValue( int r, int i, int size )
+{
+    return (double)((r + i) % size);
+}
+
+static void InitBuf( int isSum, void *buf, int n, int rank )
+{
+    int i, size;
+
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+    for (i=0; i<n; i++) {
+	if (isSum) {
+	    ((double *)buf)[i] = SumValue( rank, i );
+	}
+	else {
+	    ((dint_t *)buf)[i].value = MinValue( rank, i, size );
+	    ((dint_t *)buf)[i].index = rank;
+	}
+    }
+}
+
+static int CheckBuf( int isSum, coll_t coll, void *buf, int count,
+		     int rank, int size )
+{
+    int    errs = 0, i, r, idx, nproc, minr;
+    double sum, minv, v;
+
+    if (coll == C_REDUCE && rank != 0) return 0;
+    nproc = (coll == C_SCAN) ? rank + 1 : size;
+    for (i=0; i<count; i++) {
+	/* Index of the element in the contributions */
+	idx = (coll == C_REDSCAT) ? rank * count + i : i;
+	sum  = 0;
+	minv = size;
+	minr = -1;
+	for (r=0; r<nproc; r++) {
+	    sum += SumValue( r, idx );
+	    v    = MinValue( r, idx, size );
+	    if (v < minv) {
+		minv = v;
+		minr = r;
+	    }
+	}
+	if (isSum) {
+	    if (((double *)buf)[i] != sum) {
+		errs++;
+		if (errs < 10)
+		    printf( "%s sum[%d] = %f, expected %f\n", collName[coll],
+			    i, ((double *)buf)[i], sum );
+	    }
+	}
+	else if (((dint_t *)buf)[i].value != minv ||
+		 ((dint_t *)buf)[i].index != minr) {
+	    errs++;
+	    if (errs < 10)
+		printf( "%s minloc[%d] = (%f,%d), expected (%f,%d)\n",
+			collName[coll], i, ((dint_t *)buf)[i].value,
+			((dint_t *)buf)[i].index, minv, minr );
+	}
+    }
+    return errs;
+}
@@ -0,0 +1,269 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/*
+ * Measure the cost of generalized requests that are completed by a
+ * helper thread while the main thread blocks in MPI_Wait or MPI_Waitall.
+ * Three quantities are reported (when MPITEST_VERBOSE is set):
+ *
+ *   wakeup   - time from MPI_Grequest_complete in the helper thread to
+ *              the return of MPI_Wait in the main thread (min/median/
+ *              99th percentile/max over nLoop trials)
+ *   mixed    - the same, but for MPI_Waitall on a set of generalized
+ *              requests mixed with point-to-point requests
+ *   rate     - generalized requests started, completed and waited for
+ *              per second, both inline and completed in batches by the
+ *              helper thread
+ *
+ * The callbacks count their invocations, so the test also checks that
+ * query_fn and free_fn run exactly once per request.
+ *
+ * Options:
+ *   -n <loops>       number of wakeup trials (default 200)
+ *   -batch <count>   requests per Waitall (default 16, max MAX_BATCH)
+ *   -delay <usec>    time the helper waits before completing, to make
+ *                    sure the main thread is blocked (default 20)
+ */
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpitest.h"
+#include "mpithreadtest.h"
+
+#define MAX_BATCH 256
+#define MAX_LOOP  10000
+
+static int verbose = 0;
+
+/* Shared state between the main and the helper thread.  The main thread
+   hands a batch of requests to the helper by setting npending under the
+   lock; the helper completes them and records when it did so. */
+static MTEST_THREAD_LOCK_TYPE lock;
+static MPI_Request pendingReq[MAX_BATCH];
+static volatile int npending = 0;
+static volatile int quit = 0;
+static volatile double tComplete = 0.0;
+static double delayUsec = 20;
+
+/* Callback invocation counters (only touched by the thread that waits) */
+static int nquery = 0, nfree = 0;
+
+int query_fn( void *extra_state, MPI_Status *status );
+int query_fn( void *extra_state, MPI_Status *status )
+{
+    nquery++;
+    status->MPI_SOURCE = MPI_UNDEFINED;
+    status->MPI_TAG    = MPI_UNDEFINED;
+    MPI_Status_set_cancelled( status, 0 );
+    MPI_Status_set_elements( status, MPI_BYTE, 0 );
+    return 0;
+}
+int free_fn( void *extra_state );
+int free_fn( void *extra_state )
+{
+    nfree++;
+    return 0;
+}
+int cancel_fn( void *extra_state, int complete );
+int cancel_fn( void *extra_state, int complete )
+{
+    return 0;
+}
+
+MTEST_THREAD_RETURN_TYPE completer( void *arg );
+MTEST_THREAD_RETURN_TYPE completer( void *arg )
+{
+    MPI_Request reqs[MAX_BATCH];
+    int         i, n, done;
+
+    while (1) {
+	MTest_thread_lock( &lock );
+	n    = npending;
+	done = quit;
+	if (n) {
+	    memcpy( reqs, pendingReq, n * sizeof(MPI_Request) );
+	    npending = 0;
+	}
+	MTest_thread_unlock( &lock );
+
+	if (n) {
+	    /* Give the main thread time to block in the wait */
+	    MTestSpin( 1.0e-6 * delayUsec );
+	    tComplete = MPI_Wtime();
+	    for (i=0; i<n; i++) {
+		MPI_Grequest_complete( reqs[i] );
+	    }
+	}
+	else if (done) break;
+    }
+    return MTEST_THREAD_RETVAL_IGN;
+}
+
+/* Hand n requests to the helper thread */
+static void PostToHelper( MPI_Request *reqs, int n )
+{
+    MTest_thread_lock( &lock );
+    memcpy( pendingReq, reqs, n * sizeof(MPI_Request) );
+    npending = n;
+    MTest_thread_unlock( &lock );
+}
+
+static void PrintDist( const char *name, double *t, int n )
+{
+    MTestSortDouble( n, t );
+    printf( "%-8s\t%10.2f\t%10.2f\t%10.2f\t%10.2f\n", name,
+	    t[0] * 1.e6, t[n/2] * 1.e6, t[(99*n)/100] * 1.e6,
+	    t[n-1] * 1.e6 );
+}
+
+int main( int argc, char *argv[] )
+{
+    int         errs = 0, provided, rank, size, partner;
+    int         i, j, k, nLoop = 200, nBatch = 16, nReq = 0;
+    int         sbuf[MAX_BATCH], rbuf[MAX_BATCH];
+    double      *wakeup, *mixed, t, rateInline, rateBatch;
+    MPI_Request reqs[2*MAX_BATCH];
+
+    MTest_Init_thread( &argc, &argv, MPI_THREAD_MULTIPLE, &provided );
+    if (provided != MPI_THREAD_MULTIPLE) {
+	printf( "This test requires MPI_THREAD_MULTIPLE\n" );
+	MPI_Abort( MPI_COMM_WORLD, 1 );
+    }
+    if (getenv("MPITEST_VERBOSE")) verbose = 1;
+
+    for (i=1; i<argc; i++) {
+	if (strcmp( argv[i], "-n" ) == 0 && i+1 < argc) {
+	    nLoop = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-batch" ) == 0 && i+1 < argc) {
+	    nBatch = atoi( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-delay" ) == 0 && i+1 < argc) {
+	    delayUsec = atof( argv[++i] );
+	}
+	else if (strcmp( argv[i], "-v" ) == 0) {
+	    verbose = 1;
+	}
+	else {
+	    fprintf( stderr, "Unrecognized argument %s\n", argv[i] );
+	    MPI_Abort( MPI_COMM_WORLD, 1 );
+	}
+    }
+    if (nLoop < 1) nLoop = 1;
+    if (nLoop > MAX_LOOP) nLoop = MAX_LOOP;
+    if (nBatch < 1) nBatch = 1;
+    if (nBatch > MAX_BATCH) nBatch = MAX_BATCH;
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &size );
+    /* The point-to-point half of the mixed wait goes to a neighbor, or
+       to ourselves if we are alone */
+    partner = rank ^ 1;
+    if (partner >= size) partner = rank;
+
+    wakeup = (double *)malloc( nLoop * sizeof(double) );
+    mixed  = (double *)malloc( nLoop * sizeof(double) );
+    if (!wakeup || !mixed) {
+	MTestError( "Could not allocate timing arrays" );
+    }
+    for (i=0; i<MAX_BATCH; i++) sbuf[i] = rank + i;
+
+    MTest_thread_lock_create( &lock );
+    MTest_Start_thread( completer, NULL );
+
+    /* Wakeup latency for a single generalized request in MPI_Wait */
+    for (k=0; k<nLoop; k++) {
+	MPI_Grequest_start( query_fn, free_fn, cancel_fn, NULL, &reqs[0] );
+	nReq++;
+	PostToHelper( reqs, 1 );
+	MPI_Wait( &reqs[0], MPI_STATUS_IGNORE );
+	wakeup[k] = MPI_Wtime() - tComplete;
+    }
+
+    /* Wakeup latency for Waitall on generalized plus pt2pt requests */
+    for (k=0; k<nLoop; k++) {
+	for (j=0; j<nBatch; j++) {
+	    MPI_Grequest_start( query_fn, free_fn, cancel_fn, NULL, &reqs[j] );
+	    nReq++;
+	}
+	for (j=0; j<nBatch/2; j++) {
+	    MPI_Irecv( &rbuf[j], 1, MPI_INT, partner, j, MPI_COMM_WORLD,
+		       &reqs[nBatch+2*j] );
+	    MPI_Isend( &sbuf[j], 1, MPI_INT, partner, j, MPI_COMM_WORLD,
+		       &reqs[nBatch+2*j+1] );
+	}
+	PostToHelper( reqs, nBatch );
+	MPI_Waitall( nBatch + 2*(nBatch/2), reqs, MPI_STATUSES_IGNORE );
+	mixed[k] = MPI_Wtime() - tComplete;
+	for (j=0; j<nBatch/2; j++) {
+	    if (rbuf[j] != partner + j) {
+		errs++;
+		if (errs < 10) {
+		    fprintf( stderr, "rbuf[%d] = %d, expected %d\n",
+			     j, rbuf[j], partner + j );
+		}
+	    }
+	}
+    }
+
+    /* Throughput of short-lived requests completed inline */
+    t = MPI_Wtime();
+    for (k=0; k<nLoop*nBatch; k++) {
+	MPI_Grequest_start( query_fn, free_fn, cancel_fn, NULL, &reqs[0] );
+	MPI_Grequest_complete( reqs[0] );
+	MPI_Wait( &reqs[0], MPI_STATUS_IGNORE );
+    }
+    t = MPI_Wtime() - t;
+    nReq += nLoop * nBatch;
+    rateInline = (t > 0) ? (nLoop * nBatch) / t : 0;
+
+    /* Throughput of batches completed by the helper thread */
+    t = MPI_Wtime();
+    for (k=0; k<nLoop; k++) {
+	for (j=0; j<nBatch; j++) {
+	    MPI_Grequest_start( query_fn, free_fn, cancel_fn, NULL, &reqs[j] );
+	}
+	PostToHelper( reqs, nBatch );
+	MPI_Waitall( nBatch, reqs, MPI_STATUSES_IGNORE );
+    }
+    t = MPI_Wtime() - t;
+    nReq += nLoop * nBatch;
+    /* Remove the deliberate helper delay from the rate */
+    t -= nLoop * 1.e-6 * delayUsec;
+    rateBatch = (t > 0) ? (nLoop * nBatch) / t : 0;
+
+    MTest_thread_lock( &lock );
+    quit = 1;
+    MTest_thread_unlock( &lock );
+    MTest_Join_threads();
+    MTest_thread_lock_free( &lock );
+
+    if (nquery != nReq || nfree != nReq) {
+	errs++;
+	fprintf( stderr, "Expected %d callbacks, got query = %d, free = %d\n",
+		 nReq, nquery, nfree );
+    }
+
+    if (verbose && rank == 0) {
+	printf( "Wakeup latency (usec), helper delay %g usec, batch %d\n",
+		delayUsec, nBatch );
+	printf( "case    \t%10s\t%10s\t%10s\t%10s\n",
+		"min", "median", "99%", "max" );
+	PrintDist( "wakeup", wakeup, nLoop );
+	PrintDist( "mixed", mixed, nLoop );
+	printf( "Inline grequests per second  = %e\n", rateInline );
+	printf( "Batched grequests per second = %e\n", rateBatch );
+	fflush( stdout );
+    }
+
+    free( wakeup );
+    free( mixed );
+
+    MTest_Finalize( errs );
+    MPI_Finalize();
+    return 0;
+}
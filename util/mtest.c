@@ -44,6 +44,10 @@
 
 static void MTestRMACleanup( void );
 static void MTestResourceSummary( FILE * );
+static void MTestSetGenDatatypesFromEnv( const char * );
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+static char *MTestSetCvarsFromEnv( const char *, int );
+#endif
 
 /* Here is where we could put the includes and definitions to enable
    memory testing */
@@ -55,6 +59,7 @@ static int returnWithVal = 0;   /* Allow programs to return with a non-zero
 				   if there was an error (may cause problems
 				   with some runtime systems) */
 static int usageOutput = 0;     /* */
+static int checkThreads = 1;    /* Threads used to check large buffers */
 
 /* Provide backward portability to MPI 1 */
 #ifndef MPI_VERSION
@@ -73,6 +78,28 @@ static int usageOutput = 0;     /* */
 
  Environment Variables:
 + MPITEST_DEBUG - If set (to any value), turns on debugging output
+. MPITEST_CHECK_THREADS - The number of threads used to check the data in
+                          very large buffers returned by MTestGetDatatypes
+                          (default 1; needs pthreads).
+. MPITEST_CVARS - A comma-separated list of name=value pairs; each MPI_T
+                  control variable is set to its value (MPI-3 only).  This
+                  permits sweeping implementation parameters across runs
+                  of a test.  The variables are set before MPI is
+                  initialized, since many (such as the ones that select
+                  protocols) cannot be changed afterwards; those that
+                  cannot be set yet (for example, ones bound to a
+                  communicator) are set after.  A variable that cannot be
+                  set at all is reported on stderr by a line that starts
+                  with "MPITEST_CVARS: unable to set".
+. MPITEST_DATATYPE_GEN - The number of generated pairs of datatypes that
+                         MTestGetDatatypes returns after the fixed list
+                         (default 0).  They are built from
+                         MPITEST_DATATYPE_SEED (default 1), with at most
+                         MPITEST_DATATYPE_DEPTH nested constructors
+                         (default 3) and at most MPITEST_DATATYPE_MAXBYTES
+                         bytes in a message (default 65536).  Each pair
+                         uses one basic type unless MPITEST_DATATYPE_MIXED
+                         is set.
 . MPITEST_THREADLEVEL_DEFAULT - If set, use as the default "provided"
                                 level of thread support.  Applies to 
                                 MTest_Init but not MTest_Init_thread.
@@ -84,8 +111,24 @@ void MTest_Init_thread( int *argc, char ***argv, int required, int *provided )
 {
     int flag;
     char *envval = 0;
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+    char *cvars, *cvarsLeft = 0;
+    int  tprovided, tinit = 0;
+#endif
 
     MPI_Initialized( &flag );
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+    /* Set control variables.  MPI_T stays initialized until after
+       MPI_Init_thread, since an implementation may discard the values
+       when MPI_T is finalized before MPI is initialized. */
+    cvars = getenv( "MPITEST_CVARS" );
+    if (cvars && !flag &&
+	MPI_T_init_thread( MPI_THREAD_SINGLE, &tprovided ) == MPI_SUCCESS) {
+	tinit     = 1;
+	cvarsLeft = MTestSetCvarsFromEnv( cvars, 0 );
+	cvars     = cvarsLeft;
+    }
+#endif
     if (!flag) {
 	/* Permit an MPI that claims only MPI 1 but includes the 
 	   MPI_Init_thread routine (e.g., IBM MPI) */
@@ -151,6 +194,32 @@ void MTest_Init_thread( int *argc, char ***argv, int required, int *provided )
     if (getenv( "MPITEST_RUSAGE" )) {
 	usageOutput = 1;
     }
+
+    envval = getenv( "MPITEST_CHECK_THREADS" );
+    if (envval) {
+	checkThreads = atoi( envval );
+	if (checkThreads < 1 || checkThreads > 256) {
+	    fprintf( stderr, "Warning: %s not valid for MPITEST_CHECK_THREADS\n",
+		     envval );
+	    fflush( stderr );
+	    checkThreads = 1;
+	}
+    }
+
+    /* Generated datatypes */
+    envval = getenv( "MPITEST_DATATYPE_GEN" );
+    if (envval) {
+	MTestSetGenDatatypesFromEnv( envval );
+    }
+
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+    /* Set the control variables that could not be set before MPI_Init */
+    if (cvars) {
+	MTestSetCvarsFromEnv( cvars, 1 );
+    }
+    if (cvarsLeft) free( cvarsLeft );
+    if (tinit) MPI_T_finalize();
+#endif
 }
 /* 
  * Initialize the tests, using an MPI-1 style init.  Supports 
@@ -256,6 +325,613 @@ void MTestSleep( int sec )
 }
 #endif
 
+/*
+ * MTestSpin( seconds ) waits by polling MPI_Wtime, so that a benchmark can
+ * delay a process by a short, accurately known time (well below the
+ * resolution of MTestSleep).
+ *
+ * MTestSortDouble( n, values ) sorts the n values in place into increasing
+ * order, for percentiles of a set of timings.
+ *
+ * MTestMedian( n, values ) sorts the n values in place and returns the
+ * median (the upper one for even n).
+ */
+void MTestSpin( double sec )
+{
+    double t0 = MPI_Wtime();
+    while (MPI_Wtime() - t0 < sec) ;
+}
+
+static int MTestCompareDouble( const void *a, const void *b )
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x < y) ? -1 : (x > y);
+}
+
+void MTestSortDouble( int n, double *values )
+{
+    qsort( values, n, sizeof(double), MTestCompareDouble );
+}
+
+double MTestMedian( int n, double *values )
+{
+    MTestSortDouble( n, values );
+    return values[n / 2];
+}
+
+/*
+ * Clock offsets
+ *
+ * MTestGetClockOffset( comm, npings, &offset, &err ) estimates the
+ * difference between the MPI_Wtime clock of the calling process and that
+ * of process 0 in comm, so that a benchmark can convert its timestamps to
+ * the clock of process 0 with
+ *     t0 = MPI_Wtime() - offset
+ * Process 0 exchanges npings messages with each other process in turn,
+ * and the exchange with the shortest round trip gives the estimate (the
+ * remote time is assumed to be read halfway through the round trip).  err
+ * is half of that round trip, a bound on the error of the estimate.  On
+ * process 0, offset and err are zero.  This routine is collective over
+ * comm; the messages are exchanged on a duplicate of comm.
+ */
+#define MTEST_CLOCK_TAG 32767
+int MTestGetClockOffset( MPI_Comm comm, int npings, double *offset,
+			 double *err )
+{
+    int      rank, size, r, i, merr;
+    double   t0, t1, tremote, rtt, best[2], dummy = 0;
+    MPI_Comm dupcomm;
+
+    /* Exchange on a private communicator, so that the messages cannot
+       match messages of the caller that are pending on comm */
+    merr = MPI_Comm_dup( comm, &dupcomm );
+    if (merr) MTestPrintError( merr );
+    comm = dupcomm;
+    merr = MPI_Comm_rank( comm, &rank );
+    if (merr) MTestPrintError( merr );
+    merr = MPI_Comm_size( comm, &size );
+    if (merr) MTestPrintError( merr );
+    if (npings < 1) npings = 1;
+
+    *offset = 0.0;
+    *err    = 0.0;
+    if (rank == 0) {
+	for (r=1; r<size; r++) {
+	    best[0] = 0.0;
+	    best[1] = 1.e20;
+	    for (i=0; i<npings; i++) {
+		t0 = MPI_Wtime();
+		merr = MPI_Send( &dummy, 1, MPI_DOUBLE, r, MTEST_CLOCK_TAG,
+				 comm );
+		if (merr) MTestPrintError( merr );
+		merr = MPI_Recv( &tremote, 1, MPI_DOUBLE, r, MTEST_CLOCK_TAG,
+				 comm, MPI_STATUS_IGNORE );
+		if (merr) MTestPrintError( merr );
+		t1  = MPI_Wtime();
+		rtt = t1 - t0;
+		if (rtt < 2 * best[1]) {
+		    best[0] = tremote - 0.5 * (t0 + t1);
+		    best[1] = 0.5 * rtt;
+		}
+	    }
+	    merr = MPI_Send( best, 2, MPI_DOUBLE, r, MTEST_CLOCK_TAG, comm );
+	    if (merr) MTestPrintError( merr );
+	}
+    }
+    else {
+	for (i=0; i<npings; i++) {
+	    merr = MPI_Recv( &dummy, 1, MPI_DOUBLE, 0, MTEST_CLOCK_TAG,
+			     comm, MPI_STATUS_IGNORE );
+	    if (merr) MTestPrintError( merr );
+	    tremote = MPI_Wtime();
+	    merr = MPI_Send( &tremote, 1, MPI_DOUBLE, 0, MTEST_CLOCK_TAG,
+			     comm );
+	    if (merr) MTestPrintError( merr );
+	}
+	merr = MPI_Recv( best, 2, MPI_DOUBLE, 0, MTEST_CLOCK_TAG, comm,
+			 MPI_STATUS_IGNORE );
+	if (merr) MTestPrintError( merr );
+	*offset = best[0];
+	*err    = best[1];
+    }
+    merr = MPI_Comm_free( &dupcomm );
+    if (merr) MTestPrintError( merr );
+    return 0;
+}
+
+/*
+ * MPI_T performance and control variables
+ *
+ * A performance variable set is an MPI_T pvar session with a handle for
+ * every performance variable that is not bound to an object or is bound
+ * to a communicator (bound to the communicator given when the set is
+ * created) and that has an integer or double type.  A variable with
+ * several values (for example, one per process in the communicator) is
+ * represented by their sum.  If MPITEST_PVARS is set to a comma-separated
+ * list of strings, only the variables whose names contain one of them are
+ * used (some implementations fail when a handle is allocated for a
+ * variable of a component that is not in use).  A test calls
+ * MTestPvarStartSample before and MTestPvarEndSample after the region of
+ * interest, then prints the values with MTestPvarPrintDeltas or looks up
+ * the change in one variable with MTestPvarGetDelta.  Values are
+ * converted to double.
+ *
+ * MTestCvarWrite and MTestCvarRead access a control variable by name,
+ * with the value as a string.  Only variables that are not bound to an
+ * object or are bound to a communicator (MPI_COMM_WORLD is used, so these
+ * need MPI to be initialized) are supported.  Variables with scope
+ * MPI_T_SCOPE_CONSTANT or MPI_T_SCOPE_READONLY cannot be written, and an
+ * implementation may refuse to change others once MPI is initialized.
+ * These routines return 0 on success and an MPI_T error code (or -1 if
+ * the variable is not found or cannot be written) otherwise.
+ */
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+#define MTEST_T_NAME_LEN 256
+struct _MTestPvarSet {
+    MPI_T_pvar_session session;
+    int                n;
+    MPI_T_pvar_handle  *handles;
+    char               **names;
+    int                *varClass, *continuous, *counts;
+    MPI_Datatype       *dtypes;
+    double             *start, *end;
+    void               *buf;      /* large enough for any variable */
+    int                maxCount;
+};
+
+static const char *MTestPvarClassName( int varClass )
+{
+    switch (varClass) {
+    case MPI_T_PVAR_CLASS_STATE:         return "state";
+    case MPI_T_PVAR_CLASS_LEVEL:         return "level";
+    case MPI_T_PVAR_CLASS_SIZE:          return "size";
+    case MPI_T_PVAR_CLASS_PERCENTAGE:    return "percent";
+    case MPI_T_PVAR_CLASS_HIGHWATERMARK: return "highwater";
+    case MPI_T_PVAR_CLASS_LOWWATERMARK:  return "lowwater";
+    case MPI_T_PVAR_CLASS_COUNTER:       return "counter";
+    case MPI_T_PVAR_CLASS_AGGREGATE:     return "aggregate";
+    case MPI_T_PVAR_CLASS_TIMER:         return "timer";
+    case MPI_T_PVAR_CLASS_GENERIC:       return "generic";
+    default:                             return "unknown";
+    }
+}
+
+/* Return true if name contains one of the comma-separated strings in
+   select */
+static int MTestNameSelected( const char *name, const char *select )
+{
+    const char *p = select, *end;
+    size_t     len;
+
+    while (*p) {
+	end = strchr( p, ',' );
+	len = end ? (size_t)(end - p) : strlen( p );
+	if (len > 0) {
+	    const char *n;
+	    for (n = name; *n; n++) {
+		if (strncmp( n, p, len ) == 0) return 1;
+	    }
+	}
+	if (!end) break;
+	p = end + 1;
+    }
+    return 0;
+}
+
+/* Read variable i of set as a double, summing its values */
+static int MTestPvarRead( MTestPvarSet *set, int i, double *value )
+{
+    MPI_Datatype dtype = set->dtypes[i];
+    int          j, merr;
+
+    merr = MPI_T_pvar_read( set->session, set->handles[i], set->buf );
+    if (merr) return merr;
+    *value = 0;
+    for (j=0; j<set->counts[i]; j++) {
+	if (dtype == MPI_INT)
+	    *value += ((int *)set->buf)[j];
+	else if (dtype == MPI_UNSIGNED)
+	    *value += ((unsigned *)set->buf)[j];
+	else if (dtype == MPI_UNSIGNED_LONG)
+	    *value += (double)((unsigned long *)set->buf)[j];
+	else if (dtype == MPI_UNSIGNED_LONG_LONG)
+	    *value += (double)((unsigned long long *)set->buf)[j];
+	else if (dtype == MPI_COUNT)
+	    *value += (double)((MPI_Count *)set->buf)[j];
+	else if (dtype == MPI_DOUBLE)
+	    *value += ((double *)set->buf)[j];
+    }
+    return 0;
+}
+
+/* Free the arrays of set and set itself */
+static void MTestPvarSetFreeArrays( MTestPvarSet *set )
+{
+    free( set->handles );
+    free( set->names );
+    free( set->varClass );
+    free( set->continuous );
+    free( set->counts );
+    free( set->dtypes );
+    free( set->buf );
+    free( set->start );
+    free( set->end );
+    free( set );
+}
+
+int MTestPvarSessionCreate( MPI_Comm comm, MTestPvarSet **pset )
+{
+    MTestPvarSet      *set;
+    MPI_T_enum        enumtype;
+    MPI_T_pvar_handle handle;
+    MPI_Datatype      dtype;
+    char              name[MTEST_T_NAME_LEN], desc[MTEST_T_NAME_LEN];
+    int               merr, provided, num, i, nameLen, descLen, verbosity;
+    int               varClass, bind, readonly, continuous, atomic, count;
+    const char        *select;
+
+    *pset = 0;
+    select = getenv( "MPITEST_PVARS" );
+    merr = MPI_T_init_thread( MPI_THREAD_SINGLE, &provided );
+    if (merr) return merr;
+    merr = MPI_T_pvar_get_num( &num );
+    if (merr) {
+	MPI_T_finalize();
+	return merr;
+    }
+
+    set = (MTestPvarSet *)calloc( 1, sizeof(MTestPvarSet) );
+    if (!set) {
+	MTestError( "Unable to allocate pvar set" );
+    }
+    if (num > 0) {
+	set->handles    = (MPI_T_pvar_handle *)malloc( num *
+						sizeof(MPI_T_pvar_handle) );
+	set->names      = (char **)malloc( num * sizeof(char *) );
+	set->varClass   = (int *)malloc( num * sizeof(int) );
+	set->continuous = (int *)malloc( num * sizeof(int) );
+	set->counts     = (int *)malloc( num * sizeof(int) );
+	set->dtypes     = (MPI_Datatype *)malloc( num * sizeof(MPI_Datatype) );
+	set->start      = (double *)calloc( num, sizeof(double) );
+	set->end        = (double *)calloc( num, sizeof(double) );
+	if (!set->handles || !set->names || !set->varClass ||
+	    !set->continuous || !set->counts || !set->dtypes || !set->start ||
+	    !set->end) {
+	    MTestError( "Unable to allocate pvar set" );
+	}
+    }
+    merr = MPI_T_pvar_session_create( &set->session );
+    if (merr) {
+	MTestPvarSetFreeArrays( set );
+	MPI_T_finalize();
+	return merr;
+    }
+
+    for (i=0; i<num; i++) {
+	nameLen = descLen = MTEST_T_NAME_LEN;
+	merr = MPI_T_pvar_get_info( i, name, &nameLen, &verbosity, &varClass,
+				    &dtype, &enumtype, desc, &descLen, &bind,
+				    &readonly, &continuous, &atomic );
+	if (merr) continue;
+	if (bind != MPI_T_BIND_NO_OBJECT && bind != MPI_T_BIND_MPI_COMM)
+	    continue;
+	if (select && !MTestNameSelected( name, select )) continue;
+	merr = MPI_T_pvar_handle_alloc( set->session, i,
+				bind == MPI_T_BIND_MPI_COMM ? &comm : NULL,
+				&handle, &count );
+	if (merr) continue;
+	/* Only the basic integer and double types */
+	if (count < 1 ||
+	    (dtype != MPI_INT && dtype != MPI_UNSIGNED &&
+	     dtype != MPI_UNSIGNED_LONG && dtype != MPI_UNSIGNED_LONG_LONG &&
+	     dtype != MPI_COUNT && dtype != MPI_DOUBLE)) {
+	    MPI_T_pvar_handle_free( set->session, &handle );
+	    continue;
+	}
+	if (!continuous &&
+	    MPI_T_pvar_start( set->session, handle ) != MPI_SUCCESS) {
+	    MPI_T_pvar_handle_free( set->session, &handle );
+	    continue;
+	}
+	set->handles[set->n]    = handle;
+	set->names[set->n]      = strdup( name );
+	set->varClass[set->n]   = varClass;
+	set->continuous[set->n] = continuous;
+	set->counts[set->n]     = count;
+	set->dtypes[set->n]     = dtype;
+	if (count > set->maxCount) set->maxCount = count;
+	set->n++;
+    }
+    /* Every supported type fits in a double or an MPI_Count */
+    set->buf = malloc( (set->maxCount > 0 ? set->maxCount : 1) *
+		       (sizeof(double) > sizeof(MPI_Count) ?
+			sizeof(double) : sizeof(MPI_Count)) );
+    if (!set->buf) {
+	MTestError( "Unable to allocate pvar buffer" );
+    }
+    *pset = set;
+    return 0;
+}
+
+static int MTestPvarSample( MTestPvarSet *set, double *values )
+{
+    int i, merr, err = 0;
+
+    for (i=0; i<set->n; i++) {
+	merr = MTestPvarRead( set, i, &values[i] );
+	if (merr) err = merr;
+    }
+    return err;
+}
+
+int MTestPvarStartSample( MTestPvarSet *set )
+{
+    return MTestPvarSample( set, set->start );
+}
+
+int MTestPvarEndSample( MTestPvarSet *set )
+{
+    return MTestPvarSample( set, set->end );
+}
+
+int MTestPvarGetNum( MTestPvarSet *set )
+{
+    return set->n;
+}
+
+int MTestPvarGetDelta( MTestPvarSet *set, const char *name, double *delta )
+{
+    int i;
+
+    for (i=0; i<set->n; i++) {
+	if (strcmp( set->names[i], name ) == 0) {
+	    *delta = set->end[i] - set->start[i];
+	    return 0;
+	}
+    }
+    return -1;
+}
+
+/* Print the start and end values and the change in each variable.  If
+   onlyChanged is true, variables whose value did not change are
+   skipped */
+void MTestPvarPrintDeltas( MTestPvarSet *set, int onlyChanged )
+{
+    int i;
+
+    for (i=0; i<set->n; i++) {
+	if (onlyChanged && set->end[i] == set->start[i]) continue;
+	printf( "%-40s %-10s %14.6g %14.6g %14.6g\n", set->names[i],
+		MTestPvarClassName( set->varClass[i] ), set->start[i],
+		set->end[i], set->end[i] - set->start[i] );
+    }
+    fflush( stdout );
+}
+
+void MTestPvarSessionFree( MTestPvarSet **pset )
+{
+    MTestPvarSet *set = *pset;
+    int          i;
+
+    if (!set) return;
+    for (i=0; i<set->n; i++) {
+	if (!set->continuous[i])
+	    MPI_T_pvar_stop( set->session, set->handles[i] );
+	MPI_T_pvar_handle_free( set->session, &set->handles[i] );
+	free( set->names[i] );
+    }
+    MPI_T_pvar_session_free( &set->session );
+    MPI_T_finalize();
+    MTestPvarSetFreeArrays( set );
+    *pset = 0;
+}
+
+/* Find a control variable and allocate a handle for it.  MPI_T must
+   be initialized; a variable bound to a communicator is only found once
+   MPI is initialized */
+static int MTestCvarFind( const char *name, MPI_T_cvar_handle *handle,
+			  MPI_Datatype *dtype, int *scope )
+{
+    MPI_T_enum enumtype;
+    MPI_Comm   comm = MPI_COMM_WORLD;
+    char       cname[MTEST_T_NAME_LEN], desc[MTEST_T_NAME_LEN];
+    int        merr, num, i, nameLen, descLen, verbosity, bind, count;
+    int        mpiInit;
+
+    merr = MPI_T_cvar_get_num( &num );
+    if (merr) return merr;
+    for (i=0; i<num; i++) {
+	nameLen = descLen = MTEST_T_NAME_LEN;
+	merr = MPI_T_cvar_get_info( i, cname, &nameLen, &verbosity, dtype,
+				    &enumtype, desc, &descLen, &bind, scope );
+	if (merr || strcmp( cname, name ) != 0) continue;
+	if (bind != MPI_T_BIND_NO_OBJECT && bind != MPI_T_BIND_MPI_COMM)
+	    return -1;
+	MPI_Initialized( &mpiInit );
+	if (bind == MPI_T_BIND_MPI_COMM && !mpiInit) return -1;
+	merr = MPI_T_cvar_handle_alloc( i,
+				bind == MPI_T_BIND_MPI_COMM ? &comm : NULL,
+				handle, &count );
+	if (merr) return merr;
+	if ((*dtype == MPI_CHAR && count > MTEST_T_NAME_LEN) ||
+	    (*dtype != MPI_CHAR && count != 1)) {
+	    MPI_T_cvar_handle_free( handle );
+	    return -1;
+	}
+	return 0;
+    }
+    return -1;
+}
+
+int MTestCvarWrite( const char *name, const char *value )
+{
+    MPI_T_cvar_handle handle;
+    MPI_Datatype      dtype;
+    union {
+	int                ival;
+	unsigned           uval;
+	unsigned long      ulval;
+	unsigned long long ullval;
+	MPI_Count          cval;
+	double             dval;
+#ifdef HAVE__BOOL
+	_Bool              bval;
+#endif
+    } buf;
+    const void *ptr = &buf;
+    int        merr, provided, scope;
+
+    merr = MPI_T_init_thread( MPI_THREAD_SINGLE, &provided );
+    if (merr) return merr;
+    merr = MTestCvarFind( name, &handle, &dtype, &scope );
+    if (merr) {
+	MPI_T_finalize();
+	return merr;
+    }
+    if (scope == MPI_T_SCOPE_CONSTANT || scope == MPI_T_SCOPE_READONLY) {
+	merr = -1;
+    }
+    else {
+	if (dtype == MPI_INT)
+	    buf.ival = atoi( value );
+	else if (dtype == MPI_UNSIGNED)
+	    buf.uval = strtoul( value, 0, 0 );
+	else if (dtype == MPI_UNSIGNED_LONG)
+	    buf.ulval = strtoul( value, 0, 0 );
+	else if (dtype == MPI_UNSIGNED_LONG_LONG)
+	    buf.ullval = strtoull( value, 0, 0 );
+	else if (dtype == MPI_COUNT)
+	    buf.cval = strtoll( value, 0, 0 );
+	else if (dtype == MPI_DOUBLE)
+	    buf.dval = strtod( value, 0 );
+	else if (dtype == MPI_CHAR)
+	    ptr = value;
+#ifdef HAVE__BOOL
+	else if (dtype == MPI_C_BOOL)
+	    buf.bval = atoi( value ) != 0;
+#endif
+	else
+	    merr = -1;
+	if (!merr) merr = MPI_T_cvar_write( handle, ptr );
+    }
+    MPI_T_cvar_handle_free( &handle );
+    MPI_T_finalize();
+    return merr;
+}
+
+int MTestCvarRead( const char *name, char *value, int len )
+{
+    MPI_T_cvar_handle handle;
+    MPI_Datatype      dtype;
+    union {
+	int                ival;
+	unsigned           uval;
+	unsigned long      ulval;
+	unsigned long long ullval;
+	MPI_Count          cval;
+	double             dval;
+#ifdef HAVE__BOOL
+	_Bool              bval;
+#endif
+	char               str[MTEST_T_NAME_LEN];
+    } buf;
+    char str[MTEST_T_NAME_LEN];
+    int  merr, provided, scope;
+
+    merr = MPI_T_init_thread( MPI_THREAD_SINGLE, &provided );
+    if (merr) return merr;
+    merr = MTestCvarFind( name, &handle, &dtype, &scope );
+    if (merr) {
+	MPI_T_finalize();
+	return merr;
+    }
+    merr = MPI_T_cvar_read( handle, &buf );
+    if (!merr) {
+	if (dtype == MPI_INT)
+	    sprintf( str, "%d", buf.ival );
+	else if (dtype == MPI_UNSIGNED)
+	    sprintf( str, "%u", buf.uval );
+	else if (dtype == MPI_UNSIGNED_LONG)
+	    sprintf( str, "%lu", buf.ulval );
+	else if (dtype == MPI_UNSIGNED_LONG_LONG)
+	    sprintf( str, "%llu", buf.ullval );
+	else if (dtype == MPI_COUNT)
+	    sprintf( str, "%lld", (long long)buf.cval );
+	else if (dtype == MPI_DOUBLE)
+	    sprintf( str, "%g", buf.dval );
+	else if (dtype == MPI_CHAR) {
+	    buf.str[MTEST_T_NAME_LEN-1] = 0;
+	    strcpy( str, buf.str );
+	}
+#ifdef HAVE__BOOL
+	else if (dtype == MPI_C_BOOL)
+	    sprintf( str, "%d", buf.bval ? 1 : 0 );
+#endif
+	else
+	    merr = -1;
+    }
+    if (!merr && len > 0) {
+	strncpy( value, str, len );
+	value[len-1] = 0;
+    }
+    MPI_T_cvar_handle_free( &handle );
+    MPI_T_finalize();
+    return merr;
+}
+
+/* Set the control variables in MPITEST_CVARS ("name=value,name=value").
+   If report is false, return a list in the same form of the items that
+   could not be set (or null if all were), to be tried again once MPI is
+   initialized; otherwise report them from process 0 */
+static char *MTestSetCvarsFromEnv( const char *envval, int report )
+{
+    char *list, *item, *eq, *next, *left;
+    int  rank = 0, merr = 0, flag;
+
+    MPI_Initialized( &flag );
+    if (flag) MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    list = strdup( envval );
+    left = (char *)malloc( strlen( envval ) + 1 );
+    if (!list || !left) {
+	fprintf( stderr, "MPITEST_CVARS: unable to set %s (no memory)\n",
+		 envval );
+	if (list) free( list );
+	if (left) free( left );
+	return 0;
+    }
+    left[0] = 0;
+    for (item = list; item && *item; item = next) {
+	next = strchr( item, ',' );
+	if (next) *next++ = 0;
+	eq = strchr( item, '=' );
+	if (eq) {
+	    *eq  = 0;
+	    merr = MTestCvarWrite( item, eq + 1 );
+	    if (!merr) continue;
+	}
+	if (!report) {
+	    if (left[0]) strcat( left, "," );
+	    if (eq) *eq = '=';
+	    strcat( left, item );
+	}
+	else if (rank == 0 && !eq) {
+	    fprintf( stderr, "Warning: %s not valid in MPITEST_CVARS\n", item );
+	}
+	else if (rank == 0) {
+	    fprintf( stderr, "MPITEST_CVARS: unable to set %s to %s (%d)\n",
+		     item, eq + 1, merr );
+	}
+    }
+    fflush( stderr );
+    free( list );
+    if (!left[0]) {
+	free( left );
+	left = 0;
+    }
+    return left;
+}
+#endif
+
 /*
  * Datatypes
  *
@@ -276,9 +952,152 @@ void MTestSleep( int sec )
  *    Vector   - Simple strided "vector" type
  *    Indexed  - Indexed datatype.  Only for a count of 1 instance of the 
  *               datatype
+ *    Gen      - Any of the generated datatypes (see below)
  */
 static int datatype_index = 0;
 
+/* ------------------------------------------------------------------------ */
+/* Filling and checking the data pattern                                    */
+/* ------------------------------------------------------------------------ */
+/*
+ * The k-th byte of a message is 0xff ^ (k & 0xff), so the pattern repeats
+ * every 256 bytes.  Rather than compute it a byte at a time, the routines
+ * below copy it from a table and compare against the table with memcpy and
+ * memcmp, which work a word (or vector register) at a time.  Only when a
+ * block of the buffer differs from the table is that block examined byte
+ * by byte, so the cost of a correct buffer is close to that of a memcmp.
+ *
+ * With MPITEST_CHECK_THREADS=n, the search for a mismatch in buffers of at
+ * least MTEST_PATTERN_MT_MIN bytes is split among n threads (only if the
+ * tests are built with pthreads).  The threads only find the first byte
+ * that is wrong; the errors themselves are counted and printed by the
+ * calling thread, in order, as before.
+ */
+#define MTEST_PATTERN_CHUNK  4096
+#define MTEST_PATTERN_MT_MIN (64 * 1024 * 1024)
+static unsigned char mtestPattern[MTEST_PATTERN_CHUNK + 256];
+static unsigned char mtestOnes[MTEST_PATTERN_CHUNK];
+static int mtestPatternReady = 0;
+
+static void MTestPatternSetup( void )
+{
+    int i;
+    for (i=0; i<MTEST_PATTERN_CHUNK + 256; i++) {
+	mtestPattern[i] = 0xff ^ (i & 0xff);
+    }
+    memset( mtestOnes, 0xff, MTEST_PATTERN_CHUNK );
+    mtestPatternReady = 1;
+}
+
+/* Set p[i] to the byte k+i of the message, for 0 <= i < n */
+static void MTestPatternFill( unsigned char *p, MPI_Aint k, MPI_Aint n )
+{
+    MPI_Aint len, i;
+
+    if (n <= 0) return;
+    if (!mtestPatternReady) MTestPatternSetup();
+    len = (n < MTEST_PATTERN_CHUNK) ? n : MTEST_PATTERN_CHUNK;
+    memcpy( p, mtestPattern + (k & 0xff), len );
+    /* The first len bytes are a whole number of periods; copy them, and
+       then the growing prefix, over the rest of the buffer */
+    for (i=len; i<n; ) {
+	if (len > n - i) len = n - i;
+	memcpy( p + i, p, len );
+	i += len;
+	if (len < i && i <= 1024 * 1024) len = i;
+    }
+}
+
+/* Return the index of the first byte of p[0..n-1] that is not byte k+i of
+   the message, or n if there is none */
+static MPI_Aint MTestPatternScan( const unsigned char *p, MPI_Aint k,
+				  MPI_Aint n )
+{
+    MPI_Aint i, len, j;
+
+    if (!mtestPatternReady) MTestPatternSetup();
+    for (i=0; i<n; i+=len) {
+	len = (n - i < MTEST_PATTERN_CHUNK) ? n - i : MTEST_PATTERN_CHUNK;
+	if (memcmp( p + i, mtestPattern + ((k + i) & 0xff), len ) != 0) {
+	    for (j=0; j<len; j++) {
+		if (p[i+j] != (unsigned char)(0xff ^ ((k + i + j) & 0xff)))
+		    return i + j;
+	    }
+	}
+    }
+    return n;
+}
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#include <pthread.h>
+#define MTEST_HAVE_CHECK_THREADS 1
+typedef struct {
+    const unsigned char *p;
+    MPI_Aint k, n, first;
+} MTestScanPart;
+
+static void *MTestPatternScanThread( void *arg )
+{
+    MTestScanPart *part = (MTestScanPart *)arg;
+    part->first = MTestPatternScan( part->p, part->k, part->n );
+    return 0;
+}
+#endif
+
+/* As MTestPatternScan, but with up to checkThreads threads for large
+   buffers */
+static MPI_Aint MTestPatternMismatch( const unsigned char *p, MPI_Aint k,
+				      MPI_Aint n )
+{
+#ifdef MTEST_HAVE_CHECK_THREADS
+    MTestScanPart *parts;
+    pthread_t     *threads;
+    int           nt = checkThreads, t, *started;
+    MPI_Aint      seg, first = n;
+
+    if (nt <= 1 || n < MTEST_PATTERN_MT_MIN) {
+	return MTestPatternScan( p, k, n );
+    }
+    if (!mtestPatternReady) MTestPatternSetup();
+    parts   = (MTestScanPart *)malloc( nt * sizeof(MTestScanPart) );
+    threads = (pthread_t *)malloc( nt * sizeof(pthread_t) );
+    started = (int *)malloc( nt * sizeof(int) );
+    if (!parts || !threads || !started) {
+	MTestError( "Out of memory in type buffer check" );
+    }
+    seg = (n + nt - 1) / nt;
+    for (t=0; t<nt; t++) {
+	parts[t].p = p + t * seg;
+	parts[t].k = k + t * seg;
+	parts[t].n = (t * seg >= n) ? 0 :
+	    ((n - t * seg < seg) ? n - t * seg : seg);
+	/* The calling thread does the first part */
+	started[t] = (t > 0 && pthread_create( &threads[t], 0,
+				  MTestPatternScanThread, &parts[t] ) == 0);
+    }
+    for (t=0; t<nt; t++) {
+	if (t == 0 || !started[t]) {
+	    MTestPatternScanThread( &parts[t] );
+	}
+	else {
+	    pthread_join( threads[t], 0 );
+	}
+    }
+    for (t=0; t<nt; t++) {
+	if (parts[t].first < parts[t].n) {
+	    first = t * seg + parts[t].first;
+	    break;
+	}
+    }
+    free( parts );
+    free( threads );
+    free( started );
+    return first;
+#else
+    return MTestPatternScan( p, k, n );
+#endif
+}
+
 /* ------------------------------------------------------------------------ */
 /* Datatype routines for contiguous datatypes                               */
 /* ------------------------------------------------------------------------ */
@@ -291,22 +1110,20 @@ static void *MTestTypeContigInit( MTestDatatype *mtype )
     int merr;
 
     if (mtype->count > 0) {
-	signed char *p;
-	int  i, totsize;
+	unsigned char *p;
+	MPI_Aint totsize;
 	merr = MPI_Type_extent( mtype->datatype, &size );
 	if (merr) MTestPrintError( merr );
 	totsize = size * mtype->count;
 	if (!mtype->buf) {
 	    mtype->buf = (void *) malloc( totsize );
 	}
-	p = (signed char *)(mtype->buf);
+	p = (unsigned char *)(mtype->buf);
 	if (!p) {
 	    /* Error - out of memory */
 	    MTestError( "Out of memory in type buffer init" );
 	}
-	for (i=0; i<totsize; i++) {
-	    p[i] = 0xff ^ (i & 0xff);
-	}
+	MTestPatternFill( p, 0, totsize );
     }
     else {
 	if (mtype->buf) {
@@ -328,7 +1145,7 @@ static void *MTestTypeContigInitRecv( MTestDatatype *mtype )
 
     if (mtype->count > 0) {
 	signed char *p;
-	int  i, totsize;
+	MPI_Aint totsize;
 	merr = MPI_Type_extent( mtype->datatype, &size );
 	if (merr) MTestPrintError( merr );
 	totsize = size * mtype->count;
@@ -340,9 +1157,7 @@ static void *MTestTypeContigInitRecv( MTestDatatype *mtype )
 	    /* Error - out of memory */
 	    MTestError( "Out of memory in type buffer init" );
 	}
-	for (i=0; i<totsize; i++) {
-	    p[i] = 0xff;
-	}
+	memset( p, 0xff, totsize );
     }
     else {
 	if (mtype->buf) {
@@ -364,23 +1179,23 @@ static int MTestTypeContigCheckbuf( MTestDatatype *mtype )
 {
     unsigned char *p;
     unsigned char expected;
-    int  i, totsize, err = 0, merr;
-    MPI_Aint size;
+    int  err = 0, merr;
+    MPI_Aint i, size, totsize;
 
     p = (unsigned char *)mtype->buf;
     if (p) {
 	merr = MPI_Type_extent( mtype->datatype, &size );
 	if (merr) MTestPrintError( merr );
 	totsize = size * mtype->count;
-	for (i=0; i<totsize; i++) {
+	/* Skip to each byte that is wrong */
+	for (i = MTestPatternMismatch( p, 0, totsize ); i<totsize;
+	     i += 1 + MTestPatternScan( p + i + 1, i + 1, totsize - i - 1 )) {
 	    expected = (0xff ^ (i & 0xff));
-	    if (p[i] != expected) {
-		err++;
-		if (mtype->printErrors && err < 10) {
-		    printf( "Data expected = %x but got p[%d] = %x\n",
-			    expected, i, p[i] );
-		    fflush( stdout );
-		}
+	    err++;
+	    if (mtype->printErrors && err < 10) {
+		printf( "Data expected = %x but got p[%ld] = %x\n",
+			expected, (long)i, p[i] );
+		fflush( stdout );
 	    }
 	}
     }
@@ -398,7 +1213,8 @@ static void *MTestTypeVectorInit( MTestDatatype *mtype )
 
     if (mtype->count > 0) {
 	unsigned char *p;
-	int  i, j, k, nc, totsize;
+	int  i, k;
+	MPI_Aint nc, totsize;
 
 	merr = MPI_Type_extent( mtype->datatype, &size );
 	if (merr) MTestPrintError( merr );
@@ -413,21 +1229,18 @@ static void *MTestTypeVectorInit( MTestDatatype *mtype )
 	}
 
 	/* First, set to -1 */
-	for (i=0; i<totsize; i++) p[i] = 0xff;
+	memset( p, 0xff, totsize );
 
-	/* Now, set the actual elements to the successive values.
-	   To do this, we need to run 3 loops */
+	/* Now, set the actual elements to the successive values, a block
+	   at a time */
 	nc = 0;
 	/* count is usually one for a vector type */
 	for (k=0; k<mtype->count; k++) {
 	    /* For each element (block) */
 	    for (i=0; i<mtype->nelm; i++) {
-		/* For each value */
-		for (j=0; j<mtype->blksize; j++) {
-		    p[j] = (0xff ^ (nc & 0xff));
-		    nc++;
-		}
-		p += mtype->stride;
+		MTestPatternFill( p, nc, mtype->blksize );
+		nc += mtype->blksize;
+		p  += mtype->stride;
 	    }
 	}
     }
@@ -462,8 +1275,8 @@ static void *MTestTypeIndexedInit( MTestDatatype *mtype )
 	MTestError( "This datatype is supported only for a single count" );
     }
     if (mtype->count == 1) {
-	signed char *p;
-	int  i, k, offset, j;
+	unsigned char *p;
+	int  i, k, offset, len;
 
 	/* Allocate the send/recv buffer */
 	merr = MPI_Type_extent( mtype->datatype, &totsize );
@@ -471,28 +1284,24 @@ static void *MTestTypeIndexedInit( MTestDatatype *mtype )
 	if (!mtype->buf) {
 	    mtype->buf = (void *) malloc( totsize );
 	}
-	p = (signed char *)(mtype->buf);
+	p = (unsigned char *)(mtype->buf);
 	if (!p) {
 	    MTestError( "Out of memory in type buffer init\n" );
 	}
 	/* Initialize the elements */
 	/* First, set to -1 */
-	for (i=0; i<totsize; i++) p[i] = 0xff;
+	memset( p, 0xff, totsize );
 
 	/* Now, set the actual elements to the successive values.
-	   We require that the base type is a contiguous type */
+	   We require that the base type is a contiguous type, so that
+	   each block is contiguous */
 	k = 0;
 	for (i=0; i<mtype->nelm; i++) {
-	    int b;
 	    /* Compute the offset: */
 	    offset = mtype->displs[i] * mtype->basesize;
-	    /* For each element in the block */
-	    for (b=0; b<mtype->index[i]; b++) {
-		for (j=0; j<mtype->basesize; j++) {
-		    p[offset+j] = 0xff ^ (k++ & 0xff);
-		}
-		offset += mtype->basesize;
-	    }
+	    len    = mtype->index[i] * mtype->basesize;
+	    MTestPatternFill( p + offset, k, len );
+	    k += len;
 	}
     }
     else {
@@ -519,7 +1328,6 @@ static void *MTestTypeIndexedInitRecv( MTestDatatype *mtype )
     }
     if (mtype->count == 1) {
 	signed char *p;
-	int  i;
 	merr = MPI_Type_extent( mtype->datatype, &totsize );
 	if (merr) MTestPrintError( merr );
 	if (!mtype->buf) {
@@ -530,9 +1338,7 @@ static void *MTestTypeIndexedInitRecv( MTestDatatype *mtype )
 	    /* Error - out of memory */
 	    MTestError( "Out of memory in type buffer init\n" );
 	}
-	for (i=0; i<totsize; i++) {
-	    p[i] = 0xff;
-	}
+	memset( p, 0xff, totsize );
     }
     else {
 	/* count == 0 */
@@ -566,41 +1372,831 @@ static int MTestTypeIndexedCheckbuf( MTestDatatype *mtype )
 
     p = (unsigned char *)mtype->buf;
     if (p) {
-	int j, k, offset;
+	int k, offset, len, m;
 	merr = MPI_Type_extent( mtype->datatype, &totsize );
 	if (merr) MTestPrintError( merr );
 	
 	k = 0;
 	for (i=0; i<mtype->nelm; i++) {
-	    int b;
 	    /* Compute the offset: */
 	    offset = mtype->displs[i] * mtype->basesize;
-	    for (b=0; b<mtype->index[i]; b++) {
-		for (j=0; j<mtype->basesize; j++) {
-		    expected = (0xff ^ (k & 0xff));
-		    if (p[offset+j] != expected) {
-			err++;
-			if (mtype->printErrors && err < 10) {
-			    printf( "Data expected = %x but got p[%d,%d] = %x\n",
-				    expected, i,j, p[offset+j] );
-			    fflush( stdout );
-			}
-		    }
-		    k++;
+	    len    = mtype->index[i] * mtype->basesize;
+	    /* Skip to each byte of the block that is wrong */
+	    for (m = MTestPatternMismatch( p + offset, k, len ); m<len;
+		 m += 1 + MTestPatternScan( p + offset + m + 1, k + m + 1,
+					    len - m - 1 )) {
+		expected = (0xff ^ ((k + m) & 0xff));
+		err++;
+		if (mtype->printErrors && err < 10) {
+		    printf( "Data expected = %x but got p[%d,%d] = %x\n",
+			    expected, i, m % mtype->basesize, p[offset+m] );
+		    fflush( stdout );
 		}
-		offset += mtype->basesize;
 	    }
+	    k += len;
 	}
     }
     return err;
 }
 
 
+/* ------------------------------------------------------------------------ */
+/* Generated datatypes                                                      */
+/* ------------------------------------------------------------------------ */
+/*
+ * After the fixed list, MTestGetDatatypes can return pairs of datatypes
+ * built from a seed (see MTestSetGenDatatypes and the MPITEST_DATATYPE_xxx
+ * environment variables described with MTest_Init).  The k-th pair depends
+ * only on the seed, k, the depth and the message size, so every process
+ * builds the same pairs and a failing pair can be rebuilt from its name.
+ *
+ * A pair is built in two steps.  First a shape is chosen: a basic type,
+ * n repetitions of a shape, or a struct of shapes.  The shape fixes the
+ * type signature.  Then the shape is built twice, once for the send type
+ * and once for the receive type, choosing for each repetition one of
+ * contiguous, vector, hvector, indexed, indexed_block, hindexed or
+ * subarray (with gaps, and blocks in reverse order), sometimes wrapped by
+ * a resized or dup.  The two types have the same signature and different
+ * layouts.  If the signature has only one basic type, the receive type is
+ * sometimes just that basic type.
+ *
+ * Each built type keeps a description of its layout (MTestTypeNode) that
+ * the buffer routines walk to find the bytes of each basic element, in
+ * signature order, without relying on the MPI implementation.  The k-th
+ * byte of the message is 0xff ^ (k & 0xff), as for the other types; bytes
+ * of the receive buffer that are not part of the message must still be
+ * 0xff after the receive.
+ *
+ * Only the extents of the component types are taken from MPI.  All
+ * displacements are nonnegative, every type has lb <= 0 and ub at or past
+ * the last byte of data, and no type overlaps itself, so count * extent
+ * bytes hold count copies of any of these types.
+ *
+ * All of the elements of a pair have the same basic type, as
+ * MPI_Accumulate requires, unless MPITEST_DATATYPE_MIXED is set.
+ */
+#if MPI_VERSION >= 2
+#define MTEST_HAVE_GEN_DATATYPES 1
+#endif
+
+#ifdef MTEST_HAVE_GEN_DATATYPES
+static int genCount    = 0;        /* Number of generated pairs */
+static int genSeed     = 1;
+static int genMaxDepth = 3;        /* Maximum nesting of constructors */
+static int genMaxBytes = 65536;    /* Maximum bytes in a message */
+static int genMixed    = 0;        /* Allow more than one basic type */
+
+/* Shapes */
+#define MTEST_SHAPE_BASIC  0
+#define MTEST_SHAPE_REPEAT 1
+#define MTEST_SHAPE_STRUCT 2
+typedef struct _MTestTypeShape {
+    int                     kind;
+    MPI_Datatype            basic;     /* for MTEST_SHAPE_BASIC */
+    int                     n;         /* repetitions or struct members */
+    int                     *blocklens;  /* for MTEST_SHAPE_STRUCT */
+    struct _MTestTypeShape  **member;  /* one for repeat, n for struct */
+} MTestTypeShape;
+
+/* Layout of a built type: nblocks blocks, block i holding blocklens[i]
+   consecutive copies of child[i] starting displs[i] bytes from the
+   origin.  A node without blocks is a basic type. */
+typedef struct _MTestTypeNode {
+    MPI_Datatype           type;      /* freed once the parent is built */
+    int                    basicSize;
+    MPI_Aint               extent;
+    int                    nblocks;
+    int                    *blocklens;
+    MPI_Aint               *displs;
+    struct _MTestTypeNode  **child;
+} MTestTypeNode;
+
+/* The basic types used in generated types */
+#define MTEST_NGENBASIC 6
+static MPI_Datatype MTestGenBasic( int i )
+{
+    switch (i) {
+    case 0:  return MPI_CHAR;
+    case 1:  return MPI_SHORT;
+    case 2:  return MPI_INT;
+    case 3:  return MPI_LONG;
+    case 4:  return MPI_FLOAT;
+    default: return MPI_DOUBLE;
+    }
+}
+
+/* A small generator that gives the same sequence everywhere */
+static unsigned int MTestGenRand( unsigned int *state, unsigned int n )
+{
+    *state = *state * 1103515245 + 12345;
+    return (n > 0) ? ((*state >> 8) % n) : 0;
+}
+
+/* The basic type of the whole signature, or MPI_DATATYPE_NULL if there is
+   more than one */
+static MPI_Datatype MTestShapeBasic( MTestTypeShape *shape )
+{
+    MPI_Datatype t, t0;
+    int          i;
+
+    if (shape->kind == MTEST_SHAPE_BASIC) return shape->basic;
+    t0 = MTestShapeBasic( shape->member[0] );
+    for (i=1; i<shape->n && shape->kind == MTEST_SHAPE_STRUCT; i++) {
+	t = MTestShapeBasic( shape->member[i] );
+	if (t != t0) return MPI_DATATYPE_NULL;
+    }
+    return t0;
+}
+
+static int MTestShapeElements( MTestTypeShape *shape )
+{
+    int i, n = 0;
+
+    if (shape->kind == MTEST_SHAPE_BASIC) return 1;
+    if (shape->kind == MTEST_SHAPE_REPEAT)
+	return shape->n * MTestShapeElements( shape->member[0] );
+    for (i=0; i<shape->n; i++)
+	n += shape->blocklens[i] * MTestShapeElements( shape->member[i] );
+    return n;
+}
+
+/* Choose a shape whose signature is at most budget bytes.  If basic is
+   not MPI_DATATYPE_NULL, every element has that type (and budget is at
+   least its size); otherwise any basic type that fits is used */
+static MTestTypeShape *MTestShapeCreate( unsigned int *rs, int depth,
+					 int budget, MPI_Datatype basic,
+					 int isRoot )
+{
+    MTestTypeShape *shape;
+    int i, r, size, minsize = 1, limit, nrep;
+
+    shape = (MTestTypeShape *)calloc( 1, sizeof(MTestTypeShape) );
+    if (!shape) MTestError( "Out of memory in datatype generator" );
+    if (basic != MPI_DATATYPE_NULL) MPI_Type_size( basic, &minsize );
+
+    r = MTestGenRand( rs, 8 );
+    if (depth == 0 || (!isRoot && r == 0)) {
+	shape->kind  = MTEST_SHAPE_BASIC;
+	shape->basic = basic;
+	/* Any basic type that fits; char always does */
+	while (shape->basic == MPI_DATATYPE_NULL) {
+	    shape->basic = MTestGenBasic( MTestGenRand( rs, MTEST_NGENBASIC ) );
+	    MPI_Type_size( shape->basic, &size );
+	    if (size > budget && size > 1) shape->basic = MPI_DATATYPE_NULL;
+	}
+    }
+    else if (r <= 2 && budget >= 9 * minsize) {
+	/* Up to 3 members of up to 3 elements each */
+	shape->kind      = MTEST_SHAPE_STRUCT;
+	shape->n         = 2 + MTestGenRand( rs, 2 );
+	shape->blocklens = (int *)malloc( shape->n * sizeof(int) );
+	shape->member    = (MTestTypeShape **)malloc( shape->n *
+						      sizeof(MTestTypeShape *) );
+	if (!shape->blocklens || !shape->member)
+	    MTestError( "Out of memory in datatype generator" );
+	for (i=0; i<shape->n; i++) {
+	    shape->blocklens[i] = 1 + MTestGenRand( rs, 3 );
+	    limit = budget / (shape->n * shape->blocklens[i]);
+	    shape->member[i] = MTestShapeCreate( rs, depth - 1, limit, basic,
+						 0 );
+	}
+    }
+    else {
+	/* Repetitions are chosen on a log scale up to 4096, giving both a
+	   few large blocks and many tiny ones */
+	shape->kind = MTEST_SHAPE_REPEAT;
+	limit = budget / minsize;
+	if (limit > 4096) limit = 4096;
+	for (nrep = 1; 2*nrep <= limit && MTestGenRand( rs, 4 ); nrep *= 2) ;
+	nrep += MTestGenRand( rs, nrep );
+	if (nrep > limit) nrep = limit;
+	shape->n      = nrep;
+	shape->member = (MTestTypeShape **)malloc( sizeof(MTestTypeShape *) );
+	if (!shape->member) MTestError( "Out of memory in datatype generator" );
+	shape->member[0] = MTestShapeCreate( rs, depth - 1, budget / nrep,
+					     basic, 0 );
+    }
+    return shape;
+}
+
+static void MTestShapeFree( MTestTypeShape *shape )
+{
+    int i;
+
+    if (shape->member) {
+	for (i=0; i<(shape->kind == MTEST_SHAPE_STRUCT ? shape->n : 1); i++)
+	    MTestShapeFree( shape->member[i] );
+	free( shape->member );
+    }
+    if (shape->blocklens) free( shape->blocklens );
+    free( shape );
+}
+
+static MTestTypeNode *MTestNodeAlloc( int nblocks )
+{
+    MTestTypeNode *node;
+
+    node = (MTestTypeNode *)calloc( 1, sizeof(MTestTypeNode) );
+    if (!node) MTestError( "Out of memory in datatype generator" );
+    node->type    = MPI_DATATYPE_NULL;
+    node->nblocks = nblocks;
+    if (nblocks > 0) {
+	node->blocklens = (int *)calloc( nblocks, sizeof(int) );
+	node->displs    = (MPI_Aint *)calloc( nblocks, sizeof(MPI_Aint) );
+	node->child     = (MTestTypeNode **)calloc( nblocks,
+						    sizeof(MTestTypeNode *) );
+	if (!node->blocklens || !node->displs || !node->child)
+	    MTestError( "Out of memory in datatype generator" );
+    }
+    return node;
+}
+
+/* Free a node and its children; a child may appear in several blocks */
+static void MTestNodeFree( MTestTypeNode *node )
+{
+    int i, j;
+
+    for (i=0; i<node->nblocks; i++) {
+	for (j=0; j<i; j++)
+	    if (node->child[j] == node->child[i]) break;
+	if (j == i) MTestNodeFree( node->child[i] );
+    }
+    if (node->nblocks > 0) {
+	free( node->blocklens );
+	free( node->displs );
+	free( node->child );
+    }
+    free( node );
+}
+
+static MTestTypeNode *MTestNodeBasic( MPI_Datatype basic )
+{
+    MTestTypeNode *node = MTestNodeAlloc( 0 );
+    MPI_Aint      lb;
+    int           merr;
+
+    node->type = basic;
+    merr = MPI_Type_size( basic, &node->basicSize );
+    if (merr) MTestPrintError( merr );
+    merr = MPI_Type_get_extent( basic, &lb, &node->extent );
+    if (merr) MTestPrintError( merr );
+    return node;
+}
+
+/* Finish a node whose type has been created: record the extent and free
+   the types of the children, which are no longer needed */
+static void MTestNodeFinish( MTestTypeNode *node )
+{
+    MPI_Aint lb;
+    int      i, merr;
+
+    merr = MPI_Type_get_extent( node->type, &lb, &node->extent );
+    if (merr) MTestPrintError( merr );
+    for (i=0; i<node->nblocks; i++) {
+	if (node->child[i]->nblocks > 0 &&
+	    node->child[i]->type != MPI_DATATYPE_NULL) {
+	    merr = MPI_Type_free( &node->child[i]->type );
+	    if (merr) MTestPrintError( merr );
+	}
+    }
+}
+
+/* Lay out nblocks blocks of the given sizes one after another with gaps
+   of up to maxgap units, in order or in reverse order */
+static void MTestLayoutBlocks( unsigned int *rs, int nblocks,
+			       MPI_Aint *bytes, MPI_Aint unit, int maxgap,
+			       MPI_Aint *displs )
+{
+    MPI_Aint cursor = 0;
+    int      i, k, reverse = (MTestGenRand( rs, 4 ) == 0);
+
+    for (k=0; k<nblocks; k++) {
+	i = reverse ? nblocks - 1 - k : k;
+	/* No gap before the first nonempty block keeps lb <= 0 (empty
+	   blocks do not count in the lb) */
+	if (cursor > 0) cursor += unit * MTestGenRand( rs, maxgap + 1 );
+	displs[i] = cursor;
+	cursor += bytes[i];
+    }
+}
+
+/* Choose a divisor of n */
+static int MTestGenDivisor( unsigned int *rs, int n )
+{
+    int d, tries;
+
+    for (tries=0; tries<8; tries++) {
+	d = 1 + MTestGenRand( rs, n );
+	if (n % d == 0) return d;
+    }
+    return 1;
+}
+
+/* Enclose the description of a type, starting at desc[len], in name( ) */
+static void MTestDescWrap( const char *name, char *desc, int len, int desclen )
+{
+    char inner[MPI_MAX_OBJECT_NAME];
+
+    strncpy( inner, desc + len, sizeof(inner) - 1 );
+    inner[sizeof(inner) - 1] = 0;
+    desc[len] = 0;
+    strncat( desc, name, desclen - len - 1 );
+    strncat( desc, "(", desclen - strlen(desc) - 1 );
+    strncat( desc, inner, desclen - strlen(desc) - 1 );
+    strncat( desc, ")", desclen - strlen(desc) - 1 );
+}
+
+/* Wrap a type in a resized type with the given lb and ub */
+static MTestTypeNode *MTestNodeResize( MTestTypeNode *inner, MPI_Aint lb,
+				       MPI_Aint ub, char *desc, int len,
+				       int desclen )
+{
+    MTestTypeNode *node = MTestNodeAlloc( 1 );
+    int           merr;
+
+    node->blocklens[0] = 1;
+    node->child[0]     = inner;
+    merr = MPI_Type_create_resized( inner->type, lb, ub - lb, &node->type );
+    if (merr) MTestPrintError( merr );
+    MTestNodeFinish( node );
+    MTestDescWrap( "resized", desc, len, desclen );
+    return node;
+}
+
+#define MTEST_GEN_CONTIG   0
+#define MTEST_GEN_VECTOR   1
+#define MTEST_GEN_HVECTOR  2
+#define MTEST_GEN_INDEXED  3
+#define MTEST_GEN_BLOCKIDX 4
+#define MTEST_GEN_HINDEXED 5
+#define MTEST_GEN_SUBARRAY 6
+#define MTEST_GEN_NKINDS   7
+static const char *genKindName[MTEST_GEN_NKINDS] = {
+    "contig", "vector", "hvector", "indexed", "blockidx", "hindexed",
+    "subarray" };
+
+/* Build a datatype with the given shape, appending a description to desc */
+static MTestTypeNode *MTestNodeCreate( unsigned int *rs, MTestTypeShape *shape,
+				       char *desc, int desclen )
+{
+    MTestTypeNode *node, *child, *inner;
+    MPI_Datatype  *types;
+    MPI_Aint      ext, *bytes, lb, ub, tlb, text;
+    int           i, n, bl = 0, nb, stride = 0, left, kind, wrap, merr = 0;
+    int           *idispls, len;
+    int           sizes[2], subsizes[2], starts[2];
+    char          name[MPI_MAX_OBJECT_NAME];
+
+    len = strlen( desc );
+    if (shape->kind == MTEST_SHAPE_BASIC) {
+	node = MTestNodeBasic( shape->basic );
+	merr = MPI_Type_get_name( shape->basic, name, &i );
+	if (merr) MTestPrintError( merr );
+	/* MPI_INT -> int */
+	strncat( desc, (strncmp( name, "MPI_", 4 ) == 0) ? name + 4 : name,
+		 desclen - len - 1 );
+	return node;
+    }
+
+    if (shape->kind == MTEST_SHAPE_STRUCT) {
+	n     = shape->n;
+	node  = MTestNodeAlloc( n );
+	types = (MPI_Datatype *)malloc( n * sizeof(MPI_Datatype) );
+	bytes = (MPI_Aint *)malloc( n * sizeof(MPI_Aint) );
+	if (!types || !bytes) MTestError( "Out of memory in datatype generator" );
+	strncat( desc, "struct(", desclen - len - 1 );
+	for (i=0; i<n; i++) {
+	    if (i > 0) strncat( desc, ",", desclen - strlen(desc) - 1 );
+	    node->child[i]     = MTestNodeCreate( rs, shape->member[i], desc,
+						  desclen );
+	    node->blocklens[i] = shape->blocklens[i];
+	    types[i]           = node->child[i]->type;
+	    bytes[i]           = shape->blocklens[i] * node->child[i]->extent;
+	}
+	MTestLayoutBlocks( rs, n, bytes, 8, 2, node->displs );
+	merr = MPI_Type_create_struct( n, node->blocklens, node->displs, types,
+				       &node->type );
+	if (merr) MTestPrintError( merr );
+	free( types );
+	free( bytes );
+	strncat( desc, ")", desclen - strlen(desc) - 1 );
+    }
+    else {
+	/* Choose the constructor and the blocks, in units of the extent of
+	   the child, then build the child */
+	n    = shape->n;
+	kind = MTestGenRand( rs, MTEST_GEN_NKINDS );
+	if (kind == MTEST_GEN_SUBARRAY) {
+	    subsizes[0] = MTestGenDivisor( rs, n );
+	    subsizes[1] = n / subsizes[0];
+	    sizes[0]    = subsizes[0] + MTestGenRand( rs, 3 );
+	    sizes[1]    = subsizes[1] + MTestGenRand( rs, 4 );
+	    starts[0]   = MTestGenRand( rs, sizes[0] - subsizes[0] + 1 );
+	    starts[1]   = MTestGenRand( rs, sizes[1] - subsizes[1] + 1 );
+	    node = MTestNodeAlloc( subsizes[0] );
+	    for (i=0; i<subsizes[0]; i++) {
+		node->blocklens[i] = subsizes[1];
+		node->displs[i]    = (MPI_Aint)(starts[0] + i) * sizes[1] +
+		    starts[1];
+	    }
+	}
+	else if (kind == MTEST_GEN_VECTOR || kind == MTEST_GEN_HVECTOR) {
+	    bl     = MTestGenDivisor( rs, n );
+	    nb     = n / bl;
+	    stride = bl + MTestGenRand( rs, bl + 3 );
+	    node   = MTestNodeAlloc( nb );
+	    for (i=0; i<nb; i++) {
+		node->blocklens[i] = bl;
+		node->displs[i]    = (MPI_Aint)i * stride;
+	    }
+	}
+	else if (kind == MTEST_GEN_CONTIG) {
+	    node = MTestNodeAlloc( 1 );
+	    node->blocklens[0] = n;
+	}
+	else {
+	    /* Either equal blocks or random lengths (some of them empty),
+	       with gaps, in order or reversed */
+	    if (kind == MTEST_GEN_BLOCKIDX) {
+		bl = MTestGenDivisor( rs, n );
+		nb = n / bl;
+		node = MTestNodeAlloc( nb );
+		for (i=0; i<nb; i++) node->blocklens[i] = bl;
+	    }
+	    else {
+		nb   = 1 + MTestGenRand( rs, (n < 64) ? n : 64 );
+		node = MTestNodeAlloc( nb );
+		for (i=0, left=n; i<nb-1; i++) {
+		    bl = MTestGenRand( rs, 2 * (n / nb) + 1 );
+		    node->blocklens[i] = (bl < left) ? bl : left;
+		    left -= node->blocklens[i];
+		}
+		node->blocklens[nb-1] = left;
+	    }
+	    bytes = (MPI_Aint *)malloc( nb * sizeof(MPI_Aint) );
+	    if (!bytes) MTestError( "Out of memory in datatype generator" );
+	    for (i=0; i<nb; i++) bytes[i] = node->blocklens[i];
+	    MTestLayoutBlocks( rs, nb, bytes, 1, 2, node->displs );
+	    free( bytes );
+	}
+
+	strncat( desc, genKindName[kind], desclen - len - 1 );
+	strncat( desc, "(", desclen - strlen(desc) - 1 );
+	child = MTestNodeCreate( rs, shape->member[0], desc, desclen );
+	strncat( desc, ")", desclen - strlen(desc) - 1 );
+	ext   = child->extent;
+	for (i=0; i<node->nblocks; i++) {
+	    node->child[i]   = child;
+	    node->displs[i] *= ext;
+	}
+
+	switch (kind) {
+	case MTEST_GEN_CONTIG:
+	    merr = MPI_Type_contiguous( n, child->type, &node->type );
+	    break;
+	case MTEST_GEN_VECTOR:
+	    merr = MPI_Type_vector( node->nblocks, bl, stride, child->type,
+				    &node->type );
+	    break;
+	case MTEST_GEN_HVECTOR:
+	    merr = MPI_Type_create_hvector( node->nblocks, bl,
+					    (MPI_Aint)stride * ext,
+					    child->type, &node->type );
+	    break;
+	case MTEST_GEN_HINDEXED:
+	    merr = MPI_Type_create_hindexed( node->nblocks, node->blocklens,
+					     node->displs, child->type,
+					     &node->type );
+	    break;
+	case MTEST_GEN_SUBARRAY:
+	    merr = MPI_Type_create_subarray( 2, sizes, subsizes, starts,
+					     MPI_ORDER_C, child->type,
+					     &node->type );
+	    break;
+	default:
+	    idispls = (int *)malloc( node->nblocks * sizeof(int) );
+	    if (!idispls) MTestError( "Out of memory in datatype generator" );
+	    for (i=0; i<node->nblocks; i++)
+		idispls[i] = (int)(node->displs[i] / ext);
+	    if (kind == MTEST_GEN_BLOCKIDX)
+		merr = MPI_Type_create_indexed_block( node->nblocks, bl,
+						      idispls, child->type,
+						      &node->type );
+	    else
+		merr = MPI_Type_indexed( node->nblocks, node->blocklens,
+					 idispls, child->type, &node->type );
+	    free( idispls );
+	    break;
+	}
+	if (merr) MTestPrintError( merr );
+    }
+    MTestNodeFinish( node );
+
+    /* The lb of a struct or indexed type that contains a resized type is
+       the lb of that type (the explicit lb marker), which can be above 0.
+       Restore lb <= 0 and ub at or past the end of the data */
+    merr = MPI_Type_get_extent( node->type, &lb, &ext );
+    if (merr) MTestPrintError( merr );
+    merr = MPI_Type_get_true_extent( node->type, &tlb, &text );
+    if (merr) MTestPrintError( merr );
+    ub = lb + ext;
+    if (lb > 0 || ub < tlb + text) {
+	if (lb > 0) lb = 0;
+	if (ub < tlb + text) ub = tlb + text;
+	node = MTestNodeResize( node, lb, ub, desc, len, desclen );
+    }
+
+    /* Sometimes wrap the type in a resized type, with padding before and
+       after, or in a dup */
+    wrap = MTestGenRand( rs, 6 );
+    if (wrap == 0) {
+	merr = MPI_Type_get_extent( node->type, &lb, &ext );
+	if (merr) MTestPrintError( merr );
+	ub  = lb + ext;
+	lb -= 8 * (MPI_Aint)MTestGenRand( rs, 3 );
+	ub += 8 * (MPI_Aint)MTestGenRand( rs, 3 );
+	node = MTestNodeResize( node, lb, ub, desc, len, desclen );
+    }
+    else if (wrap == 1) {
+	inner = node;
+	node  = MTestNodeAlloc( 1 );
+	node->blocklens[0] = 1;
+	node->child[0]     = inner;
+	merr = MPI_Type_dup( inner->type, &node->type );
+	if (merr) MTestPrintError( merr );
+	MTestNodeFinish( node );
+	MTestDescWrap( "dup", desc, len, desclen );
+    }
+    return node;
+}
+
+/* Walk the bytes of count copies of a type in signature order */
+typedef struct {
+    unsigned char *p;
+    unsigned char *mask;     /* bytes that are part of the message */
+    long          k;         /* index of the byte in the message */
+    int           check;     /* check instead of setting */
+    int           err;
+    int           printErrors;
+} MTestWalkState;
+
+/* Set or check the n contiguous message bytes at offset */
+static void MTestWalkBytes( MPI_Aint offset, MPI_Aint n, MTestWalkState *ws )
+{
+    unsigned char expected;
+    MPI_Aint      b;
+
+    if (!ws->check) {
+	MTestPatternFill( ws->p + offset, ws->k, n );
+	ws->k += n;
+	return;
+    }
+    memset( ws->mask + offset, 1, n );
+    for (b = MTestPatternScan( ws->p + offset, ws->k, n ); b<n;
+	 b += 1 + MTestPatternScan( ws->p + offset + b + 1, ws->k + b + 1,
+				    n - b - 1 )) {
+	expected = 0xff ^ ((ws->k + b) & 0xff);
+	ws->err++;
+	if (ws->printErrors && ws->err < 10) {
+	    printf( "Data expected = %x but got p[%ld] = %x\n",
+		    expected, (long)(offset+b), ws->p[offset+b] );
+	    fflush( stdout );
+	}
+    }
+    ws->k += n;
+}
+
+static void MTestNodeWalk( MTestTypeNode *node, MPI_Aint offset,
+			   MTestWalkState *ws )
+{
+    MTestTypeNode *child;
+    int           i, j;
+
+    if (node->nblocks == 0) {
+	MTestWalkBytes( offset, node->basicSize, ws );
+	return;
+    }
+    for (i=0; i<node->nblocks; i++) {
+	child = node->child[i];
+	if (child->nblocks == 0 && child->extent == child->basicSize) {
+	    /* A block of basic elements is contiguous */
+	    MTestWalkBytes( offset + node->displs[i],
+			    (MPI_Aint)node->blocklens[i] * child->basicSize,
+			    ws );
+	    continue;
+	}
+	for (j=0; j<node->blocklens[i]; j++) {
+	    MTestNodeWalk( child, offset + node->displs[i] +
+			   j * child->extent, ws );
+	}
+    }
+}
+
+static void *MTestTypeGenAlloc( MTestDatatype *mtype )
+{
+    MPI_Aint totsize = mtype->count * mtype->node->extent;
+
+    if (!mtype->buf) {
+	mtype->buf = (void *)malloc( totsize > 0 ? totsize : 1 );
+	if (!mtype->buf) {
+	    MTestError( "Out of memory in type buffer init" );
+	}
+    }
+    memset( mtype->buf, 0xff, totsize );
+    return mtype->buf;
+}
+
+static void *MTestTypeGenInit( MTestDatatype *mtype )
+{
+    MTestWalkState ws;
+    int            i;
+
+    MTestTypeGenAlloc( mtype );
+    ws.p     = (unsigned char *)mtype->buf;
+    ws.k     = 0;
+    ws.check = 0;
+    for (i=0; i<mtype->count; i++) {
+	MTestNodeWalk( mtype->node, i * mtype->node->extent, &ws );
+    }
+    return mtype->buf;
+}
+
+static void *MTestTypeGenInitRecv( MTestDatatype *mtype )
+{
+    return MTestTypeGenAlloc( mtype );
+}
+
+static void *MTestTypeGenFree( MTestDatatype *mtype )
+{
+    if (mtype->buf) {
+	free( mtype->buf );
+	mtype->buf = 0;
+    }
+    if (mtype->node) {
+	MTestNodeFree( mtype->node );
+	mtype->node = 0;
+    }
+    return 0;
+}
+
+static int MTestTypeGenCheckbuf( MTestDatatype *mtype )
+{
+    MTestWalkState ws;
+    MPI_Aint       totsize, i;
+
+    if (!mtype->buf) return 0;
+    if (!mtestPatternReady) MTestPatternSetup();
+    totsize = mtype->count * mtype->node->extent;
+    ws.p           = (unsigned char *)mtype->buf;
+    ws.k           = 0;
+    ws.check       = 1;
+    ws.err         = 0;
+    ws.printErrors = mtype->printErrors;
+    ws.mask        = (unsigned char *)calloc( totsize > 0 ? totsize : 1, 1 );
+    if (!ws.mask) {
+	MTestError( "Out of memory in type buffer check" );
+    }
+    for (i=0; i<mtype->count; i++) {
+	MTestNodeWalk( mtype->node, i * mtype->node->extent, &ws );
+    }
+    /* Nothing outside of the message may be written.  Most of the buffer
+       is unchanged, so look a chunk at a time for bytes that are not 0xff
+       and the mask only where there are some */
+    for (i=0; i<totsize; i++) {
+	if ((i % MTEST_PATTERN_CHUNK) == 0 &&
+	    memcmp( ws.p + i, mtestOnes, (totsize - i < MTEST_PATTERN_CHUNK) ?
+		    totsize - i : MTEST_PATTERN_CHUNK ) == 0) {
+	    i += MTEST_PATTERN_CHUNK - 1;
+	    continue;
+	}
+	if (!ws.mask[i] && ws.p[i] != 0xff) {
+	    ws.err++;
+	    if (ws.printErrors && ws.err < 10) {
+		printf( "Byte p[%ld] = %x is not part of the message\n",
+			(long)i, ws.p[i] );
+		fflush( stdout );
+	    }
+	}
+    }
+    free( ws.mask );
+    return ws.err;
+}
+
+/* Build the k-th generated pair */
+static void MTestGetGenDatatypes( MTestDatatype *sendtype,
+				  MTestDatatype *recvtype, int count, int k )
+{
+    MTestTypeShape *shape;
+    MPI_Datatype   basic;
+    unsigned int   rs;
+    int            budget, limit, bits, merr;
+    char           desc[MPI_MAX_OBJECT_NAME], name[MPI_MAX_OBJECT_NAME];
+
+    /* The pair depends only on the seed, k and the budget */
+    rs = (unsigned int)genSeed * 2654435761u + (unsigned int)k * 40503u;
+    MTestGenRand( &rs, 1 );
+    /* The size of the message is chosen on a log scale up to the maximum,
+       so that small types are as common as large ones */
+    budget = genMaxBytes / (count > 0 ? count : 1);
+    for (limit = 1, bits = 0; 2*limit <= budget; limit *= 2, bits++) ;
+    budget = limit >> MTestGenRand( &rs, bits + 1 );
+    /* Unless mixed types are allowed, choose one basic type that fits */
+    basic = MPI_DATATYPE_NULL;
+    while (!genMixed && basic == MPI_DATATYPE_NULL) {
+	basic = MTestGenBasic( MTestGenRand( &rs, MTEST_NGENBASIC ) );
+	merr = MPI_Type_size( basic, &limit );
+	if (merr) MTestPrintError( merr );
+	if (limit > budget && limit > 1) basic = MPI_DATATYPE_NULL;
+    }
+    shape = MTestShapeCreate( &rs, genMaxDepth, budget, basic, 1 );
+
+    sprintf( name, "gen%d/%d:", k, genSeed );
+    desc[0] = 0;
+    sendtype->node     = MTestNodeCreate( &rs, shape, desc,
+					  (int)sizeof(desc) - strlen(name) );
+    sendtype->datatype = sendtype->node->type;
+    sendtype->node->type = MPI_DATATYPE_NULL;
+    merr = MPI_Type_commit( &sendtype->datatype );
+    if (merr) MTestPrintError( merr );
+    strcat( name, desc );
+    merr = MPI_Type_set_name( sendtype->datatype, name );
+    if (merr) MTestPrintError( merr );
+
+    basic = MTestShapeBasic( shape );
+    if (basic != MPI_DATATYPE_NULL && MTestGenRand( &rs, 4 ) == 0) {
+	/* Receive into an array of the basic type */
+	recvtype->node     = MTestNodeBasic( basic );
+	recvtype->node->type = MPI_DATATYPE_NULL;
+	recvtype->datatype = basic;
+	recvtype->isBasic  = 1;
+	recvtype->count    = count * MTestShapeElements( shape );
+    }
+    else {
+	sprintf( name, "gen%d/%d:", k, genSeed );
+	desc[0] = 0;
+	recvtype->node     = MTestNodeCreate( &rs, shape, desc,
+					      (int)sizeof(desc) - strlen(name) );
+	recvtype->datatype = recvtype->node->type;
+	recvtype->node->type = MPI_DATATYPE_NULL;
+	merr = MPI_Type_commit( &recvtype->datatype );
+	if (merr) MTestPrintError( merr );
+	strcat( name, desc );
+	merr = MPI_Type_set_name( recvtype->datatype, name );
+	if (merr) MTestPrintError( merr );
+    }
+    MTestShapeFree( shape );
+
+    sendtype->InitBuf  = MTestTypeGenInit;
+    sendtype->FreeBuf  = MTestTypeGenFree;
+    sendtype->CheckBuf = MTestTypeGenCheckbuf;
+    recvtype->InitBuf  = MTestTypeGenInitRecv;
+    recvtype->FreeBuf  = MTestTypeGenFree;
+    recvtype->CheckBuf = MTestTypeGenCheckbuf;
+}
+#endif /* MTEST_HAVE_GEN_DATATYPES */
+
+/*
+   Add ngen generated pairs of datatypes after the fixed ones returned by
+   MTestGetDatatypes, built from seed with at most maxdepth nested
+   constructors and at most maxbytes bytes in each message.  The defaults
+   come from the MPITEST_DATATYPE_GEN, MPITEST_DATATYPE_SEED,
+   MPITEST_DATATYPE_DEPTH and MPITEST_DATATYPE_MAXBYTES environment
+   variables (see MTest_Init); with no generated pairs (the default),
+   MTestGetDatatypes returns only the fixed list.  A value less than 1
+   leaves the corresponding setting unchanged, except for ngen.
+ */
+void MTestSetGenDatatypes( int ngen, int seed, int maxdepth, int maxbytes )
+{
+#ifdef MTEST_HAVE_GEN_DATATYPES
+    genCount = (ngen > 0) ? ngen : 0;
+    if (seed > 0)     genSeed     = seed;
+    if (maxdepth > 0) genMaxDepth = maxdepth;
+    if (maxbytes > 0) genMaxBytes = maxbytes;
+#endif
+}
+
+static void MTestSetGenDatatypesFromEnv( const char *envval )
+{
+    char *seed     = getenv( "MPITEST_DATATYPE_SEED" );
+    char *depth    = getenv( "MPITEST_DATATYPE_DEPTH" );
+    char *maxbytes = getenv( "MPITEST_DATATYPE_MAXBYTES" );
+
+    MTestSetGenDatatypes( atoi( envval ), seed ? atoi( seed ) : 0,
+			  depth ? atoi( depth ) : 0,
+			  maxbytes ? atoi( maxbytes ) : 0 );
+#ifdef MTEST_HAVE_GEN_DATATYPES
+    if (getenv( "MPITEST_DATATYPE_MIXED" )) genMixed = 1;
+#endif
+}
+
 /* ------------------------------------------------------------------------ */
 /* Routines to select a datatype and associated buffer create/fill/check    */
 /* routines                                                                 */
 /* ------------------------------------------------------------------------ */
 
+/* Number of cases in the fixed list below */
+#define MTEST_NFIXED_DATATYPES 14
+
 /* 
    Create a range of datatypes with a given count elements.
    This uses a selection of types, rather than an exhaustive collection.
@@ -630,6 +2226,8 @@ int MTestGetDatatypes( MTestDatatype *sendtype, MTestDatatype *recvtype,
 
     sendtype->buf	  = 0;
     recvtype->buf	  = 0;
+    sendtype->node	  = 0;
+    recvtype->node	  = 0;
 
     /* Set the defaults for the message lengths */
     sendtype->count	  = count;
@@ -858,6 +2456,16 @@ int MTestGetDatatypes( MTestDatatype *sendtype, MTestDatatype *recvtype,
 	break;
 #endif
     default:
+#ifdef MTEST_HAVE_GEN_DATATYPES
+	/* The generated pairs follow the fixed list */
+	if (datatype_index < MTEST_NFIXED_DATATYPES)
+	    datatype_index = MTEST_NFIXED_DATATYPES;
+	if (datatype_index - MTEST_NFIXED_DATATYPES < genCount) {
+	    MTestGetGenDatatypes( sendtype, recvtype, count,
+				  datatype_index - MTEST_NFIXED_DATATYPES );
+	    break;
+	}
+#endif
 	datatype_index = -1;
     }
 
@@ -1537,6 +3145,34 @@ void MTestError( const char *msg )
     MPI_Abort( MPI_COMM_WORLD, 1 );
 }
 /* ------------------------------------------------------------------------ */
+/* The resident set size of this process in bytes, from /proc where it is
+   available and otherwise the maximum from getrusage; -1 if it is not
+   known */
+double MTestResidentBytes( void )
+{
+    FILE *fp;
+    char line[256];
+    long kb = -1;
+
+    fp = fopen( "/proc/self/status", "r" );
+    if (fp) {
+	while (fgets( line, sizeof(line), fp )) {
+	    if (sscanf( line, "VmRSS: %ld", &kb ) == 1) break;
+	}
+	fclose( fp );
+	if (kb >= 0) return 1024.0 * kb;
+    }
+#ifdef HAVE_GETRUSAGE
+    {
+	struct rusage ru;
+	if (getrusage( RUSAGE_SELF, &ru ) == 0) {
+	    return 1024.0 * ru.ru_maxrss;
+	}
+    }
+#endif
+    return -1;
+}
+
 static void MTestResourceSummary( FILE *fp )
 {
 #ifdef HAVE_GETRUSAGE
@@ -0,0 +1,924 @@
+/* -*- Mode: C; c-basic-offset:4 ; -*- */
+/*
+ *  (C) 2013 by Argonne National Laboratory.
+ *      See COPYRIGHT in top-level directory.
+ */
+
+/* A PMPI-based tracer that records the begin and end time of the common
+ * MPI calls made by a test and writes them, for all processes, as one
+ * timeline in the Chrome trace event format (JSON, viewable with
+ * chrome://tracing or Perfetto).  Like the NBC PMPI adapter, it is used
+ * by linking it in ahead of the MPI library, for example
+ *
+ *     make LDADD="../util/mtest.o ../util/mtest_trace.o" bcast2
+ *
+ * Each process records into a fixed-size ring of events; the slot for an
+ * event is claimed with an atomic increment, so calls from several threads
+ * do not need a lock.  When the ring fills, the oldest events are
+ * overwritten and counted as dropped (reported as "droppedEvents" in the
+ * trace, and on stderr when MPITEST_VERBOSE is set).  In MPI_Finalize,
+ * which the tests call just after MTest_Finalize, the times are converted
+ * to the clock of process 0 with MTestGetClockOffset and process 0 writes
+ * the events of every process to the trace file, named after the program
+ * so that the tests of a directory do not overwrite each other's traces.
+ * Each process appears as one "pid" in the timeline, and each thread of a
+ * process, numbered in the order of their first traced call, as one "tid".
+ *
+ * The same wrappers also keep per-call counters: the number of calls, the
+ * bytes and the cumulative time for each MPI function, and the calls,
+ * bytes and time on each communicator.  The bytes of a receive are those
+ * actually received (MPI_Irecv records none); MPI_Sendrecv counts both
+ * directions.  Each thread accumulates into its own counters, so the
+ * only cost per call is a few additions and a short search of the
+ * communicators seen by that thread.  When MPITEST_PROFILE is set, the
+ * counters are combined over the threads and processes in MPI_Finalize
+ * and process 0 writes a summary table to the profile file, with the
+ * communicator table for process 0 only (communicator handles differ
+ * between processes).  The table is not printed, since runtests treats
+ * any output other than " No Errors" as a failure.  A handle that is
+ * reused after MPI_Comm_free is counted under the communicator that first
+ * had it.
+ *
+ * Environment Variables:
+ *   MPITEST_TRACE_FILE   - name of the trace file (default
+ *                          <program>-trace.json)
+ *   MPITEST_TRACE_EVENTS - events kept per process (default 65536); 0
+ *                          turns off the timeline
+ *   MPITEST_PROFILE      - if set, write the per-call summary; if set to
+ *                          "csv", write it as comma-separated values
+ *   MPITEST_PROFILE_FILE - name of the profile file (default
+ *                          <program>-profile.txt, or .csv)
+ *
+ * Configuring with --enable-mtest-trace links the tracer into every C test
+ * (see Makefile.mtest).
+ */
+
+#include "mpi.h"
+#include "mpitestconf.h"
+#include "mpitest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+/* The MPI-3 bindings added const to the input buffers */
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+#define MTEST_CONST const
+#elif defined(MPICH2_CONST)
+#define MTEST_CONST MPICH2_CONST
+#else
+#define MTEST_CONST
+#endif
+
+#if MTEST_HAVE_MIN_MPI_VERSION(3,0)
+#define TRACE_MPI3_ROUTINES 1
+#endif
+
+typedef enum {
+    T_SEND = 0, T_SSEND, T_RECV, T_SENDRECV, T_ISEND, T_IRECV, T_WAIT,
+    T_WAITALL, T_WAITANY, T_TEST, T_PROBE, T_BARRIER, T_BCAST, T_REDUCE,
+    T_ALLREDUCE, T_GATHER, T_SCATTER, T_ALLGATHER, T_ALLTOALL,
+    T_REDSCAT_BLOCK, T_SCAN, T_EXSCAN, T_IBARRIER, T_IBCAST, T_IALLREDUCE,
+    T_COMM_DUP, T_COMM_SPLIT, T_COMM_FREE, T_WIN_FENCE, T_WIN_LOCK,
+    T_WIN_UNLOCK, T_WIN_FLUSH, T_PUT, T_GET, T_ACCUMULATE, T_MAX
+} traceFn_t;
+
+static const char *fnName[T_MAX] = {
+    "MPI_Send", "MPI_Ssend", "MPI_Recv", "MPI_Sendrecv", "MPI_Isend",
+    "MPI_Irecv", "MPI_Wait", "MPI_Waitall", "MPI_Waitany", "MPI_Test",
+    "MPI_Probe", "MPI_Barrier", "MPI_Bcast", "MPI_Reduce", "MPI_Allreduce",
+    "MPI_Gather", "MPI_Scatter", "MPI_Allgather", "MPI_Alltoall",
+    "MPI_Reduce_scatter_block", "MPI_Scan", "MPI_Exscan", "MPI_Ibarrier",
+    "MPI_Ibcast", "MPI_Iallreduce", "MPI_Comm_dup", "MPI_Comm_split",
+    "MPI_Comm_free", "MPI_Win_fence", "MPI_Win_lock", "MPI_Win_unlock",
+    "MPI_Win_flush", "MPI_Put", "MPI_Get", "MPI_Accumulate" };
+
+typedef struct {
+    double t0, t1;     /* begin and end, in seconds on the local clock */
+    long   bytes;      /* bytes sent or received by this process, or -1 */
+    int    fn;         /* traceFn_t */
+    int    peer;       /* rank of the partner or root, or -1 */
+    int    tid;        /* thread, numbered from 0 by first traced call */
+} traceEvent_t;
+
+static traceEvent_t  *events = 0;
+static volatile long nextEvent = 0;
+static long          maxEvents = 65536;
+static int           traceOn = 0;
+static double        tInit = 0;
+
+/* The program name, without the directory, for the default file names */
+#define PROG_NAME_LEN 64
+static char progName[PROG_NAME_LEN] = "mtest";
+
+/* Communicators beyond PROF_MAX_COMMS share one "other" entry */
+#define PROF_MAX_COMMS 16
+typedef struct {
+    MPI_Comm comm;
+    int      size;
+    char     name[MPI_MAX_OBJECT_NAME];
+    long     calls, bytes;
+    double   time;
+} profComm_t;
+
+typedef struct profThread {
+    long              calls[T_MAX], bytes[T_MAX];
+    double            time[T_MAX];
+    int               ncomms;
+    profComm_t        comms[PROF_MAX_COMMS+1];
+    struct profThread *next;
+} profThread_t;
+
+static profThread_t *profThreads = 0;
+static int          profOn = 0, profCsv = 0;
+
+#if defined(__GNUC__)
+#define TRACE_FETCH_AND_INC(p_) __sync_fetch_and_add( (p_), 1 )
+#define PROF_THREAD_LOCAL __thread
+#else
+/* Without an atomic increment and thread-local storage, concurrent calls
+   from several threads may overwrite each other's events and counts */
+#define TRACE_FETCH_AND_INC(p_) ((*(p_))++)
+#define PROF_THREAD_LOCAL
+#endif
+
+static PROF_THREAD_LOCAL profThread_t *myProf = 0;
+static PROF_THREAD_LOCAL int          myTid = -1;
+static volatile long                  nextTid = 0;
+
+/* Create the counters for the calling thread and add them to the list */
+static profThread_t *ProfNewThread( void )
+{
+    profThread_t *p;
+
+    p = (profThread_t *)calloc( 1, sizeof(profThread_t) );
+    if (!p) {
+	fprintf( stderr, "Unable to allocate profiling counters\n" );
+	PMPI_Abort( MPI_COMM_WORLD, 1 );
+    }
+    strcpy( p->comms[PROF_MAX_COMMS].name, "(other)" );
+#if defined(__GNUC__)
+    do {
+	p->next = profThreads;
+    } while (!__sync_bool_compare_and_swap( &profThreads, p->next, p ));
+#else
+    p->next     = profThreads;
+    profThreads = p;
+#endif
+    myProf = p;
+    return p;
+}
+
+static void ProfAdd( traceFn_t fn, MPI_Comm comm, double t, long bytes )
+{
+    profThread_t *p = myProf;
+    profComm_t   *c;
+    int          i, len;
+
+    if (!p) p = ProfNewThread();
+    p->calls[fn]++;
+    p->time[fn] += t;
+    if (bytes > 0) p->bytes[fn] += bytes;
+
+    for (i=0; i<p->ncomms; i++) {
+	if (p->comms[i].comm == comm) break;
+    }
+    if (i == p->ncomms) {
+	if (i < PROF_MAX_COMMS) {
+	    /* Remember the name and size now; the communicator may be freed
+	       before MPI_Finalize */
+	    c = &p->comms[i];
+	    c->comm = comm;
+	    if (comm == MPI_COMM_NULL) {
+		strcpy( c->name, "(none)" );
+	    }
+	    else {
+		PMPI_Comm_size( comm, &c->size );
+		PMPI_Comm_get_name( comm, c->name, &len );
+		if (len == 0) strcpy( c->name, "(unnamed)" );
+	    }
+	    p->ncomms++;
+	}
+	else {
+	    i = PROF_MAX_COMMS;
+	}
+    }
+    c = &p->comms[i];
+    c->calls++;
+    c->time += t;
+    if (bytes > 0) c->bytes += bytes;
+}
+
+static void TraceRecord( traceFn_t fn, MPI_Comm comm, double t0, int peer,
+			 long bytes )
+{
+    traceEvent_t *e;
+    double       t1;
+
+    if (!traceOn && !profOn) return;
+    t1 = PMPI_Wtime();
+    if (profOn) ProfAdd( fn, comm, t1 - t0, bytes );
+    if (!traceOn) return;
+    if (myTid < 0) myTid = (int)TRACE_FETCH_AND_INC( &nextTid );
+    e = &events[TRACE_FETCH_AND_INC( &nextEvent ) % maxEvents];
+    e->t0    = t0;
+    e->t1    = t1;
+    e->bytes = bytes;
+    e->fn    = fn;
+    e->peer  = peer;
+    e->tid   = myTid;
+}
+
+static long TraceBytes( int count, MPI_Datatype datatype )
+{
+    int size;
+
+    if (datatype == MPI_DATATYPE_NULL) return -1;
+    PMPI_Type_size( datatype, &size );
+    return (long)count * size;
+}
+
+/* The bytes received, from the status of a completed receive, or -1 */
+static long TraceStatusBytes( MPI_Status *status )
+{
+    int n;
+
+    PMPI_Get_count( status, MPI_BYTE, &n );
+    return n == MPI_UNDEFINED ? -1 : n;
+}
+
+static void TraceSetup( int *argc, char ***argv )
+{
+    const char *str;
+
+    if (argc && argv && *argc > 0 && (*argv)[0]) {
+	str = strrchr( (*argv)[0], '/' );
+	strncpy( progName, str ? str + 1 : (*argv)[0], PROG_NAME_LEN - 1 );
+    }
+
+    str = getenv( "MPITEST_PROFILE" );
+    if (str) {
+	profOn  = 1;
+	profCsv = strcmp( str, "csv" ) == 0;
+    }
+
+    str = getenv( "MPITEST_TRACE_EVENTS" );
+    if (str) maxEvents = atol( str );
+    if (maxEvents <= 0) return;
+    /* The events are sent to process 0 with an int count */
+    if (maxEvents > INT_MAX) maxEvents = INT_MAX;
+    events = (traceEvent_t *)malloc( maxEvents * sizeof(traceEvent_t) );
+    if (!events) {
+	fprintf( stderr, "Unable to allocate %ld trace events\n", maxEvents );
+	return;
+    }
+    tInit   = PMPI_Wtime();
+    traceOn = 1;
+}
+
+static void TraceWriteEvents( FILE *fp, int rank, traceEvent_t *ev, long n )
+{
+    long i;
+
+    for (i=0; i<n; i++) {
+	/* The process_name records always come first, so every event
+	   follows another record */
+	fprintf( fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+		 "\"ts\":%.3f,\"dur\":%.3f", fnName[ev[i].fn], rank,
+		 ev[i].tid, 1.e6 * ev[i].t0, 1.e6 * (ev[i].t1 - ev[i].t0) );
+	if (ev[i].peer >= 0 || ev[i].bytes >= 0) {
+	    fprintf( fp, ",\"args\":{\"peer\":%d,\"bytes\":%ld}", ev[i].peer,
+		     ev[i].bytes );
+	}
+	fprintf( fp, "}" );
+    }
+}
+
+/* Merge the events of all processes into the trace file */
+static void TraceFinalize( void )
+{
+    int          rank, size, r;
+    long         n, i, first, dropped, totDropped = 0;
+    double       offset, err, t0;
+    traceEvent_t *ev;
+    const char   *fname;
+    char         defname[PROG_NAME_LEN+16];
+    FILE         *fp = 0;
+    MPI_Datatype eventType;
+
+    if (!traceOn) return;
+    traceOn = 0;
+
+    PMPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    PMPI_Comm_size( MPI_COMM_WORLD, &size );
+
+    /* Times relative to MPI_Init on process 0, on its clock */
+    MTestGetClockOffset( MPI_COMM_WORLD, 20, &offset, &err );
+    t0 = tInit - offset;
+    PMPI_Bcast( &t0, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD );
+
+    /* Put the ring in time order */
+    n       = nextEvent < maxEvents ? nextEvent : maxEvents;
+    first   = nextEvent < maxEvents ? 0 : nextEvent % maxEvents;
+    dropped = nextEvent - n;
+    ev = (traceEvent_t *)malloc( (n > 0 ? n : 1) * sizeof(traceEvent_t) );
+    if (!ev) {
+	fprintf( stderr, "Unable to allocate trace buffer\n" );
+	PMPI_Abort( MPI_COMM_WORLD, 1 );
+    }
+    for (i=0; i<n; i++) {
+	ev[i]     = events[(first + i) % maxEvents];
+	ev[i].t0 -= offset + t0;
+	ev[i].t1 -= offset + t0;
+    }
+    free( events );
+    events = 0;
+
+    PMPI_Reduce( &dropped, &totDropped, 1, MPI_LONG, MPI_SUM, 0,
+		 MPI_COMM_WORLD );
+    PMPI_Type_contiguous( (int)sizeof(traceEvent_t), MPI_BYTE, &eventType );
+    PMPI_Type_commit( &eventType );
+    if (rank == 0) {
+	fname = getenv( "MPITEST_TRACE_FILE" );
+	if (!fname) {
+	    sprintf( defname, "%s-trace.json", progName );
+	    fname = defname;
+	}
+	fp = fopen( fname, "w" );
+	if (!fp) {
+	    fprintf( stderr, "Unable to open trace file %s\n", fname );
+	}
+	else {
+	    fprintf( fp, "{\"traceEvents\":[\n" );
+	    for (r=0; r<size; r++) {
+		fprintf( fp, "%s{\"name\":\"process_name\",\"ph\":\"M\","
+			 "\"pid\":%d,\"args\":{\"name\":\"rank %d\"}}",
+			 r == 0 ? "" : ",\n", r, r );
+	    }
+	    TraceWriteEvents( fp, 0, ev, n );
+	}
+	for (r=1; r<size; r++) {
+	    free( ev );
+	    PMPI_Recv( &n, 1, MPI_LONG, r, 0, MPI_COMM_WORLD,
+		       MPI_STATUS_IGNORE );
+	    ev = (traceEvent_t *)malloc( (n > 0 ? n : 1) *
+					 sizeof(traceEvent_t) );
+	    if (!ev) {
+		fprintf( stderr, "Unable to allocate trace buffer\n" );
+		PMPI_Abort( MPI_COMM_WORLD, 1 );
+	    }
+	    PMPI_Recv( ev, (int)n, eventType, r, 0, MPI_COMM_WORLD,
+		       MPI_STATUS_IGNORE );
+	    if (fp) TraceWriteEvents( fp, r, ev, n );
+	}
+	if (fp) {
+	    fprintf( fp, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":"
+		     "{\"droppedEvents\":%ld}}\n", totDropped );
+	    fclose( fp );
+	}
+	/* The count is also in the trace; any other output would fail the
+	   test under runtests */
+	if (totDropped && getenv( "MPITEST_VERBOSE" )) {
+	    fprintf( stderr, "%ld trace events were dropped; set "
+		     "MPITEST_TRACE_EVENTS to keep more\n", totDropped );
+	}
+    }
+    else {
+	PMPI_Send( &n, 1, MPI_LONG, 0, 0, MPI_COMM_WORLD );
+	PMPI_Send( ev, (int)n, eventType, 0, 0, MPI_COMM_WORLD );
+    }
+    PMPI_Type_free( &eventType );
+    free( ev );
+}
+
+/* Combine the counters and write the summary */
+static void ProfFinalize( void )
+{
+    int          rank, i, j, k, n = 0;
+    long         lval[2*T_MAX], lsum[2*T_MAX];
+    double       dval[T_MAX], dsum[T_MAX], dmax[T_MAX];
+    profThread_t *p;
+    profComm_t   comms[PROF_MAX_COMMS+1];
+    const char   *fname;
+    char         defname[PROG_NAME_LEN+16];
+    FILE         *fp;
+
+    if (!profOn) return;
+    profOn = 0;
+
+    PMPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    for (i=0; i<T_MAX; i++) {
+	lval[i] = lval[T_MAX+i] = 0;
+	dval[i] = 0;
+    }
+    /* Merge the threads; a communicator may have been seen by several */
+    memset( comms, 0, sizeof(comms) );
+    strcpy( comms[PROF_MAX_COMMS].name, "(other)" );
+    for (p = profThreads; p; p = p->next) {
+	for (i=0; i<T_MAX; i++) {
+	    lval[i]       += p->calls[i];
+	    lval[T_MAX+i] += p->bytes[i];
+	    dval[i]       += p->time[i];
+	}
+	for (j=0; j<=PROF_MAX_COMMS; j++) {
+	    if (j == p->ncomms && j < PROF_MAX_COMMS) j = PROF_MAX_COMMS;
+	    if (j == PROF_MAX_COMMS) {
+		k = PROF_MAX_COMMS;
+	    }
+	    else {
+		for (k=0; k<n; k++) {
+		    if (comms[k].comm == p->comms[j].comm) break;
+		}
+		if (k == n) {
+		    if (n < PROF_MAX_COMMS) {
+			comms[n]       = p->comms[j];
+			comms[n].calls = comms[n].bytes = 0;
+			comms[n].time  = 0;
+			n++;
+		    }
+		    else {
+			k = PROF_MAX_COMMS;
+		    }
+		}
+	    }
+	    comms[k].calls += p->comms[j].calls;
+	    comms[k].bytes += p->comms[j].bytes;
+	    comms[k].time  += p->comms[j].time;
+	}
+    }
+
+    PMPI_Reduce( lval, lsum, 2*T_MAX, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD );
+    PMPI_Reduce( dval, dsum, T_MAX, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD );
+    PMPI_Reduce( dval, dmax, T_MAX, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD );
+    if (rank != 0) return;
+
+    fname = getenv( "MPITEST_PROFILE_FILE" );
+    if (!fname) {
+	sprintf( defname, "%s-profile.%s", progName, profCsv ? "csv" : "txt" );
+	fname = defname;
+    }
+    fp = fopen( fname, "w" );
+    if (!fp) {
+	fprintf( stderr, "Unable to open profile file %s\n", fname );
+	return;
+    }
+
+    if (profCsv) {
+	fprintf( fp, "function,calls,bytes,time,maxtime\n" );
+    }
+    else {
+	fprintf( fp, "%-26s%12s%14s%12s%12s%10s\n", "function", "calls",
+		 "bytes", "time (s)", "max (s)", "us/call" );
+    }
+    for (i=0; i<T_MAX; i++) {
+	if (lsum[i] == 0) continue;
+	if (profCsv) {
+	    fprintf( fp, "%s,%ld,%ld,%e,%e\n", fnName[i], lsum[i],
+		     lsum[T_MAX+i], dsum[i], dmax[i] );
+	}
+	else {
+	    fprintf( fp, "%-26s%12ld%14ld%12.6f%12.6f%10.2f\n",
+		     fnName[i], lsum[i], lsum[T_MAX+i], dsum[i], dmax[i],
+		     1.e6 * dsum[i] / lsum[i] );
+	}
+    }
+
+    if (profCsv) {
+	fprintf( fp, "communicator,size,calls,bytes,time\n" );
+    }
+    else {
+	fprintf( fp, "\nprocess 0 %-32s%6s%12s%14s%12s\n", "communicator",
+		 "size", "calls", "bytes", "time (s)" );
+    }
+    for (k=0; k<=PROF_MAX_COMMS; k++) {
+	if (k == n && k < PROF_MAX_COMMS) k = PROF_MAX_COMMS;
+	if (comms[k].calls == 0) continue;
+	if (profCsv) {
+	    fprintf( fp, "%s,%d,%ld,%ld,%e\n", comms[k].name, comms[k].size,
+		     comms[k].calls, comms[k].bytes, comms[k].time );
+	}
+	else {
+	    fprintf( fp, "process 0 %-32.32s%6d%12ld%14ld%12.6f\n",
+		     comms[k].name, comms[k].size, comms[k].calls,
+		     comms[k].bytes, comms[k].time );
+	}
+    }
+    fclose( fp );
+}
+
+/* ------------------------------------------------------------------------ */
+/* Init and finalize                                                        */
+/* ------------------------------------------------------------------------ */
+int MPI_Init( int *argc, char ***argv )
+{
+    int mpi_errno;
+
+    mpi_errno = PMPI_Init( argc, argv );
+    if (mpi_errno == MPI_SUCCESS) TraceSetup( argc, argv );
+    return mpi_errno;
+}
+
+int MPI_Init_thread( int *argc, char ***argv, int required, int *provided )
+{
+    int mpi_errno;
+
+    mpi_errno = PMPI_Init_thread( argc, argv, required, provided );
+    if (mpi_errno == MPI_SUCCESS) TraceSetup( argc, argv );
+    return mpi_errno;
+}
+
+int MPI_Finalize( void )
+{
+    ProfFinalize();
+    TraceFinalize();
+    return PMPI_Finalize();
+}
+
+/* ------------------------------------------------------------------------ */
+/* Point-to-point                                                           */
+/* ------------------------------------------------------------------------ */
+int MPI_Send( MTEST_CONST void *buf, int count, MPI_Datatype datatype,
+	      int dest, int tag, MPI_Comm comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Send( buf, count, datatype, dest, tag, comm );
+    TraceRecord( T_SEND, comm, t0, dest, TraceBytes( count, datatype ) );
+    return mpi_errno;
+}
+
+int MPI_Ssend( MTEST_CONST void *buf, int count, MPI_Datatype datatype,
+	       int dest, int tag, MPI_Comm comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Ssend( buf, count, datatype, dest, tag, comm );
+    TraceRecord( T_SSEND, comm, t0, dest, TraceBytes( count, datatype ) );
+    return mpi_errno;
+}
+
+int MPI_Recv( void *buf, int count, MPI_Datatype datatype, int source,
+	      int tag, MPI_Comm comm, MPI_Status *status )
+{
+    MPI_Status st;
+    double     t0 = PMPI_Wtime();
+    int        mpi_errno;
+
+    /* The status gives the source of a wildcard receive and the bytes
+       actually received */
+    if (status == MPI_STATUS_IGNORE) status = &st;
+    mpi_errno = PMPI_Recv( buf, count, datatype, source, tag, comm, status );
+    if (mpi_errno == MPI_SUCCESS) {
+	TraceRecord( T_RECV, comm, t0, status->MPI_SOURCE,
+		     TraceStatusBytes( status ) );
+    }
+    else {
+	TraceRecord( T_RECV, comm, t0, source, -1 );
+    }
+    return mpi_errno;
+}
+
+int MPI_Sendrecv( MTEST_CONST void *sendbuf, int sendcount,
+		  MPI_Datatype sendtype, int dest, int sendtag, void *recvbuf,
+		  int recvcount, MPI_Datatype recvtype, int source,
+		  int recvtag, MPI_Comm comm, MPI_Status *status )
+{
+    MPI_Status st;
+    double     t0 = PMPI_Wtime();
+    long       bytes;
+    int        mpi_errno;
+
+    if (status == MPI_STATUS_IGNORE) status = &st;
+    mpi_errno = PMPI_Sendrecv( sendbuf, sendcount, sendtype, dest, sendtag,
+			       recvbuf, recvcount, recvtype, source, recvtag,
+			       comm, status );
+    /* Both directions: the bytes sent and the bytes actually received */
+    bytes = TraceBytes( sendcount, sendtype );
+    if (mpi_errno == MPI_SUCCESS && TraceStatusBytes( status ) > 0) {
+	bytes += TraceStatusBytes( status );
+    }
+    TraceRecord( T_SENDRECV, comm, t0, dest, bytes );
+    return mpi_errno;
+}
+
+int MPI_Isend( MTEST_CONST void *buf, int count, MPI_Datatype datatype,
+	       int dest, int tag, MPI_Comm comm, MPI_Request *request )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Isend( buf, count, datatype, dest, tag, comm,
+				   request );
+    TraceRecord( T_ISEND, comm, t0, dest, TraceBytes( count, datatype ) );
+    return mpi_errno;
+}
+
+int MPI_Irecv( void *buf, int count, MPI_Datatype datatype, int source,
+	       int tag, MPI_Comm comm, MPI_Request *request )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Irecv( buf, count, datatype, source, tag, comm,
+				   request );
+    /* The size, and the source of a wildcard receive, are only known when
+       the receive completes, so no bytes are recorded here */
+    TraceRecord( T_IRECV, comm, t0, source == MPI_ANY_SOURCE ? -1 : source,
+		 -1 );
+    return mpi_errno;
+}
+
+int MPI_Wait( MPI_Request *request, MPI_Status *status )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Wait( request, status );
+    TraceRecord( T_WAIT, MPI_COMM_NULL, t0, -1, -1 );
+    return mpi_errno;
+}
+
+int MPI_Waitall( int count, MPI_Request array_of_requests[],
+		 MPI_Status array_of_statuses[] )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Waitall( count, array_of_requests,
+				     array_of_statuses );
+    TraceRecord( T_WAITALL, MPI_COMM_NULL, t0, -1, -1 );
+    return mpi_errno;
+}
+
+int MPI_Waitany( int count, MPI_Request array_of_requests[], int *indx,
+		 MPI_Status *status )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Waitany( count, array_of_requests, indx,
+				     status );
+    TraceRecord( T_WAITANY, MPI_COMM_NULL, t0, -1, -1 );
+    return mpi_errno;
+}
+
+int MPI_Test( MPI_Request *request, int *flag, MPI_Status *status )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Test( request, flag, status );
+    TraceRecord( T_TEST, MPI_COMM_NULL, t0, -1, -1 );
+    return mpi_errno;
+}
+
+int MPI_Probe( int source, int tag, MPI_Comm comm, MPI_Status *status )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Probe( source, tag, comm, status );
+    TraceRecord( T_PROBE, comm, t0, source, -1 );
+    return mpi_errno;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Collectives                                                              */
+/* ------------------------------------------------------------------------ */
+int MPI_Barrier( MPI_Comm comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Barrier( comm );
+    TraceRecord( T_BARRIER, comm, t0, -1, -1 );
+    return mpi_errno;
+}
+
+int MPI_Bcast( void *buffer, int count, MPI_Datatype datatype, int root,
+	       MPI_Comm comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Bcast( buffer, count, datatype, root, comm );
+    TraceRecord( T_BCAST, comm, t0, root, TraceBytes( count, datatype ) );
+    return mpi_errno;
+}
+
+int MPI_Reduce( MTEST_CONST void *sendbuf, void *recvbuf, int count,
+		MPI_Datatype datatype, MPI_Op op, int root, MPI_Comm comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Reduce( sendbuf, recvbuf, count, datatype, op,
+				    root, comm );
+    TraceRecord( T_REDUCE, comm, t0, root, TraceBytes( count, datatype ) );
+    return mpi_errno;
+}
+
+int MPI_Allreduce( MTEST_CONST void *sendbuf, void *recvbuf, int count,
+		   MPI_Datatype datatype, MPI_Op op, MPI_Comm comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Allreduce( sendbuf, recvbuf, count, datatype, op,
+				       comm );
+    TraceRecord( T_ALLREDUCE, comm, t0, -1, TraceBytes( count, datatype ) );
+    return mpi_errno;
+}
+
+int MPI_Gather( MTEST_CONST void *sendbuf, int sendcount,
+		MPI_Datatype sendtype, void *recvbuf, int recvcount,
+		MPI_Datatype recvtype, int root, MPI_Comm comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Gather( sendbuf, sendcount, sendtype, recvbuf,
+				    recvcount, recvtype, root, comm );
+    TraceRecord( T_GATHER, comm, t0, root, TraceBytes( sendcount, sendtype ) );
+    return mpi_errno;
+}
+
+int MPI_Scatter( MTEST_CONST void *sendbuf, int sendcount,
+		 MPI_Datatype sendtype, void *recvbuf, int recvcount,
+		 MPI_Datatype recvtype, int root, MPI_Comm comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Scatter( sendbuf, sendcount, sendtype, recvbuf,
+				     recvcount, recvtype, root, comm );
+    TraceRecord( T_SCATTER, comm, t0, root,
+		 TraceBytes( recvcount, recvtype ) );
+    return mpi_errno;
+}
+
+int MPI_Allgather( MTEST_CONST void *sendbuf, int sendcount,
+		   MPI_Datatype sendtype, void *recvbuf, int recvcount,
+		   MPI_Datatype recvtype, MPI_Comm comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Allgather( sendbuf, sendcount, sendtype, recvbuf,
+				       recvcount, recvtype, comm );
+    TraceRecord( T_ALLGATHER, comm, t0, -1,
+		 TraceBytes( recvcount, recvtype ) );
+    return mpi_errno;
+}
+
+int MPI_Alltoall( MTEST_CONST void *sendbuf, int sendcount,
+		  MPI_Datatype sendtype, void *recvbuf, int recvcount,
+		  MPI_Datatype recvtype, MPI_Comm comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Alltoall( sendbuf, sendcount, sendtype, recvbuf,
+				      recvcount, recvtype, comm );
+    TraceRecord( T_ALLTOALL, comm, t0, -1, TraceBytes( recvcount, recvtype ) );
+    return mpi_errno;
+}
+
+int MPI_Reduce_scatter_block( MTEST_CONST void *sendbuf, void *recvbuf,
+			      int recvcount, MPI_Datatype datatype, MPI_Op op,
+			      MPI_Comm comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Reduce_scatter_block( sendbuf, recvbuf,
+						  recvcount, datatype, op,
+						  comm );
+    TraceRecord( T_REDSCAT_BLOCK, comm, t0, -1,
+		 TraceBytes( recvcount, datatype ) );
+    return mpi_errno;
+}
+
+int MPI_Scan( MTEST_CONST void *sendbuf, void *recvbuf, int count,
+	      MPI_Datatype datatype, MPI_Op op, MPI_Comm comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Scan( sendbuf, recvbuf, count, datatype, op,
+				  comm );
+    TraceRecord( T_SCAN, comm, t0, -1, TraceBytes( count, datatype ) );
+    return mpi_errno;
+}
+
+int MPI_Exscan( MTEST_CONST void *sendbuf, void *recvbuf, int count,
+		MPI_Datatype datatype, MPI_Op op, MPI_Comm comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Exscan( sendbuf, recvbuf, count, datatype, op,
+				    comm );
+    TraceRecord( T_EXSCAN, comm, t0, -1, TraceBytes( count, datatype ) );
+    return mpi_errno;
+}
+
+#ifdef TRACE_MPI3_ROUTINES
+int MPI_Ibarrier( MPI_Comm comm, MPI_Request *request )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Ibarrier( comm, request );
+    TraceRecord( T_IBARRIER, comm, t0, -1, -1 );
+    return mpi_errno;
+}
+
+int MPI_Ibcast( void *buffer, int count, MPI_Datatype datatype, int root,
+		MPI_Comm comm, MPI_Request *request )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Ibcast( buffer, count, datatype, root, comm,
+				    request );
+    TraceRecord( T_IBCAST, comm, t0, root, TraceBytes( count, datatype ) );
+    return mpi_errno;
+}
+
+int MPI_Iallreduce( MTEST_CONST void *sendbuf, void *recvbuf, int count,
+		    MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+		    MPI_Request *request )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Iallreduce( sendbuf, recvbuf, count, datatype,
+					op, comm, request );
+    TraceRecord( T_IALLREDUCE, comm, t0, -1, TraceBytes( count, datatype ) );
+    return mpi_errno;
+}
+#endif
+
+/* ------------------------------------------------------------------------ */
+/* Communicators                                                            */
+/* ------------------------------------------------------------------------ */
+int MPI_Comm_dup( MPI_Comm comm, MPI_Comm *newcomm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Comm_dup( comm, newcomm );
+    TraceRecord( T_COMM_DUP, comm, t0, -1, -1 );
+    return mpi_errno;
+}
+
+int MPI_Comm_split( MPI_Comm comm, int color, int key, MPI_Comm *newcomm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Comm_split( comm, color, key, newcomm );
+    TraceRecord( T_COMM_SPLIT, comm, t0, -1, -1 );
+    return mpi_errno;
+}
+
+int MPI_Comm_free( MPI_Comm *comm )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Comm_free( comm );
+    TraceRecord( T_COMM_FREE, MPI_COMM_NULL, t0, -1, -1 );
+    return mpi_errno;
+}
+
+/* ------------------------------------------------------------------------ */
+/* RMA                                                                      */
+/* ------------------------------------------------------------------------ */
+int MPI_Win_fence( int assert, MPI_Win win )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Win_fence( assert, win );
+    TraceRecord( T_WIN_FENCE, MPI_COMM_NULL, t0, -1, -1 );
+    return mpi_errno;
+}
+
+int MPI_Win_lock( int lock_type, int rank, int assert, MPI_Win win )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Win_lock( lock_type, rank, assert, win );
+    TraceRecord( T_WIN_LOCK, MPI_COMM_NULL, t0, rank, -1 );
+    return mpi_errno;
+}
+
+int MPI_Win_unlock( int rank, MPI_Win win )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Win_unlock( rank, win );
+    TraceRecord( T_WIN_UNLOCK, MPI_COMM_NULL, t0, rank, -1 );
+    return mpi_errno;
+}
+
+#ifdef TRACE_MPI3_ROUTINES
+int MPI_Win_flush( int rank, MPI_Win win )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Win_flush( rank, win );
+    TraceRecord( T_WIN_FLUSH, MPI_COMM_NULL, t0, rank, -1 );
+    return mpi_errno;
+}
+#endif
+
+int MPI_Put( MTEST_CONST void *origin_addr, int origin_count,
+	     MPI_Datatype origin_datatype, int target_rank,
+	     MPI_Aint target_disp, int target_count,
+	     MPI_Datatype target_datatype, MPI_Win win )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Put( origin_addr, origin_count, origin_datatype,
+				 target_rank, target_disp, target_count,
+				 target_datatype, win );
+    TraceRecord( T_PUT, MPI_COMM_NULL, t0, target_rank,
+		 TraceBytes( origin_count, origin_datatype ) );
+    return mpi_errno;
+}
+
+int MPI_Get( void *origin_addr, int origin_count,
+	     MPI_Datatype origin_datatype, int target_rank,
+	     MPI_Aint target_disp, int target_count,
+	     MPI_Datatype target_datatype, MPI_Win win )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Get( origin_addr, origin_count, origin_datatype,
+				 target_rank, target_disp, target_count,
+				 target_datatype, win );
+    TraceRecord( T_GET, MPI_COMM_NULL, t0, target_rank,
+		 TraceBytes( origin_count, origin_datatype ) );
+    return mpi_errno;
+}
+
+int MPI_Accumulate( MTEST_CONST void *origin_addr, int origin_count,
+		    MPI_Datatype origin_datatype, int target_rank,
+		    MPI_Aint target_disp, int target_count,
+		    MPI_Datatype target_datatype, MPI_Op op, MPI_Win win )
+{
+    double t0 = PMPI_Wtime();
+    int    mpi_errno = PMPI_Accumulate( origin_addr, origin_count,
+					origin_datatype, target_rank,
+					target_disp, target_count,
+					target_datatype, op, win );
+    TraceRecord( T_ACCUMULATE, MPI_COMM_NULL, t0, target_rank,
+		 TraceBytes( origin_count, origin_datatype ) );
+    return mpi_errno;
+}